@@ -0,0 +1,59 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Native functions callable from MathLang like any other function. The Compiler emits `native name` for them
+// unless a user function of the same name is visible, the Translator stores the name in the symbols section and
+// the VM resolves it to an index into builtins when it loads the program.
+
+// Arguments in source order
+using BuiltinFunc = double(*)(const double *args);
+
+struct Builtin {
+    const char *name;
+    uint32_t argsCount;
+    BuiltinFunc func;
+};
+
+const uint32_t MaxBuiltinArgsCount = 2;
+
+inline double builtinSqrt(const double *args) { return std::sqrt(args[0]); }
+inline double builtinExp(const double *args) { return std::exp(args[0]); }
+inline double builtinLog(const double *args) { return std::log(args[0]); }
+inline double builtinSin(const double *args) { return std::sin(args[0]); }
+inline double builtinCos(const double *args) { return std::cos(args[0]); }
+inline double builtinTan(const double *args) { return std::tan(args[0]); }
+inline double builtinAbs(const double *args) { return std::fabs(args[0]); }
+inline double builtinFloor(const double *args) { return std::floor(args[0]); }
+inline double builtinCeil(const double *args) { return std::ceil(args[0]); }
+inline double builtinMin(const double *args) { return std::fmin(args[0], args[1]); }
+inline double builtinMax(const double *args) { return std::fmax(args[0], args[1]); }
+inline double builtinPow(const double *args) { return std::pow(args[0], args[1]); }
+
+inline const Builtin builtins[] = {
+    { "sqrt", 1, builtinSqrt },
+    { "exp", 1, builtinExp },
+    { "log", 1, builtinLog },
+    { "sin", 1, builtinSin },
+    { "cos", 1, builtinCos },
+    { "tan", 1, builtinTan },
+    { "abs", 1, builtinAbs },
+    { "floor", 1, builtinFloor },
+    { "ceil", 1, builtinCeil },
+    { "min", 2, builtinMin },
+    { "max", 2, builtinMax },
+    { "pow", 2, builtinPow }
+};
+
+const size_t BuiltinsCount = sizeof(builtins)/sizeof(builtins[0]);
+
+// Returns the index into builtins or BuiltinsCount if there is no builtin with this name
+inline size_t findBuiltin(const char *name) {
+    for (size_t i = 0; i < BuiltinsCount; i++) {
+        if (strcmp(builtins[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return BuiltinsCount;
+}
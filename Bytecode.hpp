@@ -1,6 +1,16 @@
 #pragma once
 #include <cstdint>
 
+const uint32_t BytecodeMagic = 0x00424C4D; // "MLB"
+const uint16_t BytecodeVersion = 2;
+// Call depth the VM is sized for when a program is recursive
+const uint32_t DefaultMaxCallDepth = 1 << 14;
+// Largest stack and frame capacities a header may ask for, the VM allocates them up front
+const uint32_t MaxStackDepth = 1 << 24;
+const uint32_t MaxFrameSlots = 1 << 24;
+// Most arguments a memoized function may have, a memo table entry with its key fills one cache line
+const uint32_t MaxMemoArgsCount = 6;
+
 enum class OpCode : uint8_t {
     Jmp,
     Call,
@@ -15,7 +25,105 @@ enum class OpCode : uint8_t {
     Get,
     Unset,
     Int,
+    Enter,
+    LoadLocal,
+    StoreLocal,
+    LoadOuter,
+    RegLoadK,
+    RegMove,
+    RegAdd,
+    RegSub,
+    RegMul,
+    RegDiv,
+    RegLoadOuter,
+    RegCall,
+    RegRet,
+    RegPrint,
+    // Tail calls reuse the return stack entry and the frame of the function that makes them
+    RegTailCall,
+    TailCall,
+    // Calls of the functions in Builtins.hpp, the operand is the symbol of the builtin name
+    RegNative,
+    Native,
+    // Shared by both engines, placed after the arguments of a pure function are in its frame. Returns a result
+    // remembered for the same arguments at once, otherwise the result gets remembered when the function returns.
+    Memo,
+    // Vector values, see VM/VectorPool.hpp. Vec packs the last size values into a new vector in source order,
+    // VecDot and VecSum reduce to a number. Elementwise arithmetic and builtins use the scalar opcodes.
+    Vec,
+    VecDot,
+    VecSum,
+    RegVec,
+    RegVecDot,
+    RegVecSum,
+    // Unary minus as the compiler emitted it before, 0 - x, so that -0 and the vector broadcast behave the same
+    Neg,
+    RegNeg,
+    // Superinstructions created by the VM when it loads stack code, never present in .mlb files
+    LoadLocal2,
+    LoadLocalAdd,
+    LoadLocalSub,
+    LoadLocalMul,
+    LoadLocalDiv,
+    LoadLocal2Add,
+    LoadLocal2Sub,
+    LoadLocal2Mul,
+    LoadLocal2Div,
+    StoreLocal2,
+    PushLoadLocal,
+    // Created by the VM behind the halt sentinel, the return address of a call whose result goes to the memo table
+    MemoReturn,
     _Count
 };
 
-using LabelAddress = uint32_t;
\ No newline at end of file
+using LabelAddress = uint32_t;
+// Index of a function scope, 0 is the top level
+using ScopeIndex = uint16_t;
+// Index of a variable inside the frame of its scope
+using SlotIndex = uint16_t;
+
+enum class BytecodeFlags : uint16_t {
+    None = 0,
+    Recursive = 1 << 0,
+    // Code uses the Reg* opcodes of the register engine instead of the operand stack
+    Register = 1 << 1
+};
+
+// Leading header of every .mlb file, followed by sectionsCount SectionEntry records
+struct BytecodeHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t flags;
+    // Capacities from the Translator's max-depth analysis
+    uint32_t stackDepth;
+    uint32_t callDepth;
+    uint32_t frameSlots;
+    // Code address the program starts at
+    LabelAddress entry;
+    uint32_t sectionsCount;
+};
+
+enum class SectionType : uint32_t {
+    // Instructions, every code address is relative to the start of this section
+    Code = 1,
+    // Distinct doubles referenced by index from Push and RegLoadK
+    Constants = 2,
+    // Null-terminated names referenced by index from Set, Get, Unset and the function table
+    Symbols = 3,
+    // FunctionEntry records
+    Functions = 4
+};
+
+// Loaders skip sections of unknown types, so new ones can be added without a version bump
+struct SectionEntry {
+    SectionType type;
+    // Offset from the start of the file
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct FunctionEntry {
+    LabelAddress address;
+    // Index of the label name in the symbols section
+    uint32_t name;
+};
\ No newline at end of file
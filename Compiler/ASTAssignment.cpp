@@ -14,3 +14,7 @@ void ASTAssignment::codegen(CodeBuilder &builder) {
     mExpr->codegen(builder);
     builder.genSet(mVarName);
 }
+
+void ASTAssignment::optimize(OptLevel level) {
+    ASTExpr::simplify(mExpr, level);
+}
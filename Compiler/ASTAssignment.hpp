@@ -10,6 +10,7 @@ public:
 
     void print(int tabs) override;
     void codegen(CodeBuilder &builder) override;
+    void optimize(OptLevel level) override;
 
 private:
     std::string mVarName;
@@ -1,4 +1,24 @@
 #include "ASTExpr.hpp"
 
 void ASTExpr::print(int tabs) {
+}
+
+bool ASTExpr::getConstant(double &value) const {
+    return false;
+}
+
+bool ASTExpr::splitConstant(char op, double &constant, std::unique_ptr<ASTExpr> &rest) {
+    return false;
+}
+
+void ASTExpr::simplify(std::unique_ptr<ASTExpr> &expr, OptLevel level) {
+    expr->optimize(level);
+    std::unique_ptr<ASTExpr> simplified = expr->mSimplify(level);
+    if (simplified) {
+        expr = std::move(simplified);
+    }
+}
+
+std::unique_ptr<ASTExpr> ASTExpr::mSimplify(OptLevel level) {
+    return nullptr;
 }
\ No newline at end of file
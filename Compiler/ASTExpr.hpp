@@ -1,7 +1,19 @@
 #pragma once
 #include "ASTStatement.hpp"
+#include <memory>
 
 class ASTExpr : public ASTStatement {
 public:
     void print(int tabs) override;
+    // False for anything but a number
+    virtual bool getConstant(double &value) const;
+    // For c op x with a constant c, gives c and moves x to rest. This expression is left empty and must be dropped.
+    virtual bool splitConstant(char op, double &constant, std::unique_ptr<ASTExpr> &rest);
+
+    // Optimizes the subexpressions of expr, then replaces expr with a simpler equivalent if there is one
+    static void simplify(std::unique_ptr<ASTExpr> &expr, OptLevel level);
+
+protected:
+    // Called with the subexpressions already simplified, nullptr keeps this expression
+    virtual std::unique_ptr<ASTExpr> mSimplify(OptLevel level);
 };
\ No newline at end of file
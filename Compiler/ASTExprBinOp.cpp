@@ -1,5 +1,29 @@
 #include "ASTExprBinOp.hpp"
+#include "ASTExprNumber.hpp"
+#include "ASTExprNeg.hpp"
 #include "CodeBuilder.hpp"
+#include <cmath>
+
+// Computes lhs op rhs as the VM would, false if the result is inf or NaN, which have no literal
+static bool foldConstants(char op, double lhs, double rhs, double &value) {
+    if (op == '+') {
+        value = lhs + rhs;
+    }
+    else if (op == '-') {
+        value = lhs - rhs;
+    }
+    else if (op == '*') {
+        value = lhs*rhs;
+    }
+    else {
+        value = lhs / rhs;
+    }
+    return std::isfinite(value);
+}
+
+static bool isPositiveZero(double value) {
+    return value == 0 && !std::signbit(value);
+}
 
 ASTExprBinOp::ASTExprBinOp(char op, std::unique_ptr<ASTExpr> lhs, std::unique_ptr<ASTExpr> rhs) : mLHS(std::move(lhs)), mRHS(std::move(rhs)) {
     mOp = op;
@@ -16,3 +40,81 @@ void ASTExprBinOp::codegen(CodeBuilder &builder) {
     mLHS->codegen(builder);
     builder.genBinOp(mOp);
 }
+
+
+void ASTExprBinOp::optimize(OptLevel level) {
+    simplify(mLHS, level);
+    simplify(mRHS, level);
+}
+
+bool ASTExprBinOp::splitConstant(char op, double &constant, std::unique_ptr<ASTExpr> &rest) {
+    if (mOp != op || !mLHS->getConstant(constant)) {
+        return false;
+    }
+    rest = std::move(mRHS);
+    return true;
+}
+
+std::unique_ptr<ASTExpr> ASTExprBinOp::mSimplify(OptLevel level) {
+    double lhs, rhs, value;
+    bool isConstantLhs = mLHS->getConstant(lhs);
+    bool isConstantRhs = mRHS->getConstant(rhs);
+    if (isConstantLhs && isConstantRhs) {
+        return foldConstants(mOp, lhs, rhs, value) ? std::make_unique<ASTExprNumber>(value) : nullptr;
+    }
+    // Exact for every operand, -0, inf, NaN and vectors included. x - (-0) and x + 0 turn -0 into +0.
+    if (isConstantRhs && (((mOp == '*' || mOp == '/') && rhs == 1) || (mOp == '-' && isPositiveZero(rhs)))) {
+        return std::move(mLHS);
+    }
+    if (isConstantLhs && mOp == '*' && lhs == 1) {
+        return std::move(mRHS);
+    }
+    // The parser's unary minus
+    if (isConstantLhs && mOp == '-' && isPositiveZero(lhs)) {
+        return std::make_unique<ASTExprNeg>(std::move(mRHS));
+    }
+    if (level != OptLevel::Fast) {
+        return nullptr;
+    }
+    if (isConstantRhs && mOp == '+' && rhs == 0) {
+        return std::move(mLHS);
+    }
+    if (isConstantLhs && mOp == '+' && lhs == 0) {
+        return std::move(mRHS);
+    }
+    if (mOp == '+' || mOp == '*') {
+        return mReassociate();
+    }
+    return nullptr;
+}
+
+std::unique_ptr<ASTExpr> ASTExprBinOp::mReassociate() {
+    // Constants move to the left and up the tree until they meet, c1 op (c2 op x) is then folded to c op x.
+    // Only constants change places, so the other operands are still evaluated in the same order.
+    double lhs, constant;
+    std::unique_ptr<ASTExpr> rest;
+    if (mRHS->getConstant(constant)) {
+        std::swap(mLHS, mRHS);
+    }
+    if (mLHS->getConstant(lhs)) {
+        if (!mRHS->splitConstant(mOp, constant, rest)) {
+            return nullptr;
+        }
+        double value;
+        if (!foldConstants(mOp, lhs, constant, value)) {
+            mRHS = std::make_unique<ASTExprBinOp>(mOp, std::make_unique<ASTExprNumber>(constant), std::move(rest));
+            return nullptr;
+        }
+        return std::make_unique<ASTExprBinOp>(mOp, std::make_unique<ASTExprNumber>(value), std::move(rest));
+    }
+    // x op (c op y) -> c op (x op y), (c op y) op x -> c op (y op x)
+    if (mRHS->splitConstant(mOp, constant, rest)) {
+        auto inner = std::make_unique<ASTExprBinOp>(mOp, std::move(mLHS), std::move(rest));
+        return std::make_unique<ASTExprBinOp>(mOp, std::make_unique<ASTExprNumber>(constant), std::move(inner));
+    }
+    if (mLHS->splitConstant(mOp, constant, rest)) {
+        auto inner = std::make_unique<ASTExprBinOp>(mOp, std::move(rest), std::move(mRHS));
+        return std::make_unique<ASTExprBinOp>(mOp, std::make_unique<ASTExprNumber>(constant), std::move(inner));
+    }
+    return nullptr;
+}
@@ -8,8 +8,15 @@ public:
 
     void print(int tabs) override;
     void codegen(CodeBuilder &builder) override;
+    void optimize(OptLevel level) override;
+    bool splitConstant(char op, double &constant, std::unique_ptr<ASTExpr> &rest) override;
+
+protected:
+    std::unique_ptr<ASTExpr> mSimplify(OptLevel level) override;
 
 private:
+    std::unique_ptr<ASTExpr> mReassociate();
+
     char mOp;
     std::unique_ptr<ASTExpr> mLHS, mRHS;
 };
\ No newline at end of file
@@ -16,5 +16,11 @@ void ASTExprCallFunc::codegen(CodeBuilder &builder) {
     for (auto it = mArgs.cbegin(); it != mArgs.cend(); it++) {
         (*it)->codegen(builder);
     }
-    builder.genCall(mFuncName);
+    builder.genCall(mFuncName, mArgs.size());
+}
+
+void ASTExprCallFunc::optimize(OptLevel level) {
+    for (auto &arg : mArgs) {
+        simplify(arg, level);
+    }
 }
\ No newline at end of file
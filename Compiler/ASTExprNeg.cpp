@@ -0,0 +1,28 @@
+#include "ASTExprNeg.hpp"
+#include "ASTExprNumber.hpp"
+#include "CodeBuilder.hpp"
+
+ASTExprNeg::ASTExprNeg(std::unique_ptr<ASTExpr> expr) : mExpr(std::move(expr)) {
+}
+
+void ASTExprNeg::print(int tabs) {
+    mPrint(tabs, "ExprNeg");
+    mExpr->print(tabs + 1);
+}
+
+void ASTExprNeg::codegen(CodeBuilder &builder) {
+    mExpr->codegen(builder);
+    builder.genNeg();
+}
+
+void ASTExprNeg::optimize(OptLevel level) {
+    simplify(mExpr, level);
+}
+
+std::unique_ptr<ASTExpr> ASTExprNeg::mSimplify(OptLevel level) {
+    double value;
+    if (mExpr->getConstant(value)) {
+        return std::make_unique<ASTExprNumber>(0.0 - value);
+    }
+    return nullptr;
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+#include "ASTExpr.hpp"
+#include <memory>
+
+// Unary minus, only created by the optimizer from the 0 - x the parser builds
+class ASTExprNeg : public ASTExpr {
+public:
+    ASTExprNeg(std::unique_ptr<ASTExpr> expr);
+
+    void print(int tabs) override;
+    void codegen(CodeBuilder &builder) override;
+    void optimize(OptLevel level) override;
+
+protected:
+    std::unique_ptr<ASTExpr> mSimplify(OptLevel level) override;
+
+private:
+    std::unique_ptr<ASTExpr> mExpr;
+};
\ No newline at end of file
@@ -11,4 +11,9 @@ void ASTExprNumber::print(int tabs) {
 
 void ASTExprNumber::codegen(CodeBuilder &builder) {
     builder.genPush(mValue);
+}
+
+bool ASTExprNumber::getConstant(double &value) const {
+    value = mValue;
+    return true;
 }
\ No newline at end of file
@@ -7,6 +7,7 @@ public:
 
     void print(int tabs) override;
     void codegen(CodeBuilder &builder) override;
+    bool getConstant(double &value) const override;
 
 private:
     double mValue;
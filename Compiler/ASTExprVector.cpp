@@ -0,0 +1,25 @@
+#include "ASTExprVector.hpp"
+#include "CodeBuilder.hpp"
+
+ASTExprVector::ASTExprVector(std::vector<std::unique_ptr<ASTExpr>> &elements) : mElements(std::move(elements)) {
+}
+
+void ASTExprVector::print(int tabs) {
+    mPrint(tabs, "ExprVector");
+    for (const auto &element : mElements) {
+        element->print(tabs + 1);
+    }
+}
+
+void ASTExprVector::codegen(CodeBuilder &builder) {
+    for (auto it = mElements.cbegin(); it != mElements.cend(); it++) {
+        (*it)->codegen(builder);
+    }
+    builder.genVector(mElements.size());
+}
+
+void ASTExprVector::optimize(OptLevel level) {
+    for (auto &element : mElements) {
+        simplify(element, level);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#pragma once
+#include "ASTExpr.hpp"
+#include <vector>
+#include <memory>
+
+class ASTExprVector : public ASTExpr {
+public:
+    ASTExprVector(std::vector<std::unique_ptr<ASTExpr>> &elements);
+
+    void print(int tabs) override;
+    void codegen(CodeBuilder &builder) override;
+    void optimize(OptLevel level) override;
+
+private:
+    std::vector<std::unique_ptr<ASTExpr>> mElements;
+};
\ No newline at end of file
@@ -1,8 +1,9 @@
 #include "ASTFuncDef.hpp"
 #include "CodeBuilder.hpp"
 
-ASTFuncDef::ASTFuncDef(const std::string &funcName, const std::vector<std::string> &argNames,
-    std::vector<std::unique_ptr<ASTStatement>> &statements) : mFuncName(funcName), mArgNames(argNames), mStatements(std::move(statements)) {
+ASTFuncDef::ASTFuncDef(const std::string &funcName, const std::vector<std::string> &argNames, const std::vector<std::string> &pragmas,
+    std::vector<std::unique_ptr<ASTStatement>> &statements) : mFuncName(funcName), mArgNames(argNames), mPragmas(pragmas),
+    mStatements(std::move(statements)) {
 }
 
 void ASTFuncDef::print(int tabs) {
@@ -12,16 +13,27 @@ void ASTFuncDef::print(int tabs) {
     }
     args.pop_back();
     args += "]";
-    mPrint(tabs, "FuncDef{" + mFuncName + "; " + args + "}");
+    std::string pragmas;
+    for (const auto &pragma : mPragmas) {
+        pragmas += "; #pragma " + pragma;
+    }
+    mPrint(tabs, "FuncDef{" + mFuncName + "; " + args + pragmas + "}");
     for (const auto &statement : mStatements) {
         statement->print(tabs + 1);
     }
 }
 
 void ASTFuncDef::codegen(CodeBuilder &builder) {
-    builder.beginFunc(mFuncName, mArgNames);
+    builder.beginFunc(mFuncName, mArgNames, mPragmas);
     for (const auto &it : mStatements) {
         it->codegen(builder);
+        builder.endStatement();
     }
     builder.endFunc();
+}
+
+void ASTFuncDef::optimize(OptLevel level) {
+    for (const auto &statement : mStatements) {
+        statement->optimize(level);
+    }
 }
\ No newline at end of file
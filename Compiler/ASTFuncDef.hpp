@@ -5,14 +5,16 @@
 
 class ASTFuncDef : public ASTStatement {
 public:
-    ASTFuncDef(const std::string &funcName, const std::vector<std::string> &argNames, 
-               std::vector<std::unique_ptr<ASTStatement>> &statements);
+    ASTFuncDef(const std::string &funcName, const std::vector<std::string> &argNames,
+               const std::vector<std::string> &pragmas, std::vector<std::unique_ptr<ASTStatement>> &statements);
 
     void print(int tabs) override;
     void codegen(CodeBuilder &builder) override;
+    void optimize(OptLevel level) override;
 
 private:
     std::string mFuncName;
     std::vector<std::string> mArgNames;
+    std::vector<std::string> mPragmas;
     std::vector<std::unique_ptr<ASTStatement>> mStatements;
 };
\ No newline at end of file
@@ -13,4 +13,8 @@ void ASTReturn::print(int tabs) {
 void ASTReturn::codegen(CodeBuilder &builder) {
     mExpr->codegen(builder);
     builder.genReturn();
+}
+
+void ASTReturn::optimize(OptLevel level) {
+    ASTExpr::simplify(mExpr, level);
 }
\ No newline at end of file
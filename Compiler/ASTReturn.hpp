@@ -11,6 +11,7 @@ public:
 
     void print(int tabs) override;
     void codegen(CodeBuilder &builder) override;
+    void optimize(OptLevel level) override;
 
 private:
     std::unique_ptr<ASTExpr> mExpr;
@@ -1,5 +1,6 @@
 #include "ASTRoot.hpp"
 #include "ASTStatement.hpp"
+#include "CodeBuilder.hpp"
 
 ASTRoot::ASTRoot(std::vector<std::unique_ptr<ASTStatement>> &statements) : mStatements(std::move(statements)) {
 }
@@ -10,8 +11,21 @@ void ASTRoot::print() {
     }
 }
 
+void ASTRoot::optimize(OptLevel level) {
+    if (level == OptLevel::None) {
+        return;
+    }
+    // The value of an expression statement is dropped, simplifying its subexpressions is enough
+    for (const auto &statement : mStatements) {
+        statement->optimize(level);
+    }
+}
+
 void ASTRoot::codegen(CodeBuilder &builder) {
+    builder.beginRoot();
     for (const auto &statement : mStatements) {
         statement->codegen(builder);
+        builder.endStatement();
     }
+    builder.endRoot();
 }
\ No newline at end of file
@@ -1,15 +1,15 @@
 #pragma once
+#include "ASTStatement.hpp"
 #include <vector>
 #include <memory>
 
-class ASTStatement;
-class CodeBuilder;
-
 class ASTRoot {
 public:
     ASTRoot(std::vector<std::unique_ptr<ASTStatement>> &statements);
 
     void print();
+    // The optimization pass, runs once between Parser::process and codegen
+    void optimize(OptLevel level);
     void codegen(CodeBuilder &builder);
 
 private:
@@ -6,6 +6,9 @@ void ASTStatement::print(int tabs) {
 void ASTStatement::codegen(CodeBuilder &builder) {
 }
 
+void ASTStatement::optimize(OptLevel level) {
+}
+
 void ASTStatement::mPrint(int tabs, const std::string &text) {
     for (int i = 0; i < tabs; i++) {
         printf("  ");
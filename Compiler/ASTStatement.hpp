@@ -3,10 +3,23 @@
 
 class CodeBuilder;
 
+// Rewrites done between parsing and codegen, -O0 to -O2 on the command line
+enum class OptLevel {
+    // The code as written
+    None,
+    // Constant folding and the identities that give bit-identical results for every value, then the IRBuilder merges
+    // common subexpressions and copies
+    Exact,
+    // Also x + 0 and regrouping of constants, which may change the sign of a zero or the rounding
+    Fast
+};
+
 class ASTStatement {
 public:
     virtual void print(int tabs);
     virtual void codegen(CodeBuilder &builder);
+    // Simplifies the expressions of the statement in place
+    virtual void optimize(OptLevel level);
 
 protected:
     void mPrint(int tabs, const std::string &text);
@@ -1,116 +1,539 @@
 #include "CodeBuilder.hpp"
-#include <cstdarg>
+#include "../Builtins.hpp"
+#include "../Translator/BytecodeWriter.hpp"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+// Builtins the VM implements as opcodes on vectors, user functions shadow them as any other builtin
+static const struct {
+    const char *name;
+    size_t argsCount;
+    OpCode opCode;
+    OpCode regOpCode;
+} intrinsics[] = {
+    { "dot", 2, OpCode::VecDot, OpCode::RegVecDot },
+    { "sum", 1, OpCode::VecSum, OpCode::RegVecSum }
+};
+
+// Assembly mnemonics, a register opcode shares the one of its stack counterpart
+static const char *getMnemonic(OpCode opCode) {
+    static const char *mnemonics[] = {
+        "jmp", "call", "ret", "add", "sub", "mul", "div", "push", "pop", "set", "get", "unset", "int",
+        "enter", "loadlocal", "storelocal", "loadouter",
+        "loadk", "mov", "add", "sub", "mul", "div", "loadouter", "call", "ret", "print",
+        "tailcall", "tailcall", "native", "native", "memo", "vec", "vdot", "vsum", "vec", "vdot", "vsum", "neg", "neg"
+    };
+    static_assert(sizeof(mnemonics)/sizeof(mnemonics[0]) == static_cast<size_t>(OpCode::LoadLocal2),
+                  "mnemonics must cover every opcode of .mlb files");
+    return mnemonics[static_cast<size_t>(opCode)];
+}
 
 SymbolName::SymbolName(const std::string &name, const std::string &fullName) : name(name), fullName(fullName) {}
 
-void CodeBuilder::beginFunc(const std::string &funcName, const std::vector<std::string> &argNames) {
+VarSymbol::VarSymbol(const SymbolName &symbol, size_t scope, size_t slot) : symbol(symbol), scope(scope), slot(slot) {}
+
+FuncSymbol::FuncSymbol(const SymbolName &symbol, size_t argsCount, bool isBuiltin) : symbol(symbol) {
+    this->argsCount = argsCount;
+    this->isBuiltin = isBuiltin;
+    this->isIntrinsic = false;
+    this->intrinsic = OpCode::Native;
+    this->regIntrinsic = OpCode::RegNative;
+}
+
+FuncScope::FuncScope(const SymbolName &symbol, size_t varStackSize, size_t scope, size_t enterPos) : symbol(symbol) {
+    this->varStackSize = varStackSize;
+    this->scope = scope;
+    this->slotsCount = 0;
+    this->frameSize = 0;
+    this->enterPos = enterPos;
+    this->valuesCount = 0;
+    this->effects = SIZE_MAX;
+}
+
+FuncEffects::FuncEffects(const std::string &fullName, size_t argsCount, bool isMemoAllowed) : fullName(fullName) {
+    this->argsCount = argsCount;
+    this->isMemoAllowed = isMemoAllowed;
+    this->isImpure = false;
+}
+
+CodeOperand::CodeOperand(Kind kind, size_t index) {
+    this->kind = kind;
+    this->index = index;
+    this->number = 0.0;
+}
+
+CodeOperand::CodeOperand(Kind kind, const std::string &name) : name(name) {
+    this->kind = kind;
+    this->index = 0;
+    this->number = 0.0;
+}
+
+CodeOperand::CodeOperand(double number) {
+    this->kind = Kind::Number;
+    this->index = 0;
+    this->number = number;
+}
+
+CodeLine::CodeLine(OpCode opCode, const std::vector<CodeOperand> &operands, size_t depth, const std::string &comment)
+    : operands(operands), comment(comment) {
+    this->kind = Kind::Instruction;
+    this->opCode = opCode;
+    this->depth = depth;
+}
+
+CodeLine::CodeLine(Kind kind, const std::string &label, size_t depth) : label(label) {
+    this->kind = kind;
+    this->opCode = OpCode::Jmp;
+    this->depth = depth;
+}
+
+void CodeBuilder::beginRoot() {
+    mRootScope.enterPos = mCode.size();
+}
+
+void CodeBuilder::endRoot() {
+    mInsertEnter(mRootScope, 0);
+    mGenMemo();
+}
+
+void CodeBuilder::beginFunc(const std::string &funcName, const std::vector<std::string> &argNames,
+                            const std::vector<std::string> &pragmas) {
     std::string fullName = mGetAbsoluteSymbolName(funcName);
-    mAddLine("");
-    mAddLine("jmp @%s_end@", fullName.data());
-    mAddLine("%s:", fullName.data());
-    mFuncStack.push_back(std::make_pair(SymbolName(funcName, fullName), mVarStack.size()));
-    for (auto it = argNames.cbegin(); it != argNames.cend(); it++) {
-        genSet(*it);
-    }
-    mFuncTable.push_back(SymbolName(funcName, fullName));
+    mAddBlank();
+    mAddInstruction(OpCode::Jmp, { CodeOperand(CodeOperand::Kind::Label, "@" + fullName + "_end@") });
+    mAddLabel(fullName);
+    mFuncStack.push_back(FuncScope(SymbolName(funcName, fullName), mVarStack.size(), mScopesCount++, mCode.size()));
+    bool isMemoAllowed = std::find(pragmas.begin(), pragmas.end(), "nomemo") == pragmas.end();
+    mFuncStack.back().effects = mFuncEffects.size();
+    mFuncEffects.push_back(FuncEffects(fullName, argNames.size(), isMemoAllowed));
+    mGenArguments(argNames);
+    // Whether the function is pure is known only once the whole program is generated. Until mGenMemo sets the
+    // arguments count or removes the line, its operand is the index of the function effects.
+    mAddInstruction(OpCode::Memo, { CodeOperand(CodeOperand::Kind::Index, mFuncStack.back().effects) });
+    mFuncTable.push_back(FuncSymbol(SymbolName(funcName, fullName), argNames.size()));
 }
 
 void CodeBuilder::endFunc() {
-    while (mVarStack.size() != mFuncStack.back().second) {
-        mAddLine("unset %s", mVarStack.back().fullName.data());
-        mVarStack.pop_back();
-    }
-    mAddLine("ret");
+    mGenFuncEnd();
+    // Locals live in the frame, so leaving it with ret replaces the old per-variable unsets
+    mVarStack.erase(mVarStack.begin() + mFuncStack.back().varStackSize, mVarStack.end());
 
-    std::string funcName = mFuncStack.back().first.fullName;
+    mInsertEnter(mFuncStack.back(), mFuncStack.size());
+    std::string funcName = mFuncStack.back().symbol.fullName;
     mFuncStack.pop_back();
 
-    mAddLine("@%s_end@:", funcName.data());
-    mAddLine("");
+    mAddLabel("@" + funcName + "_end@");
+    mAddBlank();
 }
 
+void CodeBuilder::endStatement() {}
+
 void CodeBuilder::genSet(const std::string &varName) {
-    std::string fullName = mGetAbsoluteSymbolName(varName);
-    mAddLine("set %s", fullName.data());
-    mVarStack.push_back(SymbolName(varName, fullName));
+    const VarSymbol &var = mAddVar(varName);
+    mAddInstruction(OpCode::StoreLocal, { CodeOperand(CodeOperand::Kind::Index, var.slot) }, var.symbol.fullName);
+    mCountValues(1, 0);
 }
 
 void CodeBuilder::genBinOp(char op) {
+    mCountValues(2, 1);
     if (op == '+') {
-        mAddLine("add");
+        mAddInstruction(OpCode::Add);
     }
     else if (op == '-') {
-        mAddLine("sub");
+        mAddInstruction(OpCode::Sub);
     }
     else if (op == '*') {
-        mAddLine("mul");
+        mAddInstruction(OpCode::Mul);
     }
     else if (op == '/') {
-        mAddLine("div");
+        mAddInstruction(OpCode::Div);
     }
 }
 
-void CodeBuilder::genCall(const std::string &funcName) {
-    mAddLine("call %s", mFindFuncAbsolute(funcName).data());
+void CodeBuilder::genNeg() {
+    mAddInstruction(OpCode::Neg);
+}
+
+void CodeBuilder::genCall(const std::string &funcName, size_t argsCount) {
+    const FuncSymbol &func = mFindCallee(funcName, argsCount);
+    mAddCallEffect(func);
+    mCountValues(func.argsCount, func.symbol.fullName == "print" ? 0 : 1);
+    if (func.isBuiltin) {
+        if (func.isIntrinsic) {
+            mAddInstruction(func.intrinsic);
+        }
+        else {
+            mAddInstruction(OpCode::Native, { CodeOperand(CodeOperand::Kind::Symbol, func.symbol.fullName) });
+        }
+        mLastCallEnd = SIZE_MAX;
+        return;
+    }
+    mLastCallPos = mCode.size();
+    if (func.symbol.fullName == "print") {
+        mAddInstruction(OpCode::Int, { CodeOperand(CodeOperand::Kind::Byte, 0) });
+    }
+    else {
+        mAddInstruction(OpCode::Call, { CodeOperand(CodeOperand::Kind::Label, func.symbol.fullName) });
+    }
+    mLastCallEnd = mIsTailCallAllowed(func) ? mCode.size() : SIZE_MAX;
+    mLastCallFunc = func.symbol.fullName;
 }
 
 void CodeBuilder::genPush(double value) {
-    mAddLine("push %f", value);
+    mAddInstruction(OpCode::Push, { CodeOperand(value) });
+    mCountValues(0, 1);
+}
+
+void CodeBuilder::genVector(size_t count) {
+    mAddInstruction(OpCode::Vec, { CodeOperand(CodeOperand::Kind::Index, count) });
+    mCountValues(count, 1);
 }
 
 void CodeBuilder::genGet(const std::string &varName) {
-    mAddLine("get %s", mFindVarAbsolute(varName).data());
+    const VarSymbol &var = mFindVarAbsolute(varName);
+    mCountValues(0, 1);
+    if (var.scope == mGetCurrentScope().scope) {
+        mAddInstruction(OpCode::LoadLocal, { CodeOperand(CodeOperand::Kind::Index, var.slot) }, var.symbol.fullName);
+    }
+    else {
+        mAddOuterReadEffect();
+        mAddInstruction(OpCode::LoadOuter, { CodeOperand(CodeOperand::Kind::Index, var.scope),
+                                             CodeOperand(CodeOperand::Kind::Index, var.slot) }, var.symbol.fullName);
+    }
 }
 
 void CodeBuilder::genReturn() {}
 
-const std::string &CodeBuilder::getFinalCode() const {
-    return mSource;
+void CodeBuilder::declareVar(const std::string &varName) {
+    mAddVar(varName);
+}
+
+void CodeBuilder::mGenArguments(const std::vector<std::string> &argNames) {
+    // The caller pushed the arguments, setting the parameters takes them
+    mGetCurrentScope().valuesCount = argNames.size();
+    for (auto it = argNames.cbegin(); it != argNames.cend(); it++) {
+        genSet(*it);
+    }
+}
+
+void CodeBuilder::mGenFuncEnd() {
+    if (mGetCurrentScope().valuesCount == 0) {
+        mError("function '" + mGetCurrentScope().symbol.fullName + "' returns no value");
+    }
+    // Return always emits nothing here, so a call that ends the body is a tail call whatever statement made it
+    if (mLastCallEnd == mCode.size()) {
+        mCode.erase(mCode.begin() + mLastCallPos, mCode.end());
+        mAddInstruction(OpCode::TailCall, { CodeOperand(CodeOperand::Kind::Label, mLastCallFunc) });
+    }
+    else {
+        mAddInstruction(OpCode::Ret);
+    }
+    mLastCallEnd = SIZE_MAX;
+}
+
+void CodeBuilder::mCountValues(size_t popCount, size_t pushCount) {
+    FuncScope &scope = mGetCurrentScope();
+    scope.valuesCount = scope.valuesCount > popCount ? scope.valuesCount - popCount + pushCount : pushCount;
+}
+
+std::vector<uint8_t> CodeBuilder::getBytecode() {
+    BytecodeWriter writer;
+    writer.setRegister(mIsRegister);
+    // Errors point at the line of the listing, there is no source text to show
+    AsmToken token;
+    token.pos.line = mIsRegister ? 2 : 1;
+    for (const auto &line : mCode) {
+        if (line.kind == CodeLine::Kind::Label) {
+            writer.addLabel(line.label, token);
+        }
+        else if (line.kind == CodeLine::Kind::Instruction) {
+            token.value = getMnemonic(line.opCode);
+            writer.addOpCode(line.opCode, token);
+            for (const auto &operand : line.operands) {
+                if (operand.kind == CodeOperand::Kind::Index || operand.kind == CodeOperand::Kind::Register) {
+                    if (operand.index > UINT16_MAX) {
+                        mError("index " + std::to_string(operand.index) + " of '" + token.value + "' is out of range");
+                    }
+                    writer.addArg(static_cast<uint16_t>(operand.index));
+                }
+                else if (operand.kind == CodeOperand::Kind::Byte) {
+                    writer.addArg(static_cast<uint8_t>(operand.index));
+                }
+                else if (operand.kind == CodeOperand::Kind::Label) {
+                    writer.addLabelArg(operand.name);
+                }
+                else if (operand.kind == CodeOperand::Kind::Symbol) {
+                    writer.addArg(writer.getSymbol(operand.name));
+                }
+                else {
+                    writer.addArg(writer.getConstant(operand.number));
+                }
+            }
+        }
+        token.pos.line++;
+    }
+    return writer.finish();
+}
+
+std::string CodeBuilder::getListing() const {
+    std::string listing = mIsRegister ? "engine register\n" : "";
+    for (const auto &line : mCode) {
+        if (line.kind != CodeLine::Kind::Blank) {
+            listing.append(4*line.depth, ' ');
+        }
+        if (line.kind == CodeLine::Kind::Label) {
+            listing += line.label + ":";
+        }
+        else if (line.kind == CodeLine::Kind::Instruction && line.opCode == OpCode::Int) {
+            listing += "call print";
+        }
+        else if (line.kind == CodeLine::Kind::Instruction) {
+            listing += getMnemonic(line.opCode);
+            // Register instructions separate their operands with commas and name the destination first
+            bool isRegister = std::any_of(line.operands.begin(), line.operands.end(), [](const CodeOperand &operand) {
+                return operand.kind == CodeOperand::Kind::Register;
+            });
+            std::vector<CodeOperand> operands = line.operands;
+            if (line.opCode == OpCode::RegCall || line.opCode == OpCode::RegNative) {
+                std::swap(operands[0], operands[1]);
+            }
+            for (size_t i = 0; i < operands.size(); i++) {
+                listing += i == 0 ? " " : isRegister ? ", " : " ";
+                if (operands[i].kind == CodeOperand::Kind::Register) {
+                    listing += "r" + std::to_string(operands[i].index);
+                }
+                else if (operands[i].kind == CodeOperand::Kind::Label || operands[i].kind == CodeOperand::Kind::Symbol) {
+                    listing += operands[i].name;
+                }
+                else if (operands[i].kind == CodeOperand::Kind::Number) {
+                    listing += mFormatNumber(operands[i].number);
+                }
+                else {
+                    listing += std::to_string(operands[i].index);
+                }
+            }
+            if (!line.comment.empty()) {
+                listing += " ; " + line.comment;
+            }
+        }
+        listing += "\n";
+    }
+    return listing;
+}
+
+const std::vector<FuncSymbol> &CodeBuilder::getFunctions() const {
+    return mFuncTable;
 }
 
 void CodeBuilder::mError(const std::string &text) {
     printf("CodeBuilderError: %s\n", text.data());
-    throw std::exception("parser error");
+    throw std::runtime_error("parser error");
 }
 
-void CodeBuilder::mAddLine(const char *fmt, ...) {
-    va_list args;
-    va_start(args, fmt);
-    char buf[1024];
-    vsprintf_s(buf, fmt, args);
-    va_end(args);
-    for (size_t i = 0; i < mFuncStack.size(); i++) {
-        mSource += "    ";
+void CodeBuilder::mAddInstruction(OpCode opCode, const std::vector<CodeOperand> &operands, const std::string &comment) {
+    mCode.push_back(CodeLine(opCode, operands, mFuncStack.size(), comment));
+}
+
+void CodeBuilder::mAddLabel(const std::string &label) {
+    mCode.push_back(CodeLine(CodeLine::Kind::Label, label, mFuncStack.size()));
+}
+
+void CodeBuilder::mAddBlank() {
+    mCode.push_back(CodeLine(CodeLine::Kind::Blank, "", 0));
+}
+
+std::string CodeBuilder::mFormatNumber(double value) {
+    // %f keeps the listing readable, a folded constant it would round is written in full
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%f", value);
+    double parsed = strtod(buf, nullptr);
+    if (memcmp(&parsed, &value, sizeof(value)) != 0) {
+        snprintf(buf, sizeof(buf), "%.17g", value);
     }
-    mSource += buf;
-    mSource += "\n";
+    return buf;
+}
+
+void CodeBuilder::mInsertEnter(const FuncScope &func, size_t depth) {
+    // The frame size is known only once the whole body is generated, so the line goes back to the function entry
+    std::vector<CodeOperand> operands = { CodeOperand(CodeOperand::Kind::Index, func.scope),
+                                          CodeOperand(CodeOperand::Kind::Index, std::max(func.slotsCount, func.frameSize)) };
+    mCode.insert(mCode.begin() + func.enterPos, CodeLine(OpCode::Enter, operands, depth, ""));
+}
+
+FuncScope &CodeBuilder::mGetCurrentScope() {
+    return mFuncStack.empty() ? mRootScope : mFuncStack.back();
+}
+
+bool CodeBuilder::mIsTailCallAllowed(const FuncSymbol &func) {
+    // The callee takes over the frame of the current function, so it must not be nested in it and read that frame
+    if (mFuncStack.empty() || func.symbol.fullName == "print") {
+        return false;
+    }
+    std::string prefix = mFuncStack.back().symbol.fullName + ".";
+    return func.symbol.fullName.compare(0, prefix.size(), prefix) != 0;
+}
+
+const VarSymbol &CodeBuilder::mAddVar(const std::string &varName) {
+    // Assigning an existing variable of the same function reuses its slot
+    std::string fullName = mGetAbsoluteSymbolName(varName);
+    FuncScope &scope = mGetCurrentScope();
+    for (size_t i = scope.varStackSize; i < mVarStack.size(); i++) {
+        if (mVarStack[i].symbol.fullName == fullName) {
+            return mVarStack[i];
+        }
+    }
+    mVarStack.push_back(VarSymbol(SymbolName(varName, fullName), scope.scope, scope.slotsCount++));
+    return mVarStack.back();
 }
 
 std::string CodeBuilder::mGetAbsoluteSymbolName(const std::string &name) {
     std::string absoluteName;
-    for (const auto &funcName : mFuncStack) {
-        absoluteName += funcName.first.name + ".";
+    for (const auto &func : mFuncStack) {
+        absoluteName += func.symbol.name + ".";
     }
     return absoluteName + name;
 }
 
-std::string CodeBuilder::mFindVarAbsolute(const std::string &name) {
+const VarSymbol &CodeBuilder::mFindVarAbsolute(const std::string &name) {
     for (auto it = mVarStack.rbegin(); it != mVarStack.rend(); it++) {
-        if (it->name == name) {
-            return it->fullName;
+        if (it->symbol.name == name) {
+            return *it;
         }
     }
     mError("variable '" + name + "' not found");
+    return mVarStack.back();
 }
 
-std::string CodeBuilder::mFindFuncAbsolute(const std::string &name) {
+const FuncSymbol &CodeBuilder::mFindFuncAbsolute(const std::string &name) {
     if (name == "print") {
-        return "print";
+        return mPrintFunc;
     }
     for (auto it = mFuncTable.rbegin(); it != mFuncTable.rend(); it++) {
-        if (it->name == name) {
-            return it->fullName;
+        if (it->symbol.name == name) {
+            return *it;
+        }
+    }
+    // User functions shadow the builtins
+    size_t builtin = findBuiltin(name.data());
+    if (builtin != BuiltinsCount) {
+        mBuiltinFunc = FuncSymbol(SymbolName(name, name), builtins[builtin].argsCount, true);
+        return mBuiltinFunc;
+    }
+    for (const auto &intrinsic : intrinsics) {
+        if (name == intrinsic.name) {
+            mBuiltinFunc = FuncSymbol(SymbolName(name, name), intrinsic.argsCount, true);
+            mBuiltinFunc.isIntrinsic = true;
+            mBuiltinFunc.intrinsic = intrinsic.opCode;
+            mBuiltinFunc.regIntrinsic = intrinsic.regOpCode;
+            return mBuiltinFunc;
         }
     }
     mError("function '" + name + "' not found");
+    return mPrintFunc;
+}
+
+const FuncSymbol &CodeBuilder::mFindCallee(const std::string &name, size_t argsCount) {
+    const FuncSymbol &func = mFindFuncAbsolute(name);
+    if (func.argsCount != argsCount) {
+        mError("function '" + name + "' expects " + std::to_string(func.argsCount) + " arguments instead " +
+               std::to_string(argsCount));
+    }
+    return func;
+}
+
+void CodeBuilder::mAddCallEffect(const FuncSymbol &func) {
+    if (func.isBuiltin) {
+        return;
+    }
+    if (mFuncStack.empty()) {
+        if (func.symbol.fullName != "print") {
+            mRootCallees[func.symbol.fullName]++;
+        }
+        return;
+    }
+    FuncEffects &effects = mFuncEffects[mFuncStack.back().effects];
+    if (func.symbol.fullName == "print") {
+        effects.isImpure = true;
+    }
+    else {
+        effects.callees[func.symbol.fullName]++;
+    }
+}
+
+void CodeBuilder::mAddOuterReadEffect() {
+    // Globals and the frames of enclosing functions may change between two calls with the same arguments
+    if (!mFuncStack.empty()) {
+        mFuncEffects[mFuncStack.back().effects].isImpure = true;
+    }
+}
+
+void CodeBuilder::mGenMemo() {
+    // Impurity spreads from callees to callers until nothing changes, recursive functions stay pure unless
+    // something in their cycle prints
+    std::map<std::string, bool> isPure;
+    for (const auto &effects : mFuncEffects) {
+        isPure[effects.fullName] = !effects.isImpure;
+    }
+    bool isChanged = true;
+    while (isChanged) {
+        isChanged = false;
+        for (const auto &effects : mFuncEffects) {
+            auto isCalleePure = [&](const std::pair<const std::string, size_t> &callee) { return isPure[callee.first]; };
+            if (isPure[effects.fullName] && !std::all_of(effects.callees.begin(), effects.callees.end(), isCalleePure)) {
+                isPure[effects.fullName] = false;
+                isChanged = true;
+            }
+        }
+    }
+
+    // A remembered result is only found again if the function runs more than once in a run of the program: it is
+    // called twice, by a function that runs more than once or by itself. A function the program never calls is
+    // there for the host, which may call it any number of times. Counts stop at 2.
+    std::map<std::string, size_t> baseRuns = mRootCallees;
+    std::set<std::string> calledFuncs;
+    for (const auto &effects : mFuncEffects) {
+        for (const auto &callee : effects.callees) {
+            if (callee.first != effects.fullName) {
+                calledFuncs.insert(callee.first);
+            }
+        }
+    }
+    for (const auto &effects : mFuncEffects) {
+        if (calledFuncs.count(effects.fullName) == 0 && mRootCallees.count(effects.fullName) == 0) {
+            baseRuns[effects.fullName] = 2;
+        }
+    }
+    std::map<std::string, size_t> runs = baseRuns;
+    isChanged = true;
+    while (isChanged) {
+        isChanged = false;
+        std::map<std::string, size_t> nextRuns = baseRuns;
+        for (const auto &effects : mFuncEffects) {
+            for (const auto &callee : effects.callees) {
+                nextRuns[callee.first] += runs[effects.fullName]*callee.second;
+            }
+        }
+        for (auto &funcRuns : nextRuns) {
+            funcRuns.second = std::min<size_t>(funcRuns.second, 2);
+            isChanged = isChanged || funcRuns.second != runs[funcRuns.first];
+        }
+        runs = std::move(nextRuns);
+    }
+
+    std::vector<CodeLine> code;
+    code.reserve(mCode.size());
+    for (auto &line : mCode) {
+        if (line.kind == CodeLine::Kind::Instruction && line.opCode == OpCode::Memo) {
+            const FuncEffects &effects = mFuncEffects[line.operands[0].index];
+            // A function that calls nothing costs about as much to run again as to look up
+            if (!isPure[effects.fullName] || !effects.isMemoAllowed || effects.callees.empty() ||
+                effects.argsCount > MaxMemoArgsCount || runs[effects.fullName] < 2) {
+                continue;
+            }
+            line.operands[0].index = effects.argsCount;
+        }
+        code.push_back(std::move(line));
+    }
+    mCode = std::move(code);
 }
@@ -1,7 +1,9 @@
 #pragma once
+#include "../Bytecode.hpp"
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 
 struct SymbolName {
     SymbolName(const std::string &name, const std::string &fullName);
@@ -9,30 +11,167 @@ struct SymbolName {
     std::string name, fullName;
 };
 
+struct VarSymbol {
+    VarSymbol(const SymbolName &symbol, size_t scope, size_t slot);
+
+    SymbolName symbol;
+    size_t scope;
+    size_t slot;
+};
+
+struct FuncSymbol {
+    FuncSymbol(const SymbolName &symbol, size_t argsCount, bool isBuiltin = false);
+
+    SymbolName symbol;
+    size_t argsCount;
+    bool isBuiltin;
+    // Builtins the VM implements as opcodes of each engine instead of calling a native
+    bool isIntrinsic;
+    OpCode intrinsic;
+    OpCode regIntrinsic;
+};
+
+struct FuncScope {
+    FuncScope(const SymbolName &symbol, size_t varStackSize, size_t scope, size_t enterPos);
+
+    SymbolName symbol;
+    size_t varStackSize;
+    size_t scope;
+    size_t slotsCount;
+    size_t frameSize;
+    size_t enterPos;
+    // Values the body has left on the stack, a body leaving none has nothing to return
+    size_t valuesCount;
+    // Index into the effects of the functions, SIZE_MAX for the top level
+    size_t effects;
+};
+
+// What the purity analysis needs to know about one function, collected while its body is generated
+struct FuncEffects {
+    FuncEffects(const std::string &fullName, size_t argsCount, bool isMemoAllowed);
+
+    std::string fullName;
+    size_t argsCount;
+    // False under #pragma nomemo
+    bool isMemoAllowed;
+    // Prints or reads a variable of another scope, so its result is not a function of the arguments alone
+    bool isImpure;
+    // Full names of the user functions it calls and the number of calls of each, builtins have no side effects
+    std::map<std::string, size_t> callees;
+};
+
+// Operand of a generated instruction, labels, constants and symbols get their indices when the bytecode is written
+struct CodeOperand {
+    enum class Kind {
+        Index,
+        Register,
+        Byte,
+        Label,
+        Symbol,
+        Number
+    };
+
+    CodeOperand(Kind kind, size_t index);
+    CodeOperand(Kind kind, const std::string &name);
+    CodeOperand(double number);
+
+    Kind kind;
+    size_t index;
+    double number;
+    std::string name;
+};
+
+// Line of the generated code. The bytecode and the .mla listing are both made from these once the program is complete,
+// so the late changes (frame sizes, memo, tail calls) edit instructions instead of text.
+struct CodeLine {
+    enum class Kind {
+        Instruction,
+        Label,
+        Blank
+    };
+
+    CodeLine(OpCode opCode, const std::vector<CodeOperand> &operands, size_t depth, const std::string &comment);
+    CodeLine(Kind kind, const std::string &label, size_t depth);
+
+    Kind kind;
+    OpCode opCode;
+    // In the order of the bytecode
+    std::vector<CodeOperand> operands;
+    std::string label;
+    // Listing only
+    std::string comment;
+    size_t depth;
+};
+
+// Generates stack machine code, the symbol and scope handling is shared with RegisterCodeBuilder
 class CodeBuilder {
 public:
     CodeBuilder() = default;
+    virtual ~CodeBuilder() = default;
 
-    void beginFunc(const std::string &funcName, const std::vector<std::string> &argNames);
-    void endFunc();
-    void genSet(const std::string &varName);
-    void genBinOp(char op);
-    void genCall(const std::string &funcName);
-    void genPush(double value);
-    void genGet(const std::string &varName);
-    void genReturn();
+    virtual void beginRoot();
+    virtual void endRoot();
+    virtual void beginFunc(const std::string &funcName, const std::vector<std::string> &argNames,
+                           const std::vector<std::string> &pragmas = {});
+    virtual void endFunc();
+    virtual void endStatement();
+    virtual void genSet(const std::string &varName);
+    virtual void genBinOp(char op);
+    // 0 - the last value
+    virtual void genNeg();
+    virtual void genCall(const std::string &funcName, size_t argsCount);
+    virtual void genPush(double value);
+    // Packs the last count values, in the order they were generated, into a vector
+    virtual void genVector(size_t count);
+    virtual void genGet(const std::string &varName);
+    virtual void genReturn();
+    // Gives a variable its slot before anything is assigned to it, so that it can be assigned while other values are on
+    // the stack
+    void declareVar(const std::string &varName);
 
-    const std::string &getFinalCode() const;
+    // Encodes the code without going through the assembly text, throws std::exception if the analysis rejects it
+    std::vector<uint8_t> getBytecode();
+    // Assembly text of the same code, the Translator turns it into the same bytecode
+    std::string getListing() const;
+    // Every function defined by the source, nested ones under their full names
+    const std::vector<FuncSymbol> &getFunctions() const;
 
-private:
+protected:
+    virtual void mGenArguments(const std::vector<std::string> &argNames);
+    virtual void mGenFuncEnd();
+    void mCountValues(size_t popCount, size_t pushCount);
     void mError(const std::string &text);
-    void mAddLine(const char *fmt, ...);
+    void mAddInstruction(OpCode opCode, const std::vector<CodeOperand> &operands = {}, const std::string &comment = "");
+    void mAddLabel(const std::string &label);
+    void mAddBlank();
+    static std::string mFormatNumber(double value);
+    void mInsertEnter(const FuncScope &func, size_t depth);
+    FuncScope &mGetCurrentScope();
+    bool mIsTailCallAllowed(const FuncSymbol &func);
+    const VarSymbol &mAddVar(const std::string &varName);
     std::string mGetAbsoluteSymbolName(const std::string &name);
-    std::string mFindVarAbsolute(const std::string &name);
-    std::string mFindFuncAbsolute(const std::string &name);
+    const VarSymbol &mFindVarAbsolute(const std::string &name);
+    const FuncSymbol &mFindFuncAbsolute(const std::string &name);
+    const FuncSymbol &mFindCallee(const std::string &name, size_t argsCount);
+    void mAddCallEffect(const FuncSymbol &func);
+    void mAddOuterReadEffect();
+    void mGenMemo();
 
-    std::string mSource;
-    std::vector<std::pair<SymbolName, size_t>> mFuncStack;
-    std::vector<SymbolName> mVarStack;
-    std::vector<SymbolName> mFuncTable;
+    std::vector<CodeLine> mCode;
+    bool mIsRegister = false;
+    std::vector<FuncScope> mFuncStack;
+    std::vector<VarSymbol> mVarStack;
+    std::vector<FuncSymbol> mFuncTable;
+    FuncSymbol mPrintFunc = FuncSymbol(SymbolName("print", "print"), 1);
+    // Filled from the builtin table by mFindFuncAbsolute
+    FuncSymbol mBuiltinFunc = FuncSymbol(SymbolName("", ""), 0, true);
+    FuncScope mRootScope = FuncScope(SymbolName("", ""), 0, 0, 0);
+    std::vector<FuncEffects> mFuncEffects;
+    // Calls of each user function made by the top level
+    std::map<std::string, size_t> mRootCallees;
+    size_t mScopesCount = 1;
+    // Last call line, mGenFuncEnd turns it into a tail call when nothing follows it
+    size_t mLastCallPos = SIZE_MAX;
+    size_t mLastCallEnd = SIZE_MAX;
+    std::string mLastCallFunc;
 };
\ No newline at end of file
@@ -0,0 +1,692 @@
+#include "IRBuilder.hpp"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+// Largest body, in values other than the arguments, that is inlined at a call
+const size_t InlineBudget = 16;
+
+IRInstruction::IRInstruction(IROp op, const std::string &name) : name(name) {
+    this->op = op;
+    this->binOp = 0;
+    this->number = 0;
+    this->func = SIZE_MAX;
+    this->funcsCount = 0;
+}
+
+IRFunction::IRFunction(const std::string &name, const std::vector<std::string> &argNames,
+                       const std::vector<std::string> &pragmas, size_t parent) : name(name), argNames(argNames), pragmas(pragmas) {
+    this->parent = parent;
+    this->isImpure = false;
+    this->isPure = false;
+}
+
+void IRBuilder::beginRoot() {
+    mFunctions.push_back(IRFunction("", {}, {}, SIZE_MAX));
+    mOpenFunctions.push_back(0);
+}
+
+void IRBuilder::endRoot() {
+    mOpenFunctions.pop_back();
+}
+
+void IRBuilder::beginFunc(const std::string &funcName, const std::vector<std::string> &argNames,
+                          const std::vector<std::string> &pragmas) {
+    size_t index = mFunctions.size();
+    IRInstruction ins(IROp::Func, funcName);
+    ins.func = index;
+    mAddValue(ins, 0);
+    mFunctions.push_back(IRFunction(funcName, argNames, pragmas, mOpenFunctions.back()));
+    mOpenFunctions.push_back(index);
+    mFunctionsByName[funcName].push_back(index);
+    for (const auto &argName : argNames) {
+        size_t value = mAddValue(IRInstruction(IROp::Param, argName), 0);
+        mCurrent().vars[argName] = value;
+    }
+}
+
+void IRBuilder::endFunc() {
+    mOpenFunctions.pop_back();
+}
+
+void IRBuilder::endStatement() {
+    mAddValue(IRInstruction(IROp::Statement), mValues.size());
+}
+
+void IRBuilder::genSet(const std::string &varName) {
+    IRInstruction ins(IROp::Store, varName);
+    size_t value = mValues.back();
+    mAddValue(ins, 1);
+    mCurrent().vars[varName] = value;
+}
+
+void IRBuilder::genBinOp(char op) {
+    IRInstruction ins(IROp::BinOp);
+    ins.binOp = op;
+    mValues.push_back(mAddValue(ins, 2));
+}
+
+void IRBuilder::genNeg() {
+    mValues.push_back(mAddValue(IRInstruction(IROp::Neg), 1));
+}
+
+void IRBuilder::genCall(const std::string &funcName, size_t argsCount) {
+    IRInstruction ins(IROp::Call, funcName);
+    IRFunction &func = mCurrent();
+    ins.funcsCount = mFunctions.size();
+    ins.func = mResolveFunc(funcName, ins.funcsCount);
+    if (ins.func != SIZE_MAX) {
+        func.callees.insert(ins.func);
+    }
+    else if (funcName == "print") {
+        func.isImpure = true;
+    }
+    mValues.push_back(mAddValue(ins, argsCount));
+}
+
+void IRBuilder::genPush(double value) {
+    IRInstruction ins(IROp::Const);
+    ins.number = value;
+    mValues.push_back(mAddValue(ins, 0));
+}
+
+void IRBuilder::genVector(size_t count) {
+    mValues.push_back(mAddValue(IRInstruction(IROp::Vector), count));
+}
+
+void IRBuilder::genGet(const std::string &varName) {
+    IRFunction &func = mCurrent();
+    auto it = func.vars.find(varName);
+    if (it != func.vars.end()) {
+        mValues.push_back(it->second);
+        return;
+    }
+    // The variable of an enclosing scope is read from its frame, so every assignment to it has to stay
+    func.isImpure = true;
+    IRInstruction ins(IROp::Load, varName);
+    for (size_t i = func.parent; i != SIZE_MAX; i = mFunctions[i].parent) {
+        if (mFunctions[i].vars.count(varName) != 0) {
+            mFunctions[i].observedVars.insert(varName);
+            ins.func = i;
+            break;
+        }
+    }
+    mValues.push_back(mAddValue(ins, 0));
+}
+
+void IRBuilder::genReturn() {
+    mAddValue(IRInstruction(IROp::Return), 1);
+}
+
+void IRBuilder::optimize() {
+    mAnalyzePurity();
+    // Callees come first, so a function is inlined with the calls in its own body already inlined
+    std::vector<size_t> order;
+    std::vector<bool> isRecursive = mFindRecursive(order);
+    for (size_t index : order) {
+        mInlineCalls(index, isRecursive);
+    }
+    for (auto &func : mFunctions) {
+        mNumberValues(func);
+        mRemoveDeadValues(func);
+    }
+}
+
+void IRBuilder::codegen(CodeBuilder &builder) {
+    GenCalls calls;
+    mGenFunction(0, calls);
+    builder.beginRoot();
+    for (const auto &call : calls) {
+        call(builder);
+    }
+    builder.endRoot();
+}
+
+void IRBuilder::print() {
+    static const char *names[] = { "param", "load", "const", "binop", "neg", "call", "vector", "seq", "store",
+                                   "return", "statement", "func" };
+    for (const auto &func : mFunctions) {
+        std::string args;
+        for (const auto &argName : func.argNames) {
+            args += (args.empty() ? "" : ", ") + argName;
+        }
+        printf("%s(%s)%s\n", func.name.empty() ? "root" : func.name.data(), args.data(), func.isPure ? " pure" : "");
+        for (size_t i = 0; i < func.code.size(); i++) {
+            const IRInstruction &ins = func.code[i];
+            std::string line = ins.op <= IROp::Seq ? "    %" + std::to_string(i) + " = " : "    ";
+            line += names[static_cast<size_t>(ins.op)];
+            if (ins.op == IROp::BinOp) {
+                line += std::string(" ") + ins.binOp;
+            }
+            else if (ins.op == IROp::Const) {
+                line += " " + mFormatNumber(ins.number);
+            }
+            else if (!ins.name.empty()) {
+                line += " " + ins.name;
+            }
+            for (size_t operand : ins.operands) {
+                line += " %" + std::to_string(operand);
+            }
+            printf("%s\n", line.data());
+        }
+    }
+}
+
+IRFunction &IRBuilder::mCurrent() {
+    return mFunctions[mOpenFunctions.back()];
+}
+
+size_t IRBuilder::mAddValue(const IRInstruction &ins, size_t operandsCount) {
+    // The operands are the last values of the stack code, in the order they were pushed
+    std::vector<IRInstruction> &code = mCurrent().code;
+    code.push_back(ins);
+    code.back().operands.assign(mValues.end() - operandsCount, mValues.end());
+    mValues.resize(mValues.size() - operandsCount);
+    return code.size() - 1;
+}
+
+void IRBuilder::mAnalyzePurity() {
+    // Same fixed point as mGenMemo, a function stays pure unless it or something it calls is impure
+    for (auto &func : mFunctions) {
+        func.isPure = !func.isImpure;
+    }
+    bool isChanged = true;
+    while (isChanged) {
+        isChanged = false;
+        for (auto &func : mFunctions) {
+            if (!func.isPure) {
+                continue;
+            }
+            for (size_t callee : func.callees) {
+                if (!mFunctions[callee].isPure) {
+                    func.isPure = false;
+                    isChanged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+size_t IRBuilder::mResolveFunc(const std::string &funcName, size_t funcsCount) {
+    // print is never shadowed, user functions shadow the builtins
+    auto it = mFunctionsByName.find(funcName);
+    if (funcName == "print" || it == mFunctionsByName.end()) {
+        return SIZE_MAX;
+    }
+    auto defined = std::lower_bound(it->second.begin(), it->second.end(), funcsCount);
+    return defined == it->second.begin() ? SIZE_MAX : *(defined - 1);
+}
+
+std::vector<bool> IRBuilder::mFindRecursive(std::vector<size_t> &order) {
+    // Tarjan's algorithm without recursion, the strongly connected components of the call graph come out callees
+    // first. A function is recursive if its component has more than one function or it calls itself.
+    size_t count = mFunctions.size();
+    std::vector<std::vector<size_t>> callees(count);
+    for (size_t i = 0; i < count; i++) {
+        callees[i].assign(mFunctions[i].callees.begin(), mFunctions[i].callees.end());
+    }
+    std::vector<size_t> indices(count, SIZE_MAX);
+    std::vector<size_t> lowLinks(count, 0);
+    std::vector<bool> isOnStack(count, false);
+    std::vector<bool> isRecursive(count, false);
+    std::vector<size_t> stack;
+    std::vector<std::pair<size_t, size_t>> work;
+    size_t nextIndex = 0;
+    auto visit = [&](size_t func) {
+        indices[func] = lowLinks[func] = nextIndex++;
+        stack.push_back(func);
+        isOnStack[func] = true;
+        work.push_back({ func, 0 });
+    };
+    for (size_t root = 0; root < count; root++) {
+        if (indices[root] != SIZE_MAX) {
+            continue;
+        }
+        visit(root);
+        while (!work.empty()) {
+            size_t func = work.back().first;
+            if (work.back().second < callees[func].size()) {
+                size_t callee = callees[func][work.back().second++];
+                if (indices[callee] == SIZE_MAX) {
+                    visit(callee);
+                }
+                else if (isOnStack[callee]) {
+                    lowLinks[func] = std::min(lowLinks[func], indices[callee]);
+                }
+                continue;
+            }
+            work.pop_back();
+            if (!work.empty()) {
+                size_t caller = work.back().first;
+                lowLinks[caller] = std::min(lowLinks[caller], lowLinks[func]);
+            }
+            if (lowLinks[func] != indices[func]) {
+                continue;
+            }
+            size_t first = order.size();
+            size_t member;
+            do {
+                member = stack.back();
+                stack.pop_back();
+                isOnStack[member] = false;
+                order.push_back(member);
+            } while (member != func);
+            if (order.size() - first > 1 || mFunctions[func].callees.count(func) != 0) {
+                for (size_t i = first; i < order.size(); i++) {
+                    isRecursive[order[i]] = true;
+                }
+            }
+        }
+    }
+    return isRecursive;
+}
+
+bool IRBuilder::mIsVisible(size_t caller, const IRInstruction &load, const std::map<std::string, size_t> &vars) {
+    // The inlined code has to read the variable the callee reads, from the frame of the same function
+    if (load.func == caller) {
+        return vars.count(load.name) != 0;
+    }
+    for (size_t i = caller; i != load.func; i = mFunctions[i].parent) {
+        if (i == SIZE_MAX || mFunctions[i].vars.count(load.name) != 0) {
+            return false;
+        }
+    }
+    return load.func != SIZE_MAX;
+}
+
+bool IRBuilder::mIsInlinable(size_t caller, const IRInstruction &call, const std::map<std::string, size_t> &vars,
+                             const std::vector<bool> &isRecursive) {
+    if (call.func == SIZE_MAX || isRecursive[call.func]) {
+        return false;
+    }
+    const IRFunction &callee = mFunctions[call.func];
+    const std::vector<IRInstruction> &code = callee.code;
+    if (callee.argNames.size() != call.operands.size() ||
+        std::find(callee.pragmas.begin(), callee.pragmas.end(), "noinline") != callee.pragmas.end()) {
+        return false;
+    }
+    // The engines agree on the result only if the body ends with its one return
+    if (code.size() < 2 || code[code.size() - 2].op != IROp::Return || !code.back().operands.empty()) {
+        return false;
+    }
+    size_t size = 0;
+    for (size_t i = 0; i + 2 < code.size(); i++) {
+        const IRInstruction &ins = code[i];
+        if (ins.op == IROp::Return || ins.op == IROp::Func) {
+            return false;
+        }
+        if (ins.op == IROp::Load && !mIsVisible(caller, ins, vars)) {
+            return false;
+        }
+        // Names resolve where the call is, an inner call must still reach the same function there
+        if (ins.op == IROp::Call && mResolveFunc(ins.name, call.funcsCount) != ins.func) {
+            return false;
+        }
+        if (ins.op <= IROp::Seq && ins.op != IROp::Param) {
+            size++;
+        }
+    }
+    return size <= InlineBudget;
+}
+
+size_t IRBuilder::mInlineCall(size_t caller, const IRInstruction &call, const std::map<std::string, size_t> &vars,
+                              std::vector<IRInstruction> &code) {
+    const IRFunction &callee = mFunctions[call.func];
+    std::vector<size_t> values(callee.code.size());
+    // The arguments are evaluated before the body, then its statements in order
+    std::vector<size_t> prerequisites;
+    for (size_t operand : call.operands) {
+        IROp op = code[operand].op;
+        if (op != IROp::Param && op != IROp::Load && op != IROp::Const) {
+            prerequisites.push_back(operand);
+        }
+    }
+    size_t param = 0;
+    size_t result = SIZE_MAX;
+    for (size_t i = 0; i + 1 < callee.code.size(); i++) {
+        IRInstruction ins = callee.code[i];
+        for (auto &operand : ins.operands) {
+            operand = values[operand];
+        }
+        if (ins.op == IROp::Param) {
+            // The first parameter is stored first, from the top of the stack, so it gets the last argument
+            values[i] = call.operands[call.operands.size() - 1 - param++];
+            continue;
+        }
+        else if (ins.op == IROp::Load && ins.func == caller) {
+            // The callee reads the variable of the caller, it holds the last value assigned before the call
+            values[i] = vars.at(ins.name);
+            continue;
+        }
+        else if (ins.op == IROp::Store || ins.op == IROp::Statement) {
+            prerequisites.insert(prerequisites.end(), ins.operands.begin(), ins.operands.end());
+            continue;
+        }
+        else if (ins.op == IROp::Return) {
+            result = ins.operands[0];
+            continue;
+        }
+        else if (ins.op == IROp::Call) {
+            ins.funcsCount = call.funcsCount;
+        }
+        values[i] = code.size();
+        code.push_back(ins);
+    }
+    if (prerequisites.empty()) {
+        return result;
+    }
+    IRInstruction seq(IROp::Seq);
+    seq.operands = prerequisites;
+    seq.operands.push_back(result);
+    code.push_back(seq);
+    return code.size() - 1;
+}
+
+void IRBuilder::mInlineCalls(size_t index, const std::vector<bool> &isRecursive) {
+    IRFunction &func = mFunctions[index];
+    std::vector<size_t> values(func.code.size());
+    std::vector<IRInstruction> code;
+    // Values of the variables at each point, for callees that read the frame of this function
+    std::map<std::string, size_t> vars;
+    for (size_t i = 0; i < func.code.size(); i++) {
+        IRInstruction ins = func.code[i];
+        for (auto &operand : ins.operands) {
+            operand = values[operand];
+        }
+        if (ins.op == IROp::Call && mIsInlinable(index, ins, vars, isRecursive)) {
+            values[i] = mInlineCall(index, ins, vars, code);
+            continue;
+        }
+        values[i] = code.size();
+        if (ins.op == IROp::Param) {
+            vars[ins.name] = values[i];
+        }
+        else if (ins.op == IROp::Store) {
+            vars[ins.name] = ins.operands[0];
+        }
+        code.push_back(ins);
+    }
+    func.code = std::move(code);
+}
+
+bool IRBuilder::mGetValueKey(const IRInstruction &ins, std::string &key) {
+    // Values with the same key are equal bit for bit, so commuted operands are different values
+    switch (ins.op) {
+    case IROp::Const: {
+        uint64_t bits;
+        memcpy(&bits, &ins.number, sizeof(bits));
+        key = "k" + std::to_string(bits);
+        return true;
+    }
+    case IROp::Load:
+        key = "l" + std::to_string(ins.func) + " " + ins.name;
+        return true;
+    case IROp::BinOp:
+        key = std::string("b") + ins.binOp;
+        break;
+    case IROp::Neg:
+        key = "n";
+        break;
+    case IROp::Vector:
+        key = "v";
+        break;
+    case IROp::Call:
+        if (ins.func == SIZE_MAX) {
+            // Builtins are pure, print is not
+            if (ins.name == "print") {
+                return false;
+            }
+            key = "c" + ins.name;
+        }
+        else {
+            // The user asked for every call of a nomemo function to run
+            const IRFunction &callee = mFunctions[ins.func];
+            if (!callee.isPure || std::find(callee.pragmas.begin(), callee.pragmas.end(), "nomemo") != callee.pragmas.end()) {
+                return false;
+            }
+            key = "f" + std::to_string(ins.func);
+        }
+        break;
+    default:
+        return false;
+    }
+    for (size_t operand : ins.operands) {
+        key += " " + std::to_string(operand);
+    }
+    return true;
+}
+
+void IRBuilder::mNumberValues(IRFunction &func) {
+    std::vector<size_t> numbers(func.code.size());
+    std::map<std::string, size_t> values;
+    for (size_t i = 0; i < func.code.size(); i++) {
+        IRInstruction &ins = func.code[i];
+        for (auto &operand : ins.operands) {
+            operand = numbers[operand];
+        }
+        numbers[i] = i;
+        std::string key;
+        if (mGetValueKey(ins, key)) {
+            numbers[i] = values.emplace(key, i).first->second;
+        }
+    }
+}
+
+void IRBuilder::mRemoveDeadValues(IRFunction &func) {
+    // Every value is used when the body is built, only the ones merged into an earlier value are left unused
+    std::vector<bool> isLive(func.code.size(), false);
+    for (size_t i = func.code.size(); i-- > 0;) {
+        const IRInstruction &ins = func.code[i];
+        if (ins.op >= IROp::Store) {
+            isLive[i] = true;
+        }
+        if (isLive[i]) {
+            for (size_t operand : ins.operands) {
+                isLive[operand] = true;
+            }
+        }
+    }
+    std::vector<size_t> indices(func.code.size());
+    std::vector<IRInstruction> code;
+    for (size_t i = 0; i < func.code.size(); i++) {
+        if (!isLive[i]) {
+            continue;
+        }
+        indices[i] = code.size();
+        code.push_back(func.code[i]);
+        for (auto &operand : code.back().operands) {
+            operand = indices[operand];
+        }
+    }
+    func.code = std::move(code);
+}
+
+void IRBuilder::mGenFunction(size_t index, GenCalls &calls) {
+    const IRFunction &func = mFunctions[index];
+    GenState state;
+    state.locations.resize(func.code.size());
+    state.usesLeft.assign(func.code.size(), 0);
+    state.tempsCount = 0;
+    for (size_t i = 0; i < func.code.size(); i++) {
+        const IRInstruction &ins = func.code[i];
+        for (size_t operand : ins.operands) {
+            state.usesLeft[operand]++;
+        }
+        if (ins.op == IROp::Param || ins.op == IROp::Load) {
+            mSetLocation(state, i, ins.name);
+        }
+    }
+
+    for (const auto &ins : func.code) {
+        if (ins.op == IROp::Store) {
+            mGenStore(func, state, ins);
+        }
+        else if (ins.op == IROp::Return) {
+            mGenValue(func, state, ins.operands[0], false);
+            state.calls.push_back([](CodeBuilder &builder) { builder.genReturn(); });
+        }
+        else if (ins.op == IROp::Statement) {
+            for (size_t operand : ins.operands) {
+                mGenValue(func, state, operand, false);
+            }
+            state.calls.push_back([](CodeBuilder &builder) { builder.endStatement(); });
+            mFreeTemps(state);
+        }
+        else if (ins.op == IROp::Func) {
+            mGenFunction(ins.func, state.calls);
+        }
+    }
+
+    if (index != 0) {
+        std::string name = func.name;
+        std::vector<std::string> argNames = func.argNames;
+        std::vector<std::string> pragmas = func.pragmas;
+        calls.push_back([=](CodeBuilder &builder) { builder.beginFunc(name, argNames, pragmas); });
+    }
+    // Temps get their slots before the body runs, RegisterCodeBuilder places new variables where its temps start
+    for (size_t i = 0; i < state.tempsCount; i++) {
+        std::string temp = "@" + std::to_string(i);
+        calls.push_back([=](CodeBuilder &builder) { builder.declareVar(temp); });
+    }
+    calls.insert(calls.end(), state.calls.begin(), state.calls.end());
+    if (index != 0) {
+        calls.push_back([](CodeBuilder &builder) { builder.endFunc(); });
+    }
+}
+
+void IRBuilder::mGenStore(const IRFunction &func, GenState &state, const IRInstruction &ins) {
+    size_t value = ins.operands[0];
+    std::string varName = ins.name;
+    bool isAvailable = !state.locations[value].empty() || func.code[value].op == IROp::Const;
+    if (isAvailable && func.observedVars.count(varName) == 0) {
+        // Copy propagation, nothing reads the variable from the frame and its uses get the value where it already is
+        state.usesLeft[value]--;
+        return;
+    }
+    mGenValue(func, state, value, true);
+
+    // Values the variable holds move to temps if they are used later
+    std::vector<size_t> &holders = state.holders[varName];
+    std::vector<size_t> held;
+    held.swap(holders);
+    for (size_t heldValue : held) {
+        if (heldValue == value) {
+            holders.push_back(heldValue);
+            continue;
+        }
+        state.locations[heldValue].clear();
+        if (state.usesLeft[heldValue] > 0) {
+            state.calls.push_back([=](CodeBuilder &builder) { builder.genGet(varName); });
+            std::string temp = mAllocTemp(state, heldValue);
+            state.calls.push_back([=](CodeBuilder &builder) { builder.genSet(temp); });
+        }
+    }
+    state.calls.push_back([=](CodeBuilder &builder) { builder.genSet(varName); });
+    if (state.locations[value].empty() && func.code[value].op != IROp::Const) {
+        mSetLocation(state, value, varName);
+    }
+}
+
+void IRBuilder::mGenValue(const IRFunction &func, GenState &state, size_t value, bool isStored) {
+    state.usesLeft[value]--;
+    if (!state.locations[value].empty()) {
+        std::string varName = state.locations[value];
+        state.calls.push_back([=](CodeBuilder &builder) { builder.genGet(varName); });
+        return;
+    }
+    mGenCompute(func, state, value);
+    if (!isStored && state.usesLeft[value] > 0 && func.code[value].op != IROp::Const) {
+        // Computed once, the later uses read it from a temp
+        std::string temp = mAllocTemp(state, value);
+        state.calls.push_back([=](CodeBuilder &builder) { builder.genSet(temp); });
+        state.calls.push_back([=](CodeBuilder &builder) { builder.genGet(temp); });
+    }
+}
+
+void IRBuilder::mGenCompute(const IRFunction &func, GenState &state, size_t value) {
+    const IRInstruction &ins = func.code[value];
+    if (ins.op == IROp::Seq) {
+        for (size_t i = 0; i + 1 < ins.operands.size(); i++) {
+            mGenPrerequisite(func, state, ins.operands[i]);
+        }
+        mGenValue(func, state, ins.operands.back(), false);
+        return;
+    }
+    for (size_t operand : ins.operands) {
+        mGenValue(func, state, operand, false);
+    }
+    if (ins.op == IROp::Const) {
+        double number = ins.number;
+        state.calls.push_back([=](CodeBuilder &builder) { builder.genPush(number); });
+    }
+    else if (ins.op == IROp::BinOp) {
+        char op = ins.binOp;
+        state.calls.push_back([=](CodeBuilder &builder) { builder.genBinOp(op); });
+    }
+    else if (ins.op == IROp::Neg) {
+        state.calls.push_back([](CodeBuilder &builder) { builder.genNeg(); });
+    }
+    else if (ins.op == IROp::Call) {
+        std::string name = ins.name;
+        size_t argsCount = ins.operands.size();
+        state.calls.push_back([=](CodeBuilder &builder) { builder.genCall(name, argsCount); });
+    }
+    else if (ins.op == IROp::Vector) {
+        size_t count = ins.operands.size();
+        state.calls.push_back([=](CodeBuilder &builder) { builder.genVector(count); });
+    }
+    else {
+        mError("value of '" + ins.name + "' is lost");
+    }
+}
+
+void IRBuilder::mGenPrerequisite(const IRFunction &func, GenState &state, size_t value) {
+    // Computed now and kept in a temp even if nothing uses it, the stack code has no way to drop a value
+    const IRInstruction &ins = func.code[value];
+    state.usesLeft[value]--;
+    if (!state.locations[value].empty() || ins.op == IROp::Const) {
+        return;
+    }
+    mGenCompute(func, state, value);
+    if (ins.op == IROp::Call && ins.func == SIZE_MAX && ins.name == "print") {
+        // print leaves nothing on the stack
+        return;
+    }
+    std::string temp = mAllocTemp(state, value);
+    state.calls.push_back([=](CodeBuilder &builder) { builder.genSet(temp); });
+}
+
+void IRBuilder::mSetLocation(GenState &state, size_t value, const std::string &varName) {
+    state.locations[value] = varName;
+    state.holders[varName].push_back(value);
+}
+
+std::string IRBuilder::mAllocTemp(GenState &state, size_t value) {
+    std::string temp;
+    if (state.freeTemps.empty()) {
+        temp = "@" + std::to_string(state.tempsCount++);
+    }
+    else {
+        temp = state.freeTemps.back();
+        state.freeTemps.pop_back();
+    }
+    state.temps[temp] = value;
+    mSetLocation(state, value, temp);
+    return temp;
+}
+
+void IRBuilder::mFreeTemps(GenState &state) {
+    // Between statements nothing on the stack refers to a temp, so the ones whose value is used up can be reused
+    for (auto it = state.temps.begin(); it != state.temps.end();) {
+        if (state.usesLeft[it->second] == 0) {
+            state.locations[it->second].clear();
+            state.holders.erase(it->first);
+            state.freeTemps.push_back(it->first);
+            it = state.temps.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+}
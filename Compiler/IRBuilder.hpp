@@ -0,0 +1,142 @@
+#pragma once
+#include "CodeBuilder.hpp"
+#include <functional>
+
+enum class IROp {
+    // Argument of the function, in its frame from the entry
+    Param,
+    // Variable of an enclosing scope, none of them can change while the body runs
+    Load,
+    Const,
+    BinOp,
+    Neg,
+    Call,
+    Vector,
+    // Value of the last operand, computed after the others. An inlined call evaluates its arguments and the statements
+    // of the body first, as the call did.
+    Seq,
+    // Assignment, the value goes to the frame only if a nested function reads the variable there or the value is
+    // needed later and is nowhere else
+    Store,
+    Return,
+    // End of a statement, the operands are values the statement leaves on the stack of the stack engine
+    Statement,
+    // Definition of a nested function, its body is generated at this point
+    Func
+};
+
+// Instruction of the SSA form. A value is the index of the instruction that defines it, so every value is defined
+// exactly once and before its uses.
+struct IRInstruction {
+    IRInstruction(IROp op, const std::string &name = "");
+
+    IROp op;
+    // Variable of Param, Load and Store, callee name of Call
+    std::string name;
+    char binOp;
+    double number;
+    // Values in the order the stack code pushes them, the right operand of BinOp comes first
+    std::vector<size_t> operands;
+    // Index of the user function a Call calls, SIZE_MAX for print and the builtins. Index of the body of Func. Index of
+    // the function whose variable a Load reads, SIZE_MAX if none has it.
+    size_t func;
+    // Functions defined before a Call, its name resolves to the last of them with that name
+    size_t funcsCount;
+};
+
+// Straight-line body of a function or of the top level
+struct IRFunction {
+    IRFunction(const std::string &name, const std::vector<std::string> &argNames,
+               const std::vector<std::string> &pragmas, size_t parent);
+
+    std::string name;
+    std::vector<std::string> argNames;
+    std::vector<std::string> pragmas;
+    // Index of the enclosing function, SIZE_MAX for the top level
+    size_t parent;
+    std::vector<IRInstruction> code;
+    // Value of each variable assigned so far while the body is built, then the last value of each one it assigns
+    std::map<std::string, size_t> vars;
+    // Variables that nested functions read from the frame
+    std::set<std::string> observedVars;
+    // Same rules as FuncEffects, a pure function returns the same result for the same arguments
+    bool isImpure;
+    std::set<size_t> callees;
+    bool isPure;
+};
+
+// Mid-level IR between the AST and the code builders. It receives the code through the CodeBuilder interface like
+// RegisterCodeBuilder does, but records each function body as SSA values instead of emitting it. optimize() inlines
+// small functions and merges values computed twice, codegen() then drives the real builder with the optimized code in
+// the original order.
+class IRBuilder : public CodeBuilder {
+public:
+    IRBuilder() = default;
+
+    void beginRoot() override;
+    void endRoot() override;
+    void beginFunc(const std::string &funcName, const std::vector<std::string> &argNames,
+                   const std::vector<std::string> &pragmas = {}) override;
+    void endFunc() override;
+    void endStatement() override;
+    void genSet(const std::string &varName) override;
+    void genBinOp(char op) override;
+    void genNeg() override;
+    void genCall(const std::string &funcName, size_t argsCount) override;
+    void genPush(double value) override;
+    void genVector(size_t count) override;
+    void genGet(const std::string &varName) override;
+    void genReturn() override;
+
+    // Inlines small functions, then global value numbering, the bodies are straight-line so one pass over each finds
+    // every redundant value
+    void optimize();
+    void codegen(CodeBuilder &builder);
+    void print();
+
+private:
+    using GenCalls = std::vector<std::function<void(CodeBuilder &)>>;
+
+    // Where the values of a body are while its code is generated
+    struct GenState {
+        // Variable holding each value, empty if it has to be computed
+        std::vector<std::string> locations;
+        std::map<std::string, std::vector<size_t>> holders;
+        std::vector<size_t> usesLeft;
+        std::map<std::string, size_t> temps;
+        std::vector<std::string> freeTemps;
+        size_t tempsCount;
+        GenCalls calls;
+    };
+
+    IRFunction &mCurrent();
+    size_t mAddValue(const IRInstruction &ins, size_t operandsCount);
+    size_t mResolveFunc(const std::string &funcName, size_t funcsCount);
+    void mAnalyzePurity();
+    std::vector<bool> mFindRecursive(std::vector<size_t> &order);
+    bool mIsVisible(size_t caller, const IRInstruction &load, const std::map<std::string, size_t> &vars);
+    bool mIsInlinable(size_t caller, const IRInstruction &call, const std::map<std::string, size_t> &vars,
+                      const std::vector<bool> &isRecursive);
+    size_t mInlineCall(size_t caller, const IRInstruction &call, const std::map<std::string, size_t> &vars,
+                       std::vector<IRInstruction> &code);
+    void mInlineCalls(size_t index, const std::vector<bool> &isRecursive);
+    bool mGetValueKey(const IRInstruction &ins, std::string &key);
+    void mNumberValues(IRFunction &func);
+    void mRemoveDeadValues(IRFunction &func);
+    void mGenFunction(size_t index, GenCalls &calls);
+    void mGenStore(const IRFunction &func, GenState &state, const IRInstruction &ins);
+    void mGenValue(const IRFunction &func, GenState &state, size_t value, bool isStored);
+    void mGenCompute(const IRFunction &func, GenState &state, size_t value);
+    void mGenPrerequisite(const IRFunction &func, GenState &state, size_t value);
+    void mSetLocation(GenState &state, size_t value, const std::string &varName);
+    std::string mAllocTemp(GenState &state, size_t value);
+    void mFreeTemps(GenState &state);
+
+    std::vector<IRFunction> mFunctions;
+    std::vector<size_t> mOpenFunctions;
+    // Indices of the functions with each name in the order they are defined, calls resolve their names as CodeBuilder
+    // does
+    std::map<std::string, std::vector<size_t>> mFunctionsByName;
+    // Values of the stack code, as RegisterCodeBuilder simulates it
+    std::vector<size_t> mValues;
+};
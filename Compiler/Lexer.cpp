@@ -1,18 +1,19 @@
 #include "Lexer.hpp"
 #include <algorithm>
 #include <locale>
+#include <stdexcept>
 
-std::string stringToLower(const std::string &str) {
+static std::string stringToLower(const std::string &str) {
     std::string out(str.size(), '\0');
     std::transform(str.begin(), str.end(), out.begin(), tolower);
     return out;
 }
 
-char stringToLower(char ch) {
+static char stringToLower(char ch) {
     return std::tolower(ch, std::locale());
 }
 
-bool stringContainsSymbol(const std::string &str, char symbol, bool caseSensitive) {
+static bool stringContainsSymbol(const std::string &str, char symbol, bool caseSensitive) {
     std::string s1 = caseSensitive ? str : stringToLower(str);
     char ch = caseSensitive ? symbol : stringToLower(symbol);
     for (const auto &it : s1) {
@@ -23,7 +24,7 @@ bool stringContainsSymbol(const std::string &str, char symbol, bool caseSensitiv
     return false;
 }
 
-std::vector<std::string> stringSplit(const std::string &str, const std::string &separatorsList, bool saveSeparators) {
+static std::vector<std::string> stringSplit(const std::string &str, const std::string &separatorsList, bool saveSeparators) {
     std::vector<std::string> tokens;
     std::string token;
     for (const auto &it : str) {
@@ -141,11 +142,33 @@ bool Lexer::mReadToken(Token &token) {
         }
         token.type = TokenType::Number;
     }
-    else if (stringContainsSymbol("+-*/(){}=;,", mLastChar, false)) {
+    else if (stringContainsSymbol("+-*/(){}[]=;,", mLastChar, false)) {
         token.value += mLastChar;
         token.type = TokenType::Symbol;
         mNextChar(true);
     }
+    else if (mLastChar == '#') {
+        std::string directive;
+        mNextChar(false);
+        while (std::isalpha(mLastChar)) {
+            directive += mLastChar;
+            mNextChar(false);
+        }
+        if (directive != "pragma") {
+            mError("unknown directive '#" + directive + "'");
+        }
+        while (mLastChar == ' ' || mLastChar == '\t') {
+            mNextChar(false);
+        }
+        while (std::isalnum(mLastChar) || mLastChar == '_') {
+            token.value += mLastChar;
+            mNextChar(false);
+        }
+        if (token.value.empty()) {
+            mError("expected pragma name");
+        }
+        token.type = TokenType::Pragma;
+    }
     else if (std::isspace(mLastChar)) {
         mNextChar(true);
         return false;
@@ -159,5 +182,5 @@ bool Lexer::mReadToken(Token &token) {
 
 void Lexer::mError(const std::string &text) {
     printf("LexerError(%d:%d): %s\n", mPosition.line, mPosition.column, text.data());
-    throw std::exception("lexer error");
+    throw std::runtime_error("lexer error");
 }
\ No newline at end of file
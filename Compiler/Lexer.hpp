@@ -5,6 +5,8 @@
 enum class TokenType {
     Def,
     Return,
+    // `#pragma name` line, the value is the name
+    Pragma,
 
     Identifier,
     Number,
@@ -1,5 +1,15 @@
 #include "Parser.hpp"
 #include "CodeBuilder.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// Pragmas a function definition may be preceded by
+static const char *knownPragmas[] = {
+    // Keeps a pure function out of the memo table, for functions called with different arguments every time
+    "nomemo",
+    // Keeps every call of a function a call, the IRBuilder inlines small ones otherwise
+    "noinline"
+};
 
 Parser::Parser(const std::vector<Token> &tokens) : mTokens(tokens) {
     mTokensPos = 0;
@@ -40,7 +50,7 @@ void Parser::mError(const std::string &text) {
         printf(" ");
     }
     printf("^\n");
-    throw std::exception("parser error");
+    throw std::runtime_error("parser error");
 }
 
 bool Parser::mMatch(char ch) {
@@ -74,9 +84,21 @@ const Token &Parser::mLookToken() {
 
 std::unique_ptr<ASTStatement> Parser::mParseStatement() {
     std::unique_ptr<ASTStatement> statement;
+    std::vector<std::string> pragmas;
+    while (mCurToken.type == TokenType::Pragma) {
+        auto isKnown = [&](const char *name) { return mCurToken.value == name; };
+        if (std::none_of(std::begin(knownPragmas), std::end(knownPragmas), isKnown)) {
+            mError("unknown pragma '" + mCurToken.value + "'");
+        }
+        pragmas.push_back(mCurToken.value);
+        mNextToken();
+        if (mCurToken.type != TokenType::Pragma && mCurToken.type != TokenType::Def) {
+            mError("pragma must precede a function definition");
+        }
+    }
     if (mCurToken.type == TokenType::Def) {
         mNextToken();
-        statement = mParseFuncDef();
+        statement = mParseFuncDef(pragmas);
     }
     else if (mCurToken.type == TokenType::Return) {
         mNextToken();
@@ -94,7 +116,7 @@ std::unique_ptr<ASTStatement> Parser::mParseStatement() {
     return statement;
 }
 
-std::unique_ptr<ASTFuncDef> Parser::mParseFuncDef() {
+std::unique_ptr<ASTFuncDef> Parser::mParseFuncDef(const std::vector<std::string> &pragmas) {
     if (mCurToken.type != TokenType::Identifier) {
         mError("expected identifier");
     }
@@ -116,7 +138,7 @@ std::unique_ptr<ASTFuncDef> Parser::mParseFuncDef() {
     while (!mMatch('}')) {
         statements.emplace_back(mParseStatement());
     }
-    return std::make_unique<ASTFuncDef>(funcName, argNames, statements);
+    return std::make_unique<ASTFuncDef>(funcName, argNames, pragmas, statements);
 }
 
 std::unique_ptr<ASTExpr> Parser::mParseExpr() {
@@ -167,6 +189,9 @@ std::unique_ptr<ASTExpr> Parser::mParseExprFactor() {
                 expr = mParseExpr();
                 mMatch(')');
             }
+            else if (mMatch('[')) {
+                expr = mParseVector();
+            }
             else {
                 mError("unknown token");
             }
@@ -214,6 +239,22 @@ std::unique_ptr<ASTExpr> Parser::mParseExprIdentifier() {
     return expr;
 }
 
+std::unique_ptr<ASTExpr> Parser::mParseVector() {
+    // The opening bracket is already matched
+    if (mMatch(']')) {
+        mError("empty vector");
+    }
+    std::vector<std::unique_ptr<ASTExpr>> elements;
+    while (true) {
+        elements.emplace_back(mParseExpr());
+        if (!mMatch(',')) {
+            mMatchError(']');
+            break;
+        }
+    }
+    return std::make_unique<ASTExprVector>(elements);
+}
+
 std::unique_ptr<ASTReturn> Parser::mParseReturn() {
     std::unique_ptr<ASTExpr> expr = mParseExpr();
     return std::make_unique<ASTReturn>(std::move(expr));
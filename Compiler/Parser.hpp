@@ -9,6 +9,7 @@
 #include "ASTExprNumber.hpp"
 #include "ASTExprCallFunc.hpp"
 #include "ASTExprVar.hpp"
+#include "ASTExprVector.hpp"
 #include "Lexer.hpp"
 
 class Parser {
@@ -24,13 +25,14 @@ private:
     void mNextToken();
     const Token &mLookToken();
     std::unique_ptr<ASTStatement> mParseStatement();
-    std::unique_ptr<ASTFuncDef> mParseFuncDef();
+    std::unique_ptr<ASTFuncDef> mParseFuncDef(const std::vector<std::string> &pragmas);
     std::unique_ptr<ASTExpr> mParseExpr();
     std::unique_ptr<ASTExpr> mParseExprTerm();
     std::unique_ptr<ASTExpr> mParseExprFactor();
     std::unique_ptr<ASTExpr> mParseNumber();
     std::unique_ptr<ASTExpr> mParseCallFunc();
     std::unique_ptr<ASTExpr> mParseExprIdentifier();
+    std::unique_ptr<ASTExpr> mParseVector();
     std::unique_ptr<ASTReturn> mParseReturn();
     std::unique_ptr<ASTAssignment> mParseAssignment();
 
@@ -0,0 +1,295 @@
+#include "RegisterCodeBuilder.hpp"
+#include <algorithm>
+
+RegOperand::RegOperand(Kind kind, size_t reg, double value) {
+    this->kind = kind;
+    this->reg = reg;
+    this->value = value;
+}
+
+RegResult::RegResult() : operand(RegOperand::Kind::Const, 0, 0.0) {
+    this->isLeft = false;
+    this->isPending = false;
+    this->codeEnd = SIZE_MAX;
+    this->isTailCall = false;
+}
+
+void RegisterCodeBuilder::beginRoot() {
+    mIsRegister = true;
+    CodeBuilder::beginRoot();
+    mResults.push_back(RegResult());
+}
+
+void RegisterCodeBuilder::endStatement() {
+    // The stack engine leaves the value of an expression statement on the stack, in a function it may be the result
+    if (!mOperands.empty()) {
+        mSetResult(mOperands.back());
+    }
+    mOperands.clear();
+    mTempsCount = 0;
+}
+
+void RegisterCodeBuilder::genSet(const std::string &varName) {
+    mKeepResult();
+    RegOperand operand = mPopOperand();
+    const VarSymbol &var = mAddVar(varName);
+    if (operand.kind == RegOperand::Kind::Temp && operand.reg == var.slot) {
+        // A new variable takes the place of the first temp, which already holds its value
+    }
+    else if (operand.kind == RegOperand::Kind::Temp && operand.reg == mLastDest && mLastDestPos != SIZE_MAX) {
+        mCode.erase(mCode.begin() + mLastDestPos, mCode.end());
+        mAddDestLine(mLastOpCode, var.slot, mLastOperands, mLastComment);
+    }
+    else {
+        mMoveTo(var.slot, operand);
+    }
+    mLastDestPos = SIZE_MAX;
+    mUpdateTemps();
+}
+
+void RegisterCodeBuilder::genBinOp(char op) {
+    mKeepResult();
+    RegOperand lhs = mOperands.back();
+    RegOperand rhs = mOperands[mOperands.size() - 2];
+    size_t rhsReg = mMaterialize(rhs);
+    size_t lhsReg = mMaterialize(lhs);
+    mOperands.erase(mOperands.end() - 2, mOperands.end());
+    mUpdateTemps();
+
+    OpCode opCode = op == '+' ? OpCode::RegAdd : op == '-' ? OpCode::RegSub : op == '*' ? OpCode::RegMul : OpCode::RegDiv;
+    size_t dest = mAllocTemp();
+    mAddDestLine(opCode, dest, { CodeOperand(CodeOperand::Kind::Register, lhsReg), CodeOperand(CodeOperand::Kind::Register, rhsReg) });
+    mOperands.push_back(RegOperand(RegOperand::Kind::Temp, dest, 0));
+}
+
+void RegisterCodeBuilder::genNeg() {
+    mKeepResult();
+    size_t reg = mMaterialize(mOperands.back());
+    mOperands.pop_back();
+    mUpdateTemps();
+
+    size_t dest = mAllocTemp();
+    mAddDestLine(OpCode::RegNeg, dest, { CodeOperand(CodeOperand::Kind::Register, reg) });
+    mOperands.push_back(RegOperand(RegOperand::Kind::Temp, dest, 0));
+}
+
+void RegisterCodeBuilder::genCall(const std::string &funcName, size_t argsCount) {
+    mKeepResult();
+    const FuncSymbol &func = mFindCallee(funcName, argsCount);
+    mAddCallEffect(func);
+    if (mOperands.size() < func.argsCount) {
+        mError("not enough arguments for '" + funcName + "'");
+    }
+    if (func.isIntrinsic) {
+        // Three-address like the arithmetic, the arguments are read where they are
+        std::vector<CodeOperand> operands;
+        for (size_t i = mOperands.size() - func.argsCount; i < mOperands.size(); i++) {
+            operands.push_back(CodeOperand(CodeOperand::Kind::Register, mMaterialize(mOperands[i])));
+        }
+        mOperands.erase(mOperands.end() - func.argsCount, mOperands.end());
+        mUpdateTemps();
+        size_t dest = mAllocTemp();
+        mAddDestLine(func.regIntrinsic, dest, operands);
+        mOperands.push_back(RegOperand(RegOperand::Kind::Temp, dest, 0));
+        return;
+    }
+    std::vector<RegOperand> args(mOperands.end() - func.argsCount, mOperands.end());
+    mOperands.erase(mOperands.end() - func.argsCount, mOperands.end());
+
+    if (func.symbol.fullName == "print") {
+        size_t reg = mMaterialize(args[0]);
+        mAddInstruction(OpCode::RegPrint, { CodeOperand(CodeOperand::Kind::Register, reg) });
+        mLastDestPos = SIZE_MAX;
+        mUpdateTemps();
+        return;
+    }
+
+    // Arguments go to consecutive registers above every live value, those become r0.. of the callee.
+    // Temps of the arguments are already there in order, filling from the last one never overwrites a pending source.
+    mUpdateTemps();
+    size_t argBase = mGetCurrentScope().slotsCount + mTempsCount;
+    for (size_t i = args.size(); i-- > 0;) {
+        mMoveTo(argBase + i, args[i]);
+    }
+    FuncScope &scope = mGetCurrentScope();
+    scope.frameSize = std::max(scope.frameSize, argBase + args.size());
+
+    size_t dest = mAllocTemp();
+    if (func.isBuiltin) {
+        mAddDestLine(OpCode::RegNative, dest, { CodeOperand(CodeOperand::Kind::Symbol, func.symbol.fullName), CodeOperand(CodeOperand::Kind::Register, argBase) });
+    }
+    else {
+        mAddDestLine(OpCode::RegCall, dest, { CodeOperand(CodeOperand::Kind::Label, func.symbol.fullName), CodeOperand(CodeOperand::Kind::Register, argBase) });
+    }
+    mOperands.push_back(RegOperand(RegOperand::Kind::Temp, dest, 0));
+    mLastCallFunc = func.symbol.fullName;
+    mLastCallBase = argBase;
+    mLastCallArgsCount = args.size();
+    mIsLastCallTail = !func.isBuiltin && mIsTailCallAllowed(func);
+}
+
+void RegisterCodeBuilder::genPush(double value) {
+    mOperands.push_back(RegOperand(RegOperand::Kind::Const, 0, value));
+}
+
+void RegisterCodeBuilder::genVector(size_t count) {
+    if (mOperands.size() < count) {
+        mError("not enough elements for the vector");
+    }
+    mKeepResult();
+    std::vector<RegOperand> elements(mOperands.end() - count, mOperands.end());
+    mOperands.erase(mOperands.end() - count, mOperands.end());
+    // The elements go to consecutive registers above every live value, as the arguments of a call
+    mUpdateTemps();
+    size_t base = mGetCurrentScope().slotsCount + mTempsCount;
+    for (size_t i = elements.size(); i-- > 0;) {
+        mMoveTo(base + i, elements[i]);
+    }
+    FuncScope &scope = mGetCurrentScope();
+    scope.frameSize = std::max(scope.frameSize, base + elements.size());
+
+    size_t dest = mAllocTemp();
+    mAddDestLine(OpCode::RegVec, dest, { CodeOperand(CodeOperand::Kind::Register, base), CodeOperand(CodeOperand::Kind::Index, count) });
+    mOperands.push_back(RegOperand(RegOperand::Kind::Temp, dest, 0));
+}
+
+void RegisterCodeBuilder::genGet(const std::string &varName) {
+    if (mFindVarAbsolute(varName).scope == mGetCurrentScope().scope) {
+        mOperands.push_back(RegOperand(RegOperand::Kind::Var, mFindVarAbsolute(varName).slot, 0));
+        return;
+    }
+    // The hidden variable may be added first, find the symbol after it
+    mKeepResult();
+    const VarSymbol &var = mFindVarAbsolute(varName);
+    mAddOuterReadEffect();
+    size_t dest = mAllocTemp();
+    mAddDestLine(OpCode::RegLoadOuter, dest, { CodeOperand(CodeOperand::Kind::Index, var.scope),
+                                               CodeOperand(CodeOperand::Kind::Index, var.slot) }, var.symbol.fullName);
+    mOperands.push_back(RegOperand(RegOperand::Kind::Temp, dest, 0));
+}
+
+void RegisterCodeBuilder::genReturn() {
+    // As in the stack engine the value only stays, the function returns the value left last at its end
+    mSetResult(mPopOperand());
+    mUpdateTemps();
+}
+
+void RegisterCodeBuilder::mGenArguments(const std::vector<std::string> &argNames) {
+    // The caller passes argument i in register i, while the stack engine binds the last pushed argument
+    // to the first parameter. Allocating the parameters backwards keeps both engines computing the same values.
+    for (auto it = argNames.crbegin(); it != argNames.crend(); it++) {
+        mAddVar(*it);
+    }
+    mResults.push_back(RegResult());
+}
+
+void RegisterCodeBuilder::mGenFuncEnd() {
+    const RegResult &result = mResults.back();
+    if (!result.isLeft) {
+        mError("function '" + mGetCurrentScope().symbol.fullName + "' returns no value");
+    }
+    if (result.isTailCall && result.codeEnd == mCode.size()) {
+        // The callee result would only be copied into ret, let the callee return it to our caller directly
+        mCode.erase(mCode.begin() + mLastDestPos, mCode.end());
+        mAddInstruction(OpCode::RegTailCall, { CodeOperand(CodeOperand::Kind::Label, mLastCallFunc), CodeOperand(CodeOperand::Kind::Register, mLastCallBase),
+                                               CodeOperand(CodeOperand::Kind::Index, mLastCallArgsCount) });
+    }
+    else {
+        size_t reg = mMaterialize(result.operand);
+        mAddInstruction(OpCode::RegRet, { CodeOperand(CodeOperand::Kind::Register, reg) });
+    }
+    mResults.pop_back();
+    mLastDestPos = SIZE_MAX;
+    mOperands.clear();
+    mTempsCount = 0;
+}
+
+size_t RegisterCodeBuilder::mAllocTemp() {
+    FuncScope &scope = mGetCurrentScope();
+    size_t reg = scope.slotsCount + mTempsCount++;
+    scope.frameSize = std::max(scope.frameSize, reg + 1);
+    return reg;
+}
+
+void RegisterCodeBuilder::mUpdateTemps() {
+    // Temps are released in stack order, the live ones are those still referenced by the value stack
+    size_t base = mGetCurrentScope().slotsCount;
+    mTempsCount = 0;
+    for (const auto &operand : mOperands) {
+        if (operand.kind == RegOperand::Kind::Temp && operand.reg >= base) {
+            mTempsCount = std::max(mTempsCount, operand.reg + 1 - base);
+        }
+    }
+}
+
+size_t RegisterCodeBuilder::mMaterialize(const RegOperand &operand) {
+    if (operand.kind == RegOperand::Kind::Const) {
+        size_t dest = mAllocTemp();
+        mAddDestLine(OpCode::RegLoadK, dest, { CodeOperand(operand.value) });
+        return dest;
+    }
+    return operand.reg;
+}
+
+void RegisterCodeBuilder::mMoveTo(size_t reg, const RegOperand &operand) {
+    if (operand.kind == RegOperand::Kind::Const) {
+        mAddDestLine(OpCode::RegLoadK, reg, { CodeOperand(operand.value) });
+    }
+    else if (operand.reg != reg) {
+        mAddDestLine(OpCode::RegMove, reg, { CodeOperand(CodeOperand::Kind::Register, operand.reg) });
+    }
+}
+
+RegOperand RegisterCodeBuilder::mPopOperand() {
+    if (mOperands.empty()) {
+        mError("value stack is empty");
+    }
+    RegOperand operand = mOperands.back();
+    mOperands.pop_back();
+    return operand;
+}
+
+void RegisterCodeBuilder::mSetResult(const RegOperand &operand) {
+    if (mFuncStack.empty()) {
+        return;
+    }
+    RegResult &result = mResults.back();
+    result.isLeft = true;
+    result.isPending = true;
+    result.operand = operand;
+    result.codeEnd = mCode.size();
+    result.isTailCall = operand.kind == RegOperand::Kind::Temp && mLastDestPos != SIZE_MAX && mLastOpCode == OpCode::RegCall &&
+                        operand.reg == mLastDest && mIsLastCallTail;
+}
+
+void RegisterCodeBuilder::mKeepResult() {
+    // Code follows the value left last, a temp would be reused and a variable may be set again. No temps are live
+    // between statements, so a hidden variable of the frame takes it.
+    RegResult &result = mResults.back();
+    if (!result.isPending) {
+        return;
+    }
+    result.isPending = false;
+    result.isTailCall = false;
+    if (result.operand.kind == RegOperand::Kind::Const) {
+        return;
+    }
+    const VarSymbol &var = mAddVar("@result");
+    mMoveTo(var.slot, result.operand);
+    result.operand = RegOperand(RegOperand::Kind::Var, var.slot, 0);
+    mLastDestPos = SIZE_MAX;
+}
+
+void RegisterCodeBuilder::mAddDestLine(OpCode opCode, size_t dest, const std::vector<CodeOperand> &operands,
+                                       const std::string &comment) {
+    mLastDestPos = mCode.size();
+    mLastDest = dest;
+    mLastOpCode = opCode;
+    mLastOperands = operands;
+    mLastComment = comment;
+    // Calls encode the callee before the destination
+    std::vector<CodeOperand> line = operands;
+    size_t destPos = opCode == OpCode::RegCall || opCode == OpCode::RegNative ? 1 : 0;
+    line.insert(line.begin() + destPos, CodeOperand(CodeOperand::Kind::Register, dest));
+    mAddInstruction(opCode, line, comment);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include "CodeBuilder.hpp"
+
+// Entry of the compile-time value stack, constants and variables get into a register only when an instruction needs them
+struct RegOperand {
+    enum class Kind {
+        Var,
+        Temp,
+        Const
+    };
+
+    RegOperand(Kind kind, size_t reg, double value);
+
+    Kind kind;
+    size_t reg;
+    double value;
+};
+
+// Value a function body left last. As in the stack engine it is the result whichever statement left it, so code
+// generated after it first moves it out of the temps.
+struct RegResult {
+    RegResult();
+
+    bool isLeft;
+    // Still where the statement left it, possibly in a temp
+    bool isPending;
+    RegOperand operand;
+    // Code size when it was left, and whether it comes from the last call, which can then become a tail call
+    size_t codeEnd;
+    bool isTailCall;
+};
+
+// Generates three-address code for the register engine of the VM. The AST still drives it through the stack
+// oriented CodeBuilder interface, the stack is simulated at compile time and only arithmetic, calls and moves are emitted.
+class RegisterCodeBuilder : public CodeBuilder {
+public:
+    RegisterCodeBuilder() = default;
+
+    void beginRoot() override;
+    void endStatement() override;
+    void genSet(const std::string &varName) override;
+    void genBinOp(char op) override;
+    void genNeg() override;
+    void genCall(const std::string &funcName, size_t argsCount) override;
+    void genPush(double value) override;
+    void genVector(size_t count) override;
+    void genGet(const std::string &varName) override;
+    void genReturn() override;
+
+protected:
+    void mGenArguments(const std::vector<std::string> &argNames) override;
+    void mGenFuncEnd() override;
+
+private:
+    size_t mAllocTemp();
+    void mUpdateTemps();
+    size_t mMaterialize(const RegOperand &operand);
+    void mMoveTo(size_t reg, const RegOperand &operand);
+    RegOperand mPopOperand();
+    void mSetResult(const RegOperand &operand);
+    void mKeepResult();
+    void mAddDestLine(OpCode opCode, size_t dest, const std::vector<CodeOperand> &operands, const std::string &comment = "");
+
+    std::vector<RegOperand> mOperands;
+    size_t mTempsCount = 0;
+    std::vector<RegResult> mResults;
+    // Last instruction that wrote a temp, genSet retargets it to the variable instead of adding a mov
+    size_t mLastDestPos = SIZE_MAX;
+    size_t mLastDest = 0;
+    OpCode mLastOpCode = OpCode::RegMove;
+    std::vector<CodeOperand> mLastOperands;
+    std::string mLastComment;
+    // Last call, returning its result turns it into a tail call
+    size_t mLastCallBase = 0;
+    size_t mLastCallArgsCount = 0;
+    bool mIsLastCallTail = false;
+};
\ No newline at end of file
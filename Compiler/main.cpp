@@ -1,8 +1,11 @@
 #include "Lexer.hpp"
 #include "Parser.hpp"
 #include "CodeBuilder.hpp"
+#include "RegisterCodeBuilder.hpp"
+#include "IRBuilder.hpp"
 #include <filesystem>
 #include <cstdio>
+#include <cstring>
 
 int main(int argc, char **argv) {
     std::string source;
@@ -45,19 +48,78 @@ int main(int argc, char **argv) {
     root->print();
     printf("--------------------------------------\n");
 
-    CodeBuilder builder;
-    root->codegen(builder);
-    printf("%s\n", builder.getFinalCode().data());
+    bool isRegister = false;
+    bool isListing = false;
+    OptLevel optLevel = OptLevel::Exact;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--register") == 0) {
+            isRegister = true;
+        }
+        else if (strcmp(argv[i], "--listing") == 0) {
+            isListing = true;
+        }
+        else if (strcmp(argv[i], "-O0") == 0) {
+            optLevel = OptLevel::None;
+        }
+        else if (strcmp(argv[i], "-O1") == 0) {
+            optLevel = OptLevel::Exact;
+        }
+        else if (strcmp(argv[i], "-O2") == 0) {
+            optLevel = OptLevel::Fast;
+        }
+        else {
+            printf("Error: unknown option '%s'\n", argv[i]);
+        }
+    }
 
-    std::string path;
-    if (argv[1]) {
-        path = std::filesystem::path(argv[1]).stem().string() + ".mla";
+    std::unique_ptr<CodeBuilder> builder;
+    if (isRegister) {
+        builder = std::make_unique<RegisterCodeBuilder>();
     }
     else {
-        path = "out.mla";
+        builder = std::make_unique<CodeBuilder>();
+    }
+    // Builders print the error themselves and throw. The listing of what was generated is written anyway,
+    // translator errors point at its lines.
+    std::string stem = argv[1] ? std::filesystem::path(argv[1]).stem().string() : "out";
+    std::vector<uint8_t> bytecode;
+    bool isFailed = false;
+    try {
+        root->optimize(optLevel);
+        if (optLevel == OptLevel::None) {
+            root->codegen(*builder);
+        }
+        else {
+            IRBuilder ir;
+            root->codegen(ir);
+            ir.optimize();
+            ir.print();
+            printf("--------------------------------------\n");
+            ir.codegen(*builder);
+        }
+        bytecode = builder->getBytecode();
+    }
+    catch (const std::runtime_error &) {
+        printf("Error: %s is not written\n", (stem + ".mlb").data());
+        isFailed = true;
+    }
+
+    // The bytecode is encoded directly, the .mla listing is only written on request or to inspect an error
+    if (isListing || isFailed) {
+        std::string listing = builder->getListing();
+        printf("%s\n", listing.data());
+        FILE *f = fopen((stem + ".mla").data(), "wb");
+        fwrite(listing.data(), 1, listing.size(), f);
+        fclose(f);
+    }
+    if (isFailed) {
+        // An older .mlb would run as if this source compiled
+        std::filesystem::remove(stem + ".mlb");
+        getchar();
+        return 1;
     }
-    FILE *f = fopen(path.data(), "wb");
-    fwrite(builder.getFinalCode().data(), 1, builder.getFinalCode().size(), f);
+    FILE *f = fopen((stem + ".mlb").data(), "wb");
+    fwrite(bytecode.data(), 1, bytecode.size(), f);
     fclose(f);
 
     getchar();
@@ -0,0 +1,102 @@
+#include "MathLang.hpp"
+#include "../Compiler/Lexer.hpp"
+#include "../Compiler/Parser.hpp"
+#include "../Compiler/CodeBuilder.hpp"
+#include "../Compiler/RegisterCodeBuilder.hpp"
+#include "../Compiler/IRBuilder.hpp"
+#include <stdexcept>
+
+namespace mathlang {
+
+Program::Program(std::shared_ptr<const ::Program> program, const std::map<std::string, size_t> &argsCounts) {
+    mProgram = std::move(program);
+    for (const auto &function : mProgram->getFunctions()) {
+        auto it = argsCounts.find(function.name);
+        if (it != argsCounts.end()) {
+            mFunctions[function.name] = { &function, it->second };
+        }
+    }
+    mVM = std::make_unique<VM>(mProgram);
+    mVM->setPrintEnabled(false);
+    mIsStarted = false;
+}
+
+double Program::call(const std::string &name, const std::vector<double> &args) {
+    auto it = mFunctions.find(name);
+    if (it == mFunctions.end()) {
+        printf("Error: unknown function '%s'\n", name.data());
+        throw std::runtime_error("unknown function");
+    }
+    if (args.size() != it->second.argsCount) {
+        printf("Error: function '%s' expects %zu arguments instead %zu\n", name.data(), it->second.argsCount, args.size());
+        throw std::runtime_error("arguments count mismatch");
+    }
+    mStart();
+    double result;
+    if (!mVM->call(*it->second.function, args.data(), args.size(), result)) {
+        throw std::runtime_error("runtime error");
+    }
+    return result;
+}
+
+std::vector<uint8_t> Program::saveSnapshot() {
+    mStart();
+    return mVM->saveSnapshot();
+}
+
+bool Program::loadSnapshot(BytecodeView snapshot) {
+    if (!mVM->loadSnapshot(snapshot)) {
+        return false;
+    }
+    mIsStarted = true;
+    return true;
+}
+
+void Program::mStart() {
+    if (!mIsStarted) {
+        mVM->run();
+        mIsStarted = true;
+    }
+}
+
+bool Program::hasFunction(const std::string &name) const {
+    return mFunctions.count(name) != 0;
+}
+
+std::shared_ptr<const ::Program> Program::getProgram() const {
+    return mProgram;
+}
+
+Program compile(const std::string &source, bool isRegister, OptLevel optLevel) {
+    Lexer lexer(source);
+    Parser parser(lexer.process());
+    std::unique_ptr<ASTRoot> root = parser.process();
+    root->optimize(optLevel);
+
+    std::unique_ptr<CodeBuilder> builder;
+    if (isRegister) {
+        builder = std::make_unique<RegisterCodeBuilder>();
+    }
+    else {
+        builder = std::make_unique<CodeBuilder>();
+    }
+    if (optLevel == OptLevel::None) {
+        root->codegen(*builder);
+    }
+    else {
+        IRBuilder ir;
+        root->codegen(ir);
+        ir.optimize();
+        ir.codegen(*builder);
+    }
+
+    std::vector<uint8_t> bytecode = builder->getBytecode();
+
+    std::map<std::string, size_t> argsCounts;
+    for (const auto &function : builder->getFunctions()) {
+        argsCounts[function.symbol.fullName] = function.argsCount;
+    }
+    return Program(std::make_shared<const ::Program>(bytecode), argsCounts);
+}
+
+}
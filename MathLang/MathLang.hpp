@@ -0,0 +1,47 @@
+#pragma once
+#include "../VM/VM.hpp"
+#include "../Compiler/ASTStatement.hpp"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// The whole toolchain as a library: the Compiler and the VM run in memory, so a host compiles
+// a source once and calls its functions any number of times without processes or .mla/.mlb files.
+namespace mathlang {
+
+class Program {
+public:
+    // argsCounts maps the full name of every function to its parameters count
+    Program(std::shared_ptr<const ::Program> program, const std::map<std::string, size_t> &argsCounts);
+
+    // Arguments in source order. The first call runs the top level once with printing off, unless the state came
+    // from a snapshot, calls then see the globals it set. Throws std::exception if there is no such function,
+    // the arguments count doesn't match or the call fails at runtime.
+    double call(const std::string &name, const std::vector<double> &args);
+    // State after the top level, a Program compiled from the same source can start from it without running it again
+    std::vector<uint8_t> saveSnapshot();
+    bool loadSnapshot(BytecodeView snapshot);
+    bool hasFunction(const std::string &name) const;
+    // The loaded bytecode, more VMs can share it to call the functions from other threads
+    std::shared_ptr<const ::Program> getProgram() const;
+
+private:
+    struct Function {
+        const ProgramFunction *function;
+        size_t argsCount;
+    };
+
+    void mStart();
+
+    std::shared_ptr<const ::Program> mProgram;
+    // One execution context, so calls of one Program must not overlap
+    std::unique_ptr<VM> mVM;
+    std::map<std::string, Function> mFunctions;
+    bool mIsStarted;
+};
+
+// Throws std::exception if the source doesn't compile, the errors are printed as the command line tools do
+Program compile(const std::string &source, bool isRegister = false, OptLevel optLevel = OptLevel::Exact);
+
+}
@@ -0,0 +1,261 @@
+#include "AsmLexer.hpp"
+#include <algorithm>
+#include <locale>
+#include <stdexcept>
+
+static std::string stringToLower(const std::string &str) {
+    std::string out(str.size(), '\0');
+    std::transform(str.begin(), str.end(), out.begin(), tolower);
+    return out;
+}
+
+static char stringToLower(char ch) {
+    return std::tolower(ch, std::locale());
+}
+
+static bool stringContainsSymbol(const std::string &str, char symbol, bool caseSensitive) {
+    std::string s1 = caseSensitive ? str : stringToLower(str);
+    char ch = caseSensitive ? symbol : stringToLower(symbol);
+    for (const auto &it : s1) {
+        if (it == ch) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::vector<std::string> stringSplit(const std::string &str, const std::string &separatorsList, bool saveSeparators) {
+    std::vector<std::string> tokens;
+    std::string token;
+    for (const auto &it : str) {
+        if (stringContainsSymbol(separatorsList, it, false)) {
+            tokens.push_back(token);
+            token.clear();
+            if (saveSeparators) {
+                token += it;
+                tokens.push_back(token);
+                token.clear();
+            }
+        }
+        else {
+            token += it;
+        }
+    }
+    if (!token.empty()) {
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+AsmPosition::AsmPosition() {
+    this->index = 0;
+    this->line = 1;
+    this->column = 0;
+}
+
+AsmToken::AsmToken() {
+}
+
+AsmToken::AsmToken(AsmTokenType type, const std::string &value) : value(value) {
+    this->type = type;
+}
+
+bool AsmToken::operator==(const AsmToken &rhs) const {
+    return this->type == rhs.type && this->value == rhs.value;
+}
+
+bool AsmToken::operator!=(const AsmToken &rhs) const {
+    return this->type != rhs.type || this->value != rhs.value;
+}
+
+AsmLexer::AsmLexer(const std::string &source) : mSource(source), mSourceLines(stringSplit(source, "\n", false)) {
+    mSourcePos = 0;
+    mLastChar = 0;
+}
+
+std::vector<AsmToken> AsmLexer::process() {
+    std::vector<AsmToken> tokens;
+    try {
+        mNextChar(true);
+        while (mLastChar != 0) {
+            AsmToken token;
+            if (mReadToken(token)) {
+                tokens.push_back(token);
+            }
+        }
+    }
+    catch (...) {}
+    return tokens;
+}
+
+void AsmLexer::mNextChar(bool skip) {
+    do {
+        if (mSourcePos < mSource.size()) {
+            mLastChar = mSource[mSourcePos];
+            mSourcePos++;
+
+            mPosition.index++;
+            mPosition.column++;
+            mPosition.src = mSourceLines[mPosition.line - 1];
+            if (mLastChar == '\n') {
+                mPosition.line++;
+                mPosition.column = 0;
+            }
+        }
+        else {
+            mLastChar = 0;
+            return;
+        }
+    } while (skip && std::isspace(mLastChar));
+}
+
+bool AsmLexer::mReadToken(AsmToken &token) {
+    token.pos = mPosition;
+    if (std::isalpha(mLastChar) || stringContainsSymbol("_@", mLastChar, false)) {
+        token.value += mLastChar;
+        mNextChar(false);
+        while (std::isalnum(mLastChar) || stringContainsSymbol("_@:.", mLastChar, false)) {
+            token.value += mLastChar;
+            mNextChar(false);
+        }
+
+        if (token.value == "jmp") {
+            token.type = AsmTokenType::Jmp;
+        }
+        else if (token.value == "call") {
+            token.type = AsmTokenType::Call;
+        }
+        else if (token.value == "ret") {
+            token.type = AsmTokenType::Ret;
+        }
+        else if (token.value == "add") {
+            token.type = AsmTokenType::Add;
+        }
+        else if (token.value == "sub") {
+            token.type = AsmTokenType::Sub;
+        }
+        else if (token.value == "mul") {
+            token.type = AsmTokenType::Mul;
+        }
+        else if (token.value == "div") {
+            token.type = AsmTokenType::Div;
+        }
+        else if (token.value == "push") {
+            token.type = AsmTokenType::Push;
+        }
+        else if (token.value == "pop") {
+            token.type = AsmTokenType::Pop;
+        }
+        else if (token.value == "set") {
+            token.type = AsmTokenType::Set;
+        }
+        else if (token.value == "get") {
+            token.type = AsmTokenType::Get;
+        }
+        else if (token.value == "unset") {
+            token.type = AsmTokenType::Unset;
+        }
+        else if (token.value == "enter") {
+            token.type = AsmTokenType::Enter;
+        }
+        else if (token.value == "loadlocal") {
+            token.type = AsmTokenType::LoadLocal;
+        }
+        else if (token.value == "storelocal") {
+            token.type = AsmTokenType::StoreLocal;
+        }
+        else if (token.value == "loadouter") {
+            token.type = AsmTokenType::LoadOuter;
+        }
+        else if (token.value == "engine") {
+            token.type = AsmTokenType::Engine;
+        }
+        else if (token.value == "loadk") {
+            token.type = AsmTokenType::LoadK;
+        }
+        else if (token.value == "mov") {
+            token.type = AsmTokenType::Mov;
+        }
+        else if (token.value == "print") {
+            token.type = AsmTokenType::Print;
+        }
+        else if (token.value == "tailcall") {
+            token.type = AsmTokenType::TailCall;
+        }
+        else if (token.value == "native") {
+            token.type = AsmTokenType::Native;
+        }
+        else if (token.value == "memo") {
+            token.type = AsmTokenType::Memo;
+        }
+        else if (token.value == "vec") {
+            token.type = AsmTokenType::Vec;
+        }
+        else if (token.value == "vdot") {
+            token.type = AsmTokenType::VecDot;
+        }
+        else if (token.value == "vsum") {
+            token.type = AsmTokenType::VecSum;
+        }
+        else if (token.value == "neg") {
+            token.type = AsmTokenType::Neg;
+        }
+        else if (token.value.find(":") != std::string::npos) {
+            token.type = AsmTokenType::Label;
+            token.value = token.value.substr(0, token.value.find(":"));
+        }
+        else {
+            token.type = AsmTokenType::Identifier;
+        }
+    }
+    else if (std::isdigit(mLastChar) || mLastChar == '-') {
+        // Constants folded by the compiler may be negative and are written with an exponent when %f would round them
+        token.value += mLastChar;
+        mNextChar(false);
+        bool isDotFound = false;
+        while (std::isdigit(mLastChar) || (!isDotFound && mLastChar == '.')) {
+            if (mLastChar == '.') {
+                isDotFound = true;
+            }
+            token.value += mLastChar;
+            mNextChar(false);
+        }
+        if (mLastChar == 'e') {
+            token.value += mLastChar;
+            mNextChar(false);
+            if (mLastChar == '-' || mLastChar == '+') {
+                token.value += mLastChar;
+                mNextChar(false);
+            }
+            while (std::isdigit(mLastChar)) {
+                token.value += mLastChar;
+                mNextChar(false);
+            }
+        }
+        if (!std::isdigit(token.value.back()) && token.value.back() != '.') {
+            mError("invalid number '" + token.value + "'");
+        }
+        token.type = AsmTokenType::Number;
+    }
+    else if (std::isspace(mLastChar) || mLastChar == ',') {
+        mNextChar(true);
+        return false;
+    }
+    else if (mLastChar == ';') {
+        while (mLastChar != 0 && mLastChar != '\n') {
+            mNextChar(false);
+        }
+        mNextChar(true);
+        return false;
+    }
+    else {
+        mError(std::string("unknown symbol '") + mLastChar + "'");
+        return false;
+    }
+    return true;
+}
+
+void AsmLexer::mError(const std::string &text) {
+    printf("LexerError(%d:%d): %s\n", mPosition.line, mPosition.column, text.data());
+    throw std::runtime_error("lexer error");
+}
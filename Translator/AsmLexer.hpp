@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+#include <vector>
+
+enum class AsmTokenType {
+    Jmp,
+    Call,
+    Ret,
+    Add,
+    Sub,
+    Mul,
+    Div,
+    Push,
+    Pop,
+    Set,
+    Get,
+    Unset,
+    Enter,
+    LoadLocal,
+    StoreLocal,
+    LoadOuter,
+    Engine,
+    LoadK,
+    Mov,
+    Print,
+    TailCall,
+    Native,
+    Memo,
+    Vec,
+    VecDot,
+    VecSum,
+    Neg,
+
+    Label,
+    Identifier,
+    Number
+};
+
+struct AsmPosition {
+    AsmPosition();
+
+    int index;
+    int line;
+    int column;
+    std::string src;
+};
+
+struct AsmToken {
+    AsmToken();
+    AsmToken(AsmTokenType type, const std::string &value);
+
+    bool operator==(const AsmToken &rhs) const;
+    bool operator!=(const AsmToken &rhs) const;
+
+    AsmTokenType type;
+    std::string value;
+    AsmPosition pos;
+};
+
+class AsmLexer {
+public:
+    AsmLexer(const std::string &source);
+
+    std::vector<AsmToken> process();
+
+private:
+    void mNextChar(bool skip);
+    bool mReadToken(AsmToken &token);
+    void mError(const std::string &text);
+
+    std::string mSource;
+    size_t mSourcePos;
+    char mLastChar;
+    AsmPosition mPosition;
+    std::vector<std::string> mSourceLines;
+};
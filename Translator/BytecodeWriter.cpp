@@ -0,0 +1,444 @@
+#include "BytecodeWriter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <stdexcept>
+
+static void getStackEffect(OpCode opCode, int32_t &pops, int32_t &pushes) {
+    pops = 0;
+    pushes = 0;
+    switch (opCode) {
+        case OpCode::Add:
+        case OpCode::Sub:
+        case OpCode::Mul:
+        case OpCode::Div:
+        case OpCode::VecDot: {
+            pops = 2;
+            pushes = 1;
+            break;
+        }
+        case OpCode::VecSum:
+        case OpCode::Neg: {
+            pops = 1;
+            pushes = 1;
+            break;
+        }
+        case OpCode::Push:
+        case OpCode::Get:
+        case OpCode::LoadLocal:
+        case OpCode::LoadOuter: {
+            pushes = 1;
+            break;
+        }
+        case OpCode::Pop:
+        case OpCode::Set:
+        case OpCode::Int:
+        case OpCode::StoreLocal: {
+            pops = 1;
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+TranslatedInstruction::TranslatedInstruction(OpCode opCode, LabelAddress offset, const AsmToken &token) : token(token) {
+    this->opCode = opCode;
+    this->offset = offset;
+}
+
+StackSummary::StackSummary() {
+    this->minDepth = 0;
+    this->maxDepth = 0;
+    this->netDepth = 0;
+    this->frameSlots = 0;
+    this->callDepth = 0;
+    this->isVisiting = false;
+    this->isDiverging = false;
+}
+
+BytecodeWriter::BytecodeWriter() {
+    mIsRegister = false;
+    mIsRecursive = false;
+    mMaxLocalDepth = 0;
+    mMaxFrameSlots = 0;
+}
+
+void BytecodeWriter::setRegister(bool isRegister) {
+    mIsRegister = isRegister;
+}
+
+bool BytecodeWriter::isRegister() const {
+    return mIsRegister;
+}
+
+LabelAddress BytecodeWriter::getAddress() const {
+    return static_cast<LabelAddress>(mCode.size());
+}
+
+void BytecodeWriter::addLabel(const std::string &name, const AsmToken &token) {
+    if (mLabels.count(name) != 0) {
+        error(token, "label '" + name + "' already exist");
+    }
+    mLabels[name] = getAddress();
+}
+
+void BytecodeWriter::addOpCode(OpCode opCode, const AsmToken &token) {
+    mInstructionIndices[getAddress()] = mInstructions.size();
+    mInstructions.push_back(TranslatedInstruction(opCode, getAddress(), token));
+    mCode.push_back(static_cast<uint8_t>(opCode));
+}
+
+void BytecodeWriter::addLabelArg(const std::string &name) {
+    mLabelUses.push_back({ name, mInstructions.size() - 1, mInstructions.back().args.size(), mCode.size() });
+    addArg(static_cast<LabelAddress>(0));
+}
+
+std::vector<uint8_t> BytecodeWriter::finish() {
+    for (const auto &use : mLabelUses) {
+        auto it = mLabels.find(use.name);
+        if (it == mLabels.end()) {
+            mInstructionError(mInstructions[use.instruction], "undefined label '" + use.name + "'");
+        }
+        mInstructions[use.instruction].args[use.arg] = it->second;
+        memcpy(mCode.data() + use.offset, &it->second, sizeof(LabelAddress));
+    }
+
+    BytecodeHeader header = mAnalyze();
+    std::vector<FunctionEntry> functions = mGetFunctions();
+    std::vector<uint8_t> symbols;
+    for (const auto &symbol : mSymbols) {
+        symbols.insert(symbols.end(), symbol.begin(), symbol.end());
+        symbols.push_back(0);
+    }
+
+    std::vector<SectionEntry> sections = {
+        { SectionType::Code, 0, static_cast<uint32_t>(mCode.size()) },
+        { SectionType::Constants, 0, static_cast<uint32_t>(mConstants.size()*sizeof(double)) },
+        { SectionType::Symbols, 0, static_cast<uint32_t>(symbols.size()) },
+        { SectionType::Functions, 0, static_cast<uint32_t>(functions.size()*sizeof(FunctionEntry)) }
+    };
+    const void *data[] = { mCode.data(), mConstants.data(), symbols.data(), functions.data() };
+    header.sectionsCount = static_cast<uint32_t>(sections.size());
+    uint32_t offset = static_cast<uint32_t>(sizeof(header) + sections.size()*sizeof(SectionEntry));
+    for (auto &section : sections) {
+        // Every section starts 8-byte aligned, a mapped file can then be read in place
+        offset = (offset + 7) & ~7u;
+        section.offset = offset;
+        offset += section.size;
+    }
+
+    std::vector<uint8_t> bc(offset, 0);
+    memcpy(bc.data(), &header, sizeof(header));
+    memcpy(bc.data() + sizeof(header), sections.data(), sections.size()*sizeof(SectionEntry));
+    for (size_t i = 0; i < sections.size(); i++) {
+        if (sections[i].size > 0) {
+            memcpy(bc.data() + sections[i].offset, data[i], sections[i].size);
+        }
+    }
+    return bc;
+}
+
+void BytecodeWriter::error(const AsmToken &token, const std::string &text) {
+    printf("TranslatorError(%d:%d): ", token.pos.line, token.pos.column);
+    printf("%s\n", text.data());
+    int tabsCount = 0;
+    for  (int i = 0; i < token.pos.column; i++) {
+        if (token.pos.src[i] == '\t') {
+            tabsCount++;
+        }
+    }
+    std::string newSrc;
+    for (const auto &ch : token.pos.src) {
+        if (ch == '\t') {
+            newSrc += "    ";
+        }
+        else {
+            newSrc += ch;
+        }
+    }
+    printf("%s\n", newSrc.data());
+    for (int i = 0; i < token.pos.column + tabsCount*3; i++) {
+        printf(" ");
+    }
+    printf("^\n");
+    throw std::runtime_error("translator error");
+}
+
+void BytecodeWriter::mInstructionError(const TranslatedInstruction &ins, const std::string &text) {
+    error(ins.token, text);
+}
+
+size_t BytecodeWriter::mGetInstructionIndex(const TranslatedInstruction &ins, LabelAddress address) {
+    auto it = mInstructionIndices.find(address);
+    if (it != mInstructionIndices.end()) {
+        return it->second;
+    }
+    if (address == mCode.size()) {
+        return mInstructions.size();
+    }
+    mInstructionError(ins, "address '" + std::to_string(address) + "' is not an instruction boundary");
+    return 0;
+}
+
+uint32_t BytecodeWriter::getConstant(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    auto it = mConstantIndices.find(bits);
+    if (it != mConstantIndices.end()) {
+        return it->second;
+    }
+    uint32_t index = static_cast<uint32_t>(mConstants.size());
+    mConstants.push_back(value);
+    mConstantIndices[bits] = index;
+    return index;
+}
+
+uint32_t BytecodeWriter::getSymbol(const std::string &name) {
+    auto it = mSymbolIndices.find(name);
+    if (it != mSymbolIndices.end()) {
+        return it->second;
+    }
+    uint32_t index = static_cast<uint32_t>(mSymbols.size());
+    mSymbols.push_back(name);
+    mSymbolIndices[name] = index;
+    return index;
+}
+
+const Builtin &BytecodeWriter::mGetBuiltin(const TranslatedInstruction &ins) {
+    return builtins[findBuiltin(mSymbols[ins.args[0]].data())];
+}
+
+std::vector<FunctionEntry> BytecodeWriter::mGetFunctions() {
+    // A function is a label that opens a frame or that some call targets
+    std::set<LabelAddress> callTargets;
+    for (const auto &ins : mInstructions) {
+        if (ins.opCode == OpCode::Call || ins.opCode == OpCode::RegCall || ins.opCode == OpCode::TailCall ||
+            ins.opCode == OpCode::RegTailCall) {
+            callTargets.insert(ins.args[0]);
+        }
+    }
+    std::vector<FunctionEntry> functions;
+    for (const auto &label : mLabels) {
+        auto it = mInstructionIndices.find(label.second);
+        bool isEnter = it != mInstructionIndices.end() && mInstructions[it->second].opCode == OpCode::Enter;
+        if (isEnter || callTargets.count(label.second) != 0) {
+            functions.push_back({ label.second, getSymbol(label.first) });
+        }
+    }
+    std::sort(functions.begin(), functions.end(), [](const FunctionEntry &a, const FunctionEntry &b) {
+        return a.address < b.address;
+    });
+    return functions;
+}
+
+BytecodeHeader BytecodeWriter::mAnalyze() {
+    BytecodeHeader header = {};
+    header.magic = BytecodeMagic;
+    header.version = BytecodeVersion;
+    // The top level starts at the first instruction
+    header.entry = 0;
+    if (mInstructions.empty()) {
+        return header;
+    }
+
+    std::map<uint32_t, uint32_t> scopeSizes;
+    for (const auto &ins : mInstructions) {
+        if (ins.opCode == OpCode::Enter) {
+            scopeSizes[ins.args[0]] = std::max(scopeSizes[ins.args[0]], ins.args[1]);
+        }
+    }
+    for (const auto &ins : mInstructions) {
+        size_t scopeArg = ins.opCode == OpCode::RegLoadOuter ? 1 : 0;
+        if ((ins.opCode == OpCode::LoadOuter || ins.opCode == OpCode::RegLoadOuter) &&
+            (scopeSizes.count(ins.args[scopeArg]) == 0 || ins.args[scopeArg + 1] >= scopeSizes[ins.args[scopeArg]])) {
+            mInstructionError(ins, "slot '" + std::to_string(ins.args[scopeArg + 1]) + "' is out of the frame of scope '" +
+                              std::to_string(ins.args[scopeArg]) + "'");
+        }
+    }
+
+    const StackSummary &root = mAnalyzeFunc(0);
+    uint32_t callDepth = root.callDepth;
+    uint32_t stackDepth = static_cast<uint32_t>(root.maxDepth);
+    uint32_t frameSlots = root.frameSlots;
+    // A host may call any function once the top level has finished, on top of what the top level leaves behind
+    for (const auto &function : mGetFunctions()) {
+        auto it = mInstructionIndices.find(function.address);
+        if (it == mInstructionIndices.end()) {
+            continue;
+        }
+        const StackSummary &summary = mAnalyzeFunc(it->second);
+        callDepth = std::max(callDepth, summary.callDepth + 1);
+        stackDepth = std::max(stackDepth, static_cast<uint32_t>(root.netDepth - summary.minDepth + summary.maxDepth));
+        frameSlots = std::max(frameSlots, scopeSizes[0] + summary.frameSlots);
+    }
+
+    if (mIsRegister) {
+        header.flags |= static_cast<uint16_t>(BytecodeFlags::Register);
+    }
+
+    // A recursive program has no static bound, every activation gets the worst case of a single function. Large
+    // functions get fewer levels, so that the capacities stay within what the VM accepts.
+    if (mIsRecursive) {
+        header.flags |= static_cast<uint16_t>(BytecodeFlags::Recursive);
+        uint32_t levelsCount = std::min(MaxStackDepth / std::max<uint32_t>(mMaxLocalDepth, 1),
+                                        MaxFrameSlots / std::max<uint32_t>(mMaxFrameSlots, 1));
+        header.callDepth = std::min(DefaultMaxCallDepth, levelsCount - 1);
+        header.stackDepth = (header.callDepth + 1)*static_cast<uint32_t>(mMaxLocalDepth);
+        header.frameSlots = (header.callDepth + 1)*mMaxFrameSlots;
+    }
+    else {
+        header.callDepth = callDepth;
+        header.stackDepth = stackDepth;
+        header.frameSlots = frameSlots;
+    }
+    return header;
+}
+
+const StackSummary &BytecodeWriter::mAnalyzeFunc(size_t entry) {
+    StackSummary &summary = mSummaries[entry];
+    summary.isVisiting = true;
+
+    int32_t depth = 0;
+    uint32_t frameSlots = 0;
+    std::vector<bool> isVisited(mInstructions.size(), false);
+    size_t i = entry;
+    while (i < mInstructions.size()) {
+        if (isVisited[i]) {
+            summary.isDiverging = true;
+            break;
+        }
+        isVisited[i] = true;
+
+        const auto &ins = mInstructions[i];
+        if (ins.opCode == OpCode::Jmp) {
+            i = mGetInstructionIndex(ins, ins.args[0]);
+            continue;
+        }
+        else if (ins.opCode == OpCode::Call || ins.opCode == OpCode::RegCall || ins.opCode == OpCode::TailCall ||
+                 ins.opCode == OpCode::RegTailCall) {
+            bool isTailCall = ins.opCode == OpCode::TailCall || ins.opCode == OpCode::RegTailCall;
+            if (ins.opCode == OpCode::RegCall && (ins.args[1] >= frameSlots || ins.args[2] > frameSlots)) {
+                mInstructionError(ins, "register is out of the frame");
+            }
+            if (ins.opCode == OpCode::RegTailCall && ins.args[1] + ins.args[2] > frameSlots) {
+                mInstructionError(ins, "arguments of the tail call are out of the frame");
+            }
+            if (isTailCall && entry == 0) {
+                mInstructionError(ins, "tail call outside of function");
+            }
+            // A register call puts the callee frame over the argument registers, a stack call above the whole frame.
+            // A tail call reuses the current frame, counting it as a call keeps the bounds safe.
+            uint32_t calleeBase = ins.opCode == OpCode::RegCall ? ins.args[2] : frameSlots;
+            size_t callee = mGetInstructionIndex(ins, ins.args[0]);
+            auto it = mSummaries.find(callee);
+            if (it != mSummaries.end() && it->second.isVisiting) {
+                // Without conditional jumps a recursive call never returns
+                mIsRecursive = true;
+                summary.isDiverging = true;
+                break;
+            }
+            const StackSummary &calleeSummary = it != mSummaries.end() ? it->second : mAnalyzeFunc(callee);
+            summary.minDepth = std::min(summary.minDepth, depth + calleeSummary.minDepth);
+            if (entry == 0 && summary.minDepth < 0) {
+                mInstructionError(ins, "operand stack underflow");
+            }
+            summary.maxDepth = std::max(summary.maxDepth, depth + calleeSummary.maxDepth);
+            summary.frameSlots = std::max(summary.frameSlots, calleeBase + calleeSummary.frameSlots);
+            summary.callDepth = std::max(summary.callDepth, calleeSummary.callDepth + 1);
+            if (calleeSummary.isDiverging) {
+                summary.isDiverging = true;
+                break;
+            }
+            depth += calleeSummary.netDepth;
+            if (isTailCall) {
+                break;
+            }
+        }
+        else if (ins.opCode == OpCode::Ret) {
+            break;
+        }
+        else if (ins.opCode == OpCode::RegNative) {
+            if (ins.args[1] >= frameSlots || ins.args[2] + mGetBuiltin(ins).argsCount > frameSlots) {
+                mInstructionError(ins, "register is out of the frame");
+            }
+        }
+        else if (ins.opCode == OpCode::RegVec) {
+            if (ins.args[0] >= frameSlots || ins.args[1] + ins.args[2] > frameSlots) {
+                mInstructionError(ins, "register is out of the frame");
+            }
+        }
+        else if (ins.opCode == OpCode::Native || ins.opCode == OpCode::Vec) {
+            // Replaces its arguments with the result
+            int32_t pops = static_cast<int32_t>(ins.opCode == OpCode::Vec ? ins.args[0] : mGetBuiltin(ins).argsCount);
+            summary.minDepth = std::min(summary.minDepth, depth - pops);
+            if (entry == 0 && summary.minDepth < 0) {
+                mInstructionError(ins, "operand stack underflow");
+            }
+            depth += 1 - pops;
+            summary.maxDepth = std::max(summary.maxDepth, depth);
+            mMaxLocalDepth = std::max(mMaxLocalDepth, depth);
+        }
+        else if (ins.opCode == OpCode::Memo) {
+            if (entry == 0) {
+                mInstructionError(ins, "memo outside of function");
+            }
+            if (ins.args[0] > frameSlots) {
+                mInstructionError(ins, "arguments of the memo are out of the frame");
+            }
+            // A remembered result is pushed before the function returns
+            if (!mIsRegister) {
+                summary.maxDepth = std::max(summary.maxDepth, depth + 1);
+                mMaxLocalDepth = std::max(mMaxLocalDepth, depth + 1);
+            }
+        }
+        else if (ins.opCode == OpCode::RegRet) {
+            if (ins.args[0] >= frameSlots) {
+                mInstructionError(ins, "register 'r" + std::to_string(ins.args[0]) + "' is out of the frame");
+            }
+            break;
+        }
+        else if (ins.opCode == OpCode::Enter) {
+            frameSlots = ins.args[1];
+            summary.frameSlots = std::max(summary.frameSlots, frameSlots);
+            mMaxFrameSlots = std::max(mMaxFrameSlots, frameSlots);
+        }
+        else {
+            if ((ins.opCode == OpCode::LoadLocal || ins.opCode == OpCode::StoreLocal) && ins.args[0] >= frameSlots) {
+                mInstructionError(ins, "slot '" + std::to_string(ins.args[0]) + "' is out of the frame");
+            }
+            size_t registersCount = 0;
+            if (ins.opCode == OpCode::RegAdd || ins.opCode == OpCode::RegSub || ins.opCode == OpCode::RegMul || ins.opCode == OpCode::RegDiv ||
+                ins.opCode == OpCode::RegVecDot) {
+                registersCount = 3;
+            }
+            else if (ins.opCode == OpCode::RegMove || ins.opCode == OpCode::RegVecSum || ins.opCode == OpCode::RegNeg) {
+                registersCount = 2;
+            }
+            else if (ins.opCode == OpCode::RegLoadK || ins.opCode == OpCode::RegLoadOuter || ins.opCode == OpCode::RegPrint) {
+                registersCount = 1;
+            }
+            for (size_t j = 0; j < registersCount; j++) {
+                if (ins.args[j] >= frameSlots) {
+                    mInstructionError(ins, "register 'r" + std::to_string(ins.args[j]) + "' is out of the frame");
+                }
+            }
+            int32_t pops, pushes;
+            getStackEffect(ins.opCode, pops, pushes);
+            summary.minDepth = std::min(summary.minDepth, depth - pops);
+            // Only the top level starts with an empty stack, functions may pop their arguments
+            if (entry == 0 && summary.minDepth < 0) {
+                mInstructionError(ins, "operand stack underflow");
+            }
+            depth += pushes - pops;
+            summary.maxDepth = std::max(summary.maxDepth, depth);
+            mMaxLocalDepth = std::max(mMaxLocalDepth, depth);
+        }
+        i++;
+    }
+
+    summary.netDepth = depth;
+    summary.isVisiting = false;
+    return summary;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include "AsmLexer.hpp"
+#include "../Bytecode.hpp"
+#include "../Builtins.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <type_traits>
+
+struct TranslatedInstruction {
+    TranslatedInstruction(OpCode opCode, LabelAddress offset, const AsmToken &token);
+
+    OpCode opCode;
+    LabelAddress offset;
+    std::vector<uint32_t> args;
+    AsmToken token;
+};
+
+// Operand stack and frame usage of a function, relative to its entry
+struct StackSummary {
+    StackSummary();
+
+    int32_t minDepth;
+    int32_t maxDepth;
+    int32_t netDepth;
+    uint32_t frameSlots;
+    uint32_t callDepth;
+    bool isVisiting;
+    bool isDiverging;
+};
+
+// Assembles instructions into a .mlb image, shared by the Translator and the Compiler. Labels may be used before
+// they are defined, their addresses are patched in by finish(), which then runs the max-depth analysis and lays out
+// the sections. Errors are printed at the token of the instruction and thrown as std::exception.
+class BytecodeWriter {
+public:
+    BytecodeWriter();
+
+    void setRegister(bool isRegister);
+    bool isRegister() const;
+    LabelAddress getAddress() const;
+    void addLabel(const std::string &name, const AsmToken &token);
+    void addOpCode(OpCode opCode, const AsmToken &token);
+    template <typename T>
+    void addArg(T value);
+    // Address of the label as a LabelAddress argument
+    void addLabelArg(const std::string &name);
+    uint32_t getConstant(double value);
+    uint32_t getSymbol(const std::string &name);
+    std::vector<uint8_t> finish();
+
+    static void error(const AsmToken &token, const std::string &text);
+
+private:
+    struct LabelUse {
+        std::string name;
+        size_t instruction;
+        size_t arg;
+        size_t offset;
+    };
+
+    void mInstructionError(const TranslatedInstruction &ins, const std::string &text);
+    size_t mGetInstructionIndex(const TranslatedInstruction &ins, LabelAddress address);
+    const Builtin &mGetBuiltin(const TranslatedInstruction &ins);
+    std::vector<FunctionEntry> mGetFunctions();
+    BytecodeHeader mAnalyze();
+    const StackSummary &mAnalyzeFunc(size_t entry);
+
+    std::vector<uint8_t> mCode;
+    std::map<std::string, LabelAddress> mLabels;
+    std::vector<LabelUse> mLabelUses;
+    std::vector<TranslatedInstruction> mInstructions;
+    std::map<LabelAddress, size_t> mInstructionIndices;
+    std::map<size_t, StackSummary> mSummaries;
+    // Pools are keyed by the bits of a constant so that 0.0 and -0.0 stay distinct
+    std::vector<double> mConstants;
+    std::map<uint64_t, uint32_t> mConstantIndices;
+    std::vector<std::string> mSymbols;
+    std::map<std::string, uint32_t> mSymbolIndices;
+    bool mIsRegister;
+    bool mIsRecursive;
+    int32_t mMaxLocalDepth;
+    uint32_t mMaxFrameSlots;
+};
+
+template <typename T>
+void BytecodeWriter::addArg(T value) {
+    static_assert(std::is_integral_v<T> && sizeof(T) <= sizeof(uint32_t), "arguments are integers of up to 32 bits");
+    mInstructions.back().args.push_back(value);
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(&value);
+    mCode.insert(mCode.end(), p, p + sizeof(value));
+}
@@ -1,47 +1,24 @@
 #include "Translator.hpp"
 
-Translator::Translator(const std::vector<Token> &tokens) : mTokens(tokens) {
+Translator::Translator(const std::vector<AsmToken> &tokens) : mTokens(tokens) {
     mTokensPos = 0;
 }
 
 std::vector<uint8_t> Translator::process() {
     std::vector<uint8_t> bc;
     try {
-        mTranslate(bc, false);
-
-        mTokensPos = 0;
-        mTranslate(bc, true);
+        mTranslate();
+        bc = mWriter.finish();
     }
     catch (...) {
+        bc.clear();
     }
 
     return bc;
 }
 
 void Translator::mError(const std::string &text) {
-    printf("TranslatorError(%d:%d): ", mLastToken.pos.line, mLastToken.pos.column);
-    printf("%s\n", text.data());
-    int tabsCount = 0;
-    for  (int i = 0; i < mLastToken.pos.column; i++) {
-        if (mLastToken.pos.src[i] == '\t') {
-            tabsCount++;
-        }
-    }
-    std::string newSrc;
-    for (const auto &ch : mLastToken.pos.src) {
-        if (ch == '\t') {
-            newSrc += "    ";
-        }
-        else {
-            newSrc += ch;
-        }
-    }
-    printf("%s\n", newSrc.data());
-    for (int i = 0; i < mLastToken.pos.column + tabsCount*3; i++) {
-        printf(" ");
-    }
-    printf("^\n");
-    throw std::exception("translator error");
+    BytecodeWriter::error(mLastToken, text);
 }
 
 void Translator::mNextToken() {
@@ -55,117 +32,293 @@ void Translator::mNextToken() {
     }
 }
 
-void Translator::mCheck(TokenType type, const std::string &expected) {
+void Translator::mCheck(AsmTokenType type, const std::string &expected) {
     if (mCurToken.type != type) {
         mError("expected '" + expected + "' instead '" + mCurToken.value + "'");
     }
 }
 
-void Translator::mTranslate(std::vector<uint8_t> &bc, bool genBytecode) {
-    uint32_t pos = 0;
+uint16_t Translator::mGetIndex(const std::string &expected) {
+    mNextToken();
+    mCheck(AsmTokenType::Number, expected);
+    if (mCurToken.value.find_first_not_of("0123456789") != std::string::npos || std::stoul(mCurToken.value) > UINT16_MAX) {
+        mError("invalid " + expected + " '" + mCurToken.value + "'");
+    }
+    return static_cast<uint16_t>(std::stoul(mCurToken.value));
+}
+
+SlotIndex Translator::mGetRegister() {
+    mNextToken();
+    mCheck(AsmTokenType::Identifier, "register");
+    const std::string &value = mCurToken.value;
+    if (value.size() < 2 || value.size() > 6 || value[0] != 'r' ||
+        value.find_first_not_of("0123456789", 1) != std::string::npos || std::stoul(value.substr(1)) > UINT16_MAX) {
+        mError("invalid register '" + value + "'");
+    }
+    return static_cast<SlotIndex>(std::stoul(value.substr(1)));
+}
 
+void Translator::mTranslate() {
+    // Labels may be used before they are defined, the writer patches their addresses once the code is complete
     auto add = [&](auto data) {
-        if (genBytecode) {
-            uint8_t *p = reinterpret_cast<uint8_t*>(&data);
-            for (int i = 0; i < sizeof(data); i++) {
-                bc.push_back(p[i]);
-            }
+        if constexpr (std::is_same_v<decltype(data), OpCode>) {
+            mWriter.addOpCode(data, mCurToken);
         }
         else {
-            pos += sizeof(data);
+            mWriter.addArg(data);
         }
     };
 
-    auto getLabelAddress = [&](const std::string &name) {
-        if (genBytecode) {
-            auto it = mLabels.find(name);
-            if (it == mLabels.end()) {
-                mError("undefined label '" + name + "'");
+    while (mTokensPos < mTokens.size()) {
+        mNextToken();
+        if (mCurToken.type == AsmTokenType::Engine) {
+            mNextToken();
+            mCheck(AsmTokenType::Identifier, "engine name");
+            if (mWriter.getAddress() != 0) {
+                mError("engine must be selected before the first instruction");
+            }
+            if (mCurToken.value == "register") {
+                mWriter.setRegister(true);
+            }
+            else if (mCurToken.value == "stack") {
+                mWriter.setRegister(false);
+            }
+            else {
+                mError("unknown engine '" + mCurToken.value + "'");
             }
-            return it->second;
         }
-        else {
-            return static_cast<LabelAddress>(0);
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::Call) {
+            SlotIndex dest = mGetRegister();
+            mNextToken();
+            mCheck(AsmTokenType::Identifier, "label name");
+            std::string label = mCurToken.value;
+            SlotIndex base = mGetRegister();
+            add(OpCode::RegCall);
+            mWriter.addLabelArg(label);
+            add(dest);
+            add(base);
         }
-    };
-
-    while (mTokensPos < mTokens.size()) {
-        mNextToken();
-        if (mCurToken.type == TokenType::Jmp) {
-            add(OpCode::Jmp);
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::TailCall) {
             mNextToken();
-            mCheck(TokenType::Identifier, "label name");
-            add(getLabelAddress(mCurToken.value));
+            mCheck(AsmTokenType::Identifier, "label name");
+            std::string label = mCurToken.value;
+            SlotIndex base = mGetRegister();
+            add(OpCode::RegTailCall);
+            mWriter.addLabelArg(label);
+            add(base);
+            add(static_cast<SlotIndex>(mGetIndex("arguments count")));
+        }
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::Native) {
+            SlotIndex dest = mGetRegister();
+            uint32_t symbol = mGetBuiltinSymbol();
+            SlotIndex base = mGetRegister();
+            add(OpCode::RegNative);
+            add(symbol);
+            add(dest);
+            add(base);
+        }
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::Ret) {
+            add(OpCode::RegRet);
+            add(mGetRegister());
+        }
+        else if (mWriter.isRegister() && (mCurToken.type == AsmTokenType::Add || mCurToken.type == AsmTokenType::Sub ||
+                                 mCurToken.type == AsmTokenType::Mul || mCurToken.type == AsmTokenType::Div)) {
+            if (mCurToken.type == AsmTokenType::Add) {
+                add(OpCode::RegAdd);
+            }
+            else if (mCurToken.type == AsmTokenType::Sub) {
+                add(OpCode::RegSub);
+            }
+            else if (mCurToken.type == AsmTokenType::Mul) {
+                add(OpCode::RegMul);
+            }
+            else {
+                add(OpCode::RegDiv);
+            }
+            add(mGetRegister());
+            add(mGetRegister());
+            add(mGetRegister());
         }
-        else if (mCurToken.type == TokenType::Call) {
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::LoadK) {
+            add(OpCode::RegLoadK);
+            add(mGetRegister());
             mNextToken();
-            mCheck(TokenType::Identifier, "label name");
-            if (mLabels.count(mCurToken.value) != 0) {
-                add(OpCode::Call);
-                add(getLabelAddress(mCurToken.value));
+            mCheck(AsmTokenType::Number, "number");
+            add(mWriter.getConstant(std::stod(mCurToken.value)));
+        }
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::Mov) {
+            add(OpCode::RegMove);
+            add(mGetRegister());
+            add(mGetRegister());
+        }
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::LoadOuter) {
+            add(OpCode::RegLoadOuter);
+            add(mGetRegister());
+            add(static_cast<ScopeIndex>(mGetIndex("scope index")));
+            add(static_cast<SlotIndex>(mGetIndex("slot index")));
+        }
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::Print) {
+            add(OpCode::RegPrint);
+            add(mGetRegister());
+        }
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::Vec) {
+            add(OpCode::RegVec);
+            add(mGetRegister());
+            add(mGetRegister());
+            uint16_t count = mGetIndex("elements count");
+            if (count == 0) {
+                mError("vec of no elements");
             }
-            else if (mCurToken.value == "print") {
+            add(static_cast<SlotIndex>(count));
+        }
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::VecDot) {
+            add(OpCode::RegVecDot);
+            add(mGetRegister());
+            add(mGetRegister());
+            add(mGetRegister());
+        }
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::VecSum) {
+            add(OpCode::RegVecSum);
+            add(mGetRegister());
+            add(mGetRegister());
+        }
+        else if (mWriter.isRegister() && mCurToken.type == AsmTokenType::Neg) {
+            add(OpCode::RegNeg);
+            add(mGetRegister());
+            add(mGetRegister());
+        }
+        else if (mWriter.isRegister() && mCurToken.type != AsmTokenType::Jmp && mCurToken.type != AsmTokenType::Enter && mCurToken.type != AsmTokenType::Label &&
+                 mCurToken.type != AsmTokenType::Memo) {
+            mError("instruction '" + mCurToken.value + "' is not available in the register engine");
+        }
+        else if (mCurToken.type == AsmTokenType::Jmp) {
+            add(OpCode::Jmp);
+            mNextToken();
+            mCheck(AsmTokenType::Identifier, "label name");
+            mWriter.addLabelArg(mCurToken.value);
+        }
+        else if (mCurToken.type == AsmTokenType::Call) {
+            mNextToken();
+            if (mCurToken.type == AsmTokenType::Print) {
                 add(OpCode::Int);
                 add(static_cast<uint8_t>(0));
             }
+            else {
+                mCheck(AsmTokenType::Identifier, "label name");
+                add(OpCode::Call);
+                mWriter.addLabelArg(mCurToken.value);
+            }
         }
-        else if (mCurToken.type == TokenType::Ret) {
+        else if (mCurToken.type == AsmTokenType::TailCall) {
+            mNextToken();
+            mCheck(AsmTokenType::Identifier, "label name");
+            add(OpCode::TailCall);
+            mWriter.addLabelArg(mCurToken.value);
+        }
+        else if (mCurToken.type == AsmTokenType::Native) {
+            uint32_t symbol = mGetBuiltinSymbol();
+            add(OpCode::Native);
+            add(symbol);
+        }
+        else if (mCurToken.type == AsmTokenType::Ret) {
             add(OpCode::Ret);
         }
-        else if (mCurToken.type == TokenType::Add) {
+        else if (mCurToken.type == AsmTokenType::Add) {
             add(OpCode::Add);
         }
-        else if (mCurToken.type == TokenType::Sub) {
+        else if (mCurToken.type == AsmTokenType::Sub) {
             add(OpCode::Sub);
         }
-        else if (mCurToken.type == TokenType::Mul) {
+        else if (mCurToken.type == AsmTokenType::Mul) {
             add(OpCode::Mul);
         }
-        else if (mCurToken.type == TokenType::Div) {
+        else if (mCurToken.type == AsmTokenType::Div) {
             add(OpCode::Div);
         }
-        else if (mCurToken.type ==  TokenType::Push) {
+        else if (mCurToken.type ==  AsmTokenType::Push) {
             add(OpCode::Push);
             mNextToken();
-            mCheck(TokenType::Number, "number");
-            add(std::stod(mCurToken.value));
+            mCheck(AsmTokenType::Number, "number");
+            add(mWriter.getConstant(std::stod(mCurToken.value)));
         }
-        else if (mCurToken.type == TokenType::Pop) {
+        else if (mCurToken.type == AsmTokenType::Pop) {
             add(OpCode::Pop);
         }
-        else if (mCurToken.type == TokenType::Set) {
+        else if (mCurToken.type == AsmTokenType::Set) {
             add(OpCode::Set);
             mNextToken();
-            mCheck(TokenType::Identifier, "variable name");
-            uint64_t hash = std::hash<std::string>()(mCurToken.value);
-            add(hash);
+            mCheck(AsmTokenType::Identifier, "variable name");
+            add(mWriter.getSymbol(mCurToken.value));
         }
-        else if (mCurToken.type == TokenType::Get) {
+        else if (mCurToken.type == AsmTokenType::Get) {
             add(OpCode::Get);
             mNextToken();
-            mCheck(TokenType::Identifier, "variable name");
-            uint64_t hash = std::hash<std::string>()(mCurToken.value);
-            add(hash);
+            mCheck(AsmTokenType::Identifier, "variable name");
+            add(mWriter.getSymbol(mCurToken.value));
         }
-        else if (mCurToken.type == TokenType::Unset) {
+        else if (mCurToken.type == AsmTokenType::Unset) {
             add(OpCode::Unset);
             mNextToken();
-            mCheck(TokenType::Identifier, "variable name");
-            uint64_t hash = std::hash<std::string>()(mCurToken.value);
-            add(hash);
-        }
-        else if (mCurToken.type == TokenType::Label) {
-            if (!genBytecode) {
-                if (mLabels.count(mCurToken.value) == 0) {
-                    mLabels[mCurToken.value] = pos;
-                }
-                else {
-                    mError("label '" + mCurToken.value + "' already exist");
-                }
+            mCheck(AsmTokenType::Identifier, "variable name");
+            add(mWriter.getSymbol(mCurToken.value));
+        }
+        else if (mCurToken.type == AsmTokenType::Enter) {
+            add(OpCode::Enter);
+            add(static_cast<ScopeIndex>(mGetIndex("scope index")));
+            add(static_cast<SlotIndex>(mGetIndex("frame size")));
+        }
+        else if (mCurToken.type == AsmTokenType::Memo) {
+            add(OpCode::Memo);
+            uint16_t argsCount = mGetIndex("arguments count");
+            if (argsCount > MaxMemoArgsCount) {
+                mError("memo of more than " + std::to_string(MaxMemoArgsCount) + " arguments");
+            }
+            add(static_cast<SlotIndex>(argsCount));
+        }
+        else if (mCurToken.type == AsmTokenType::Vec) {
+            add(OpCode::Vec);
+            uint16_t count = mGetIndex("elements count");
+            if (count == 0) {
+                mError("vec of no elements");
             }
+            add(static_cast<SlotIndex>(count));
+        }
+        else if (mCurToken.type == AsmTokenType::VecDot) {
+            add(OpCode::VecDot);
+        }
+        else if (mCurToken.type == AsmTokenType::VecSum) {
+            add(OpCode::VecSum);
+        }
+        else if (mCurToken.type == AsmTokenType::Neg) {
+            add(OpCode::Neg);
+        }
+        else if (mCurToken.type == AsmTokenType::LoadLocal) {
+            add(OpCode::LoadLocal);
+            add(static_cast<SlotIndex>(mGetIndex("slot index")));
+        }
+        else if (mCurToken.type == AsmTokenType::StoreLocal) {
+            add(OpCode::StoreLocal);
+            add(static_cast<SlotIndex>(mGetIndex("slot index")));
+        }
+        else if (mCurToken.type == AsmTokenType::LoadOuter) {
+            add(OpCode::LoadOuter);
+            add(static_cast<ScopeIndex>(mGetIndex("scope index")));
+            add(static_cast<SlotIndex>(mGetIndex("slot index")));
+        }
+        else if (mCurToken.type == AsmTokenType::Label) {
+            mWriter.addLabel(mCurToken.value, mCurToken);
         }
         else {
             mError("unknown instruction '" + mCurToken.value + "'");
         }
     }
 }
+
+uint32_t Translator::mGetBuiltinSymbol() {
+    mNextToken();
+    mCheck(AsmTokenType::Identifier, "builtin name");
+    if (findBuiltin(mCurToken.value.data()) == BuiltinsCount) {
+        mError("unknown builtin '" + mCurToken.value + "'");
+    }
+    return mWriter.getSymbol(mCurToken.value);
+}
\ No newline at end of file
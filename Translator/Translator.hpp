@@ -1,25 +1,29 @@
 #pragma once
-#include "Lexer.hpp"
-#include "../Bytecode.hpp"
+#include "AsmLexer.hpp"
+#include "BytecodeWriter.hpp"
 #include <string>
 #include <vector>
 #include <map>
 
+// Parses the assembly text, BytecodeWriter does the encoding and the analysis
 class Translator {
 public:
-    Translator(const std::vector<Token> &tokens);
+    Translator(const std::vector<AsmToken> &tokens);
 
     std::vector<uint8_t> process();
 
 private:
     void mError(const std::string &text);
     void mNextToken();
-    void mCheck(TokenType type, const std::string &expected);
-    void mTranslate(std::vector<uint8_t> &bc, bool genBytecode);
+    void mCheck(AsmTokenType type, const std::string &expected);
+    uint16_t mGetIndex(const std::string &expected);
+    SlotIndex mGetRegister();
+    void mTranslate();
+    uint32_t mGetBuiltinSymbol();
 
-    std::vector<Token> mTokens;
+    std::vector<AsmToken> mTokens;
     size_t mTokensPos;
-    Token mLastToken;
-    Token mCurToken;
-    std::map<std::string, LabelAddress> mLabels;
+    AsmToken mLastToken;
+    AsmToken mCurToken;
+    BytecodeWriter mWriter;
 };
\ No newline at end of file
@@ -1,4 +1,4 @@
-#include "Lexer.hpp"
+#include "AsmLexer.hpp"
 #include "Translator.hpp"
 #include <filesystem>
 #include <cstdio>
@@ -43,8 +43,8 @@ int main(int argc, char **argv) {
         )";
     }
 
-    auto lexer = Lexer(source);
-    std::vector<Token> tokens = lexer.process();
+    auto lexer = AsmLexer(source);
+    std::vector<AsmToken> tokens = lexer.process();
     for (const auto &token : tokens) {
         printf("[%d: '%s']\n", token.type, token.value.data());
     }
@@ -0,0 +1,312 @@
+#include "VM.hpp"
+#include <algorithm>
+
+// Batch mode runs the same instructions as the scalar engines with every value widened to Lanes.
+// Without conditional jumps all rows take the same path, so a whole block of rows shares one dispatch.
+
+bool VM::runBatch(uint32_t address, const std::vector<const double*> &columns, size_t rows, double *results) {
+    try {
+        const auto &offsets = mProgram->getOffsets();
+        auto it = std::lower_bound(offsets.begin(), offsets.end(), address);
+        if (it == offsets.end() || *it != address || mCode[it - offsets.begin()].opCode != OpCode::Enter) {
+            mError("no function at address '" + std::to_string(address) + "'", address);
+        }
+        uint32_t entry = static_cast<uint32_t>(it - offsets.begin());
+        bool isRegister = (mHeader.flags & static_cast<uint16_t>(BytecodeFlags::Register)) != 0;
+
+        for (size_t row = 0; row < rows; row += LaneWidth) {
+            size_t count = std::min(LaneWidth, rows - row);
+            mBatchStack.clear();
+            // Arguments go where the caller would have put them: on the operand stack or in the first registers
+            if (isRegister) {
+                if (mBatchFrames.size() < columns.size()) {
+                    mBatchFrames.resize(columns.size());
+                }
+                for (size_t i = 0; i < columns.size(); i++) {
+                    mBatchFrames[i] = lanesLoadPartial(columns[i] + row, count);
+                }
+            }
+            else {
+                for (const double *column : columns) {
+                    mBatchStack.push_back(lanesLoadPartial(column + row, count));
+                }
+            }
+            mRunBatch(entry);
+            if (mBatchStack.empty()) {
+                mError("function returned no value");
+            }
+            lanesStorePartial(results + row, count, mBatchStack.back());
+        }
+    }
+    catch (...) {
+        return false;
+    }
+    return true;
+}
+
+void VM::mRunBatch(uint32_t entry) {
+    mFrameBase = 0;
+    mFrameTop = 0;
+    std::fill(mScopeFrames.begin(), mScopeFrames.end(), UINT32_MAX);
+    mBatchCalls.clear();
+    mBatchCalls.push_back({ UINT32_MAX, 0, 0, 0, 0, 0 });
+
+    mIP = entry;
+    while (true) {
+        const auto &ins = mCode[mIP++];
+        Lanes *regs = mBatchFrames.data() + mFrameBase;
+        switch (ins.opCode) {
+            case OpCode::Jmp: {
+                mIP = ins.address;
+                break;
+            }
+            case OpCode::Call:
+            case OpCode::RegCall: {
+                if (mBatchCalls.size() > DefaultMaxCallDepth) {
+                    mError("call stack overflow");
+                }
+                mBatchCalls.push_back({ mIP, mFrameBase, mFrameTop, 0, mScopeFrames[0], ins.regs[0] });
+                if (ins.opCode == OpCode::RegCall) {
+                    mFrameTop = mFrameBase + ins.regs[1];
+                }
+                mIP = ins.address;
+                break;
+            }
+            case OpCode::TailCall:
+            case OpCode::RegTailCall: {
+                auto &frame = mBatchCalls.back();
+                if (ins.opCode == OpCode::RegTailCall) {
+                    std::copy(regs + ins.regs[0], regs + ins.regs[0] + ins.regs[1], regs);
+                    mFrameTop = mFrameBase;
+                }
+                else {
+                    mFrameBase = frame.frameBase;
+                    mFrameTop = frame.frameTop;
+                }
+                mScopeFrames[frame.scope] = frame.scopeFrame;
+                frame.scope = 0;
+                frame.scopeFrame = mScopeFrames[0];
+                mIP = ins.address;
+                break;
+            }
+            case OpCode::Ret:
+            case OpCode::RegRet: {
+                Lanes value = ins.opCode == OpCode::RegRet ? regs[ins.regs[0]] : Lanes();
+                CallFrame frame = mBatchCalls.back();
+                mBatchCalls.pop_back();
+                mFrameBase = frame.frameBase;
+                mFrameTop = frame.frameTop;
+                mScopeFrames[frame.scope] = frame.scopeFrame;
+                if (mBatchCalls.empty()) {
+                    if (ins.opCode == OpCode::RegRet) {
+                        mBatchStack.push_back(value);
+                    }
+                    return;
+                }
+                if (ins.opCode == OpCode::RegRet) {
+                    mBatchFrames[mFrameBase + frame.retSlot] = value;
+                }
+                mIP = frame.retIP;
+                break;
+            }
+            case OpCode::Enter: {
+                auto &frame = mBatchCalls.back();
+                frame.scope = ins.scope;
+                frame.scopeFrame = mScopeFrames[ins.scope];
+                mFrameBase = mFrameTop;
+                mFrameTop += ins.size;
+                if (mBatchFrames.size() < mFrameTop) {
+                    mBatchFrames.resize(mFrameTop);
+                }
+                mScopeFrames[ins.scope] = mFrameBase;
+                break;
+            }
+            case OpCode::Add: {
+                Lanes arg1 = mBatchPop();
+                Lanes arg2 = mBatchPop();
+                mBatchStack.push_back(lanesAdd(arg1, arg2));
+                break;
+            }
+            case OpCode::Sub: {
+                Lanes arg1 = mBatchPop();
+                Lanes arg2 = mBatchPop();
+                mBatchStack.push_back(lanesSub(arg1, arg2));
+                break;
+            }
+            case OpCode::Mul: {
+                Lanes arg1 = mBatchPop();
+                Lanes arg2 = mBatchPop();
+                mBatchStack.push_back(lanesMul(arg1, arg2));
+                break;
+            }
+            case OpCode::Div: {
+                Lanes arg1 = mBatchPop();
+                Lanes arg2 = mBatchPop();
+                mBatchStack.push_back(lanesDiv(arg1, arg2));
+                break;
+            }
+            case OpCode::Neg: {
+                Lanes arg1 = mBatchPop();
+                mBatchStack.push_back(lanesSub(lanesBroadcast(0.0), arg1));
+                break;
+            }
+            case OpCode::Push: {
+                mBatchStack.push_back(lanesBroadcast(ins.value));
+                break;
+            }
+            case OpCode::Pop: {
+                mBatchPop();
+                break;
+            }
+            case OpCode::LoadLocal: {
+                mBatchStack.push_back(regs[ins.slot]);
+                break;
+            }
+            case OpCode::StoreLocal: {
+                regs[ins.slot] = mBatchPop();
+                break;
+            }
+            case OpCode::LoadOuter:
+            case OpCode::RegLoadOuter: {
+                uint32_t base = mScopeFrames[ins.scope];
+                if (base == UINT32_MAX) {
+                    mError("scope '" + std::to_string(ins.scope) + "' is not active (loadouter)");
+                }
+                if (ins.opCode == OpCode::RegLoadOuter) {
+                    regs[ins.regs[0]] = mBatchFrames[base + ins.slot];
+                }
+                else {
+                    mBatchStack.push_back(mBatchFrames[base + ins.slot]);
+                }
+                break;
+            }
+            case OpCode::LoadLocal2: {
+                mBatchStack.push_back(regs[ins.slot]);
+                mBatchStack.push_back(regs[ins.regs[0]]);
+                break;
+            }
+            case OpCode::LoadLocalAdd: {
+                Lanes arg2 = mBatchPop();
+                mBatchStack.push_back(lanesAdd(regs[ins.slot], arg2));
+                break;
+            }
+            case OpCode::LoadLocalSub: {
+                Lanes arg2 = mBatchPop();
+                mBatchStack.push_back(lanesSub(regs[ins.slot], arg2));
+                break;
+            }
+            case OpCode::LoadLocalMul: {
+                Lanes arg2 = mBatchPop();
+                mBatchStack.push_back(lanesMul(regs[ins.slot], arg2));
+                break;
+            }
+            case OpCode::LoadLocalDiv: {
+                Lanes arg2 = mBatchPop();
+                mBatchStack.push_back(lanesDiv(regs[ins.slot], arg2));
+                break;
+            }
+            case OpCode::LoadLocal2Add: {
+                mBatchStack.push_back(lanesAdd(regs[ins.regs[0]], regs[ins.slot]));
+                break;
+            }
+            case OpCode::LoadLocal2Sub: {
+                mBatchStack.push_back(lanesSub(regs[ins.regs[0]], regs[ins.slot]));
+                break;
+            }
+            case OpCode::LoadLocal2Mul: {
+                mBatchStack.push_back(lanesMul(regs[ins.regs[0]], regs[ins.slot]));
+                break;
+            }
+            case OpCode::LoadLocal2Div: {
+                mBatchStack.push_back(lanesDiv(regs[ins.regs[0]], regs[ins.slot]));
+                break;
+            }
+            case OpCode::StoreLocal2: {
+                regs[ins.slot] = mBatchPop();
+                regs[ins.regs[0]] = mBatchPop();
+                break;
+            }
+            case OpCode::PushLoadLocal: {
+                mBatchStack.push_back(lanesBroadcast(ins.value));
+                mBatchStack.push_back(regs[ins.slot]);
+                break;
+            }
+            case OpCode::Native: {
+                const Builtin &builtin = builtins[ins.id];
+                if (mBatchStack.size() < builtin.argsCount) {
+                    mError("operand stack underflow in batch mode");
+                }
+                Lanes result = mBatchNative(builtin, mBatchStack.data() + mBatchStack.size() - builtin.argsCount);
+                mBatchStack.resize(mBatchStack.size() - builtin.argsCount);
+                mBatchStack.push_back(result);
+                break;
+            }
+            case OpCode::RegNative: {
+                regs[ins.regs[0]] = mBatchNative(builtins[ins.id], regs + ins.regs[1]);
+                break;
+            }
+            case OpCode::RegLoadK: {
+                regs[ins.slot] = lanesBroadcast(ins.value);
+                break;
+            }
+            case OpCode::Memo: {
+                // Every lane runs the body, a batch is already cheaper per row than a lookup
+                break;
+            }
+            case OpCode::RegMove: {
+                regs[ins.regs[0]] = regs[ins.regs[1]];
+                break;
+            }
+            case OpCode::RegAdd: {
+                regs[ins.regs[0]] = lanesAdd(regs[ins.regs[1]], regs[ins.regs[2]]);
+                break;
+            }
+            case OpCode::RegSub: {
+                regs[ins.regs[0]] = lanesSub(regs[ins.regs[1]], regs[ins.regs[2]]);
+                break;
+            }
+            case OpCode::RegMul: {
+                regs[ins.regs[0]] = lanesMul(regs[ins.regs[1]], regs[ins.regs[2]]);
+                break;
+            }
+            case OpCode::RegDiv: {
+                regs[ins.regs[0]] = lanesDiv(regs[ins.regs[1]], regs[ins.regs[2]]);
+                break;
+            }
+            case OpCode::RegNeg: {
+                regs[ins.regs[0]] = lanesSub(lanesBroadcast(0.0), regs[ins.regs[1]]);
+                break;
+            }
+            default: {
+                // Printing, named variables and the halt sentinel have no meaning for a batch of rows
+                mError("opcode '" + std::string(getOpCodeName(ins.opCode)) + "' is not supported in batch mode");
+            }
+        }
+    }
+}
+
+Lanes VM::mBatchNative(const Builtin &builtin, const Lanes *args) {
+    // Builtins are scalar, every lane is computed on its own
+    double values[MaxBuiltinArgsCount][LaneWidth];
+    for (size_t i = 0; i < builtin.argsCount; i++) {
+        lanesStore(values[i], args[i]);
+    }
+    double results[LaneWidth];
+    for (size_t lane = 0; lane < LaneWidth; lane++) {
+        double laneArgs[MaxBuiltinArgsCount];
+        for (size_t i = 0; i < builtin.argsCount; i++) {
+            laneArgs[i] = values[i][lane];
+        }
+        results[lane] = builtin.func(laneArgs);
+    }
+    return lanesLoad(results);
+}
+
+Lanes VM::mBatchPop() {
+    if (mBatchStack.empty()) {
+        mError("operand stack underflow in batch mode");
+    }
+    Lanes value = mBatchStack.back();
+    mBatchStack.pop_back();
+    return value;
+}
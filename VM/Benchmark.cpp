@@ -0,0 +1,134 @@
+#include "Benchmark.hpp"
+#include "VM.hpp"
+#include "WorkerPool.hpp"
+#include "Scheduler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+static void benchmarkMode(BytecodeView bc, int iterations, DispatchMode mode, bool isChecked, uint32_t jitThreshold,
+                          const char *name) {
+    auto vm = VM(bc);
+    vm.setPrintEnabled(false);
+    vm.setCheckEnabled(isChecked);
+    vm.setJitThreshold(jitThreshold);
+
+    uint64_t executedCount = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        vm.run(mode);
+        executedCount += vm.getExecutedCount();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    printf("%-10s %12llu instructions in %8.3f s: %10.2f Minstr/s\n", name, static_cast<unsigned long long>(executedCount),
+           seconds, seconds > 0 ? executedCount / seconds / 1e6 : 0.0);
+}
+
+void runBenchmark(BytecodeView bc, int iterations) {
+    printf("Benchmark: %d iterations\n", iterations);
+    benchmarkMode(bc, iterations, DispatchMode::Table, false, 0, "table");
+    benchmarkMode(bc, iterations, DispatchMode::Threaded, true, 0, "checked");
+    benchmarkMode(bc, iterations, DispatchMode::Threaded, false, 0, "threaded");
+    // Only the interpreted part is counted, compiled functions run without dispatch
+    if (Jit::isSupported()) {
+        benchmarkMode(bc, iterations, DispatchMode::Threaded, false, DefaultJitThreshold, "jit");
+    }
+}
+
+void runBatchBenchmark(BytecodeView bc, uint32_t address, size_t argsCount, size_t rows) {
+    std::vector<std::vector<double>> columns(argsCount, std::vector<double>(rows));
+    std::vector<const double*> columnPtrs;
+    for (size_t i = 0; i < argsCount; i++) {
+        for (size_t row = 0; row < rows; row++) {
+            columns[i][row] = static_cast<double>(row % 1000 + i + 1);
+        }
+        columnPtrs.push_back(columns[i].data());
+    }
+    std::vector<double> results(rows);
+
+    auto vm = VM(bc);
+    auto start = std::chrono::steady_clock::now();
+    bool isDone = vm.runBatch(address, columnPtrs, rows, results.data());
+    auto end = std::chrono::steady_clock::now();
+    if (!isDone) {
+        return;
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double sum = 0;
+    for (double result : results) {
+        sum += result;
+    }
+    printf("Batch: %zu rows, %zu lanes in %8.3f s: %10.2f Mrows/s, sum of results %f\n", rows, LaneWidth, seconds,
+           seconds > 0 ? rows / seconds / 1e6 : 0.0, sum);
+}
+
+static void benchmarkPool(const std::shared_ptr<const Program> &program, int iterations, size_t threadsCount) {
+    // Jobs are chunks of runs, a single run is too short to pay for the queueing
+    const int chunkSize = 256;
+    WorkerPool pool(program, threadsCount);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i += chunkSize) {
+        int count = std::min(chunkSize, iterations - i);
+        pool.submit([count](VM &vm) {
+            vm.setPrintEnabled(false);
+            for (int j = 0; j < count; j++) {
+                vm.run();
+            }
+        });
+    }
+    pool.wait();
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    printf("pool %3zu threads %10d runs in %8.3f s: %10.2f Mruns/s\n", pool.getThreadsCount(), iterations, seconds,
+           seconds > 0 ? iterations / seconds / 1e6 : 0.0);
+}
+
+void runPoolBenchmark(BytecodeView bc, int iterations, size_t threadsCount) {
+    printf("Pool benchmark: %d iterations\n", iterations);
+    // One decoded program for all workers
+    auto program = std::make_shared<const Program>(bc);
+    benchmarkPool(program, iterations, 1);
+    if (threadsCount > 1) {
+        benchmarkPool(program, iterations, threadsCount);
+    }
+}
+
+void runSchedulerBenchmark(BytecodeView bc, size_t tenants, size_t threadsCount, uint64_t sliceFuel, size_t memoCapacity) {
+    auto program = std::make_shared<const Program>(bc);
+    Scheduler scheduler(threadsCount, sliceFuel);
+    size_t startFootprint = 0;
+    std::vector<TaskId> tasks;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < tenants; i++) {
+        auto vm = std::make_unique<VM>(program);
+        vm->setPrintEnabled(false);
+        vm->setMemoCapacity(memoCapacity);
+        vm->start();
+        startFootprint += vm->getMemoryFootprint();
+        tasks.push_back(scheduler.spawn(std::move(vm)));
+    }
+    scheduler.wait();
+    auto end = std::chrono::steady_clock::now();
+
+    // Nothing is freed when a VM finishes, so what it holds now is the most it held while running
+    uint64_t executedCount = 0;
+    size_t failedCount = 0;
+    size_t footprint = 0;
+    for (TaskId task : tasks) {
+        const VM &vm = scheduler.getVM(task);
+        executedCount += vm.getExecutedCount();
+        footprint += vm.getMemoryFootprint();
+        failedCount += scheduler.getState(task) != TaskState::Finished;
+    }
+    double seconds = std::chrono::duration<double>(end - start).count();
+    printf("Scheduler: %zu VMs on %zu threads, %llu slices, %zu failed\n", tenants, scheduler.getThreadsCount(),
+           static_cast<unsigned long long>(scheduler.getSlicesCount()), failedCount);
+    printf("%12llu instructions in %8.3f s: %10.2f Minstr/s\n", static_cast<unsigned long long>(executedCount), seconds,
+           seconds > 0 ? executedCount / seconds / 1e6 : 0.0);
+    printf("%zu bytes per VM after the run, %zu at the start\n", tenants > 0 ? footprint / tenants : 0,
+           tenants > 0 ? startFootprint / tenants : 0);
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "Program.hpp"
+
+// Runs the program iterations times in each dispatch mode. A run of test.mls is a few dozen instructions, so starting
+// the VM costs as much as dispatching them; benchmark.mls runs about 40000 and measures the dispatch itself.
+void runBenchmark(BytecodeView bc, int iterations);
+
+// Evaluates the function at a code address over generated columns with runBatch
+void runBatchBenchmark(BytecodeView bc, uint32_t address, size_t argsCount, size_t rows);
+
+// Runs the program iterations times on a WorkerPool with one thread and with threadsCount threads
+void runPoolBenchmark(BytecodeView bc, int iterations, size_t threadsCount);
+
+// Runs tenants copies of the program as separate VMs time-sliced by a Scheduler with threadsCount threads, every VM
+// with a memo table of memoCapacity entries
+void runSchedulerBenchmark(BytecodeView bc, size_t tenants, size_t threadsCount, uint64_t sliceFuel, size_t memoCapacity);
@@ -0,0 +1,24 @@
+#pragma once
+#include "../Bytecode.hpp"
+
+// Fixed-width form of one bytecode instruction with its operands already unpacked.
+// Jmp/Call addresses are instruction indices, not byte offsets, and Push/RegLoadK carry the value of their constant.
+// Register operands live in regs, except for RegLoadK which keeps its destination in slot.
+// Superinstructions keep their first slot in slot and the second one in regs[0].
+// Native and RegNative keep the index of their builtin in id.
+struct alignas(16) Instruction {
+    OpCode opCode;
+    uint8_t id;
+    ScopeIndex scope;
+    union {
+        uint32_t address;
+        uint32_t slot;
+        uint32_t size;
+    };
+    union {
+        double value;
+        // Index into the symbols of the program
+        uint32_t symbol;
+        SlotIndex regs[4];
+    };
+};
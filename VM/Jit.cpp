@@ -0,0 +1,332 @@
+#include "Jit.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+// System V argument registers of JitFunc
+const int RegSP = 7; // rdi
+const int RegFrame = 6; // rsi
+const int RegFrames = 2; // rdx
+const int RegScopeFrames = 1; // rcx
+// xmm14 and xmm15 hold operands popped from the memory stack, the rest caches the operand stack
+const int StackRegistersCount = 14;
+const int ScratchA = 15;
+const int ScratchB = 14;
+
+Jit::Jit() {
+    mStackSize = 0;
+    mMemoryTop = 0;
+}
+
+Jit::~Jit() {
+#if JIT_SUPPORTED
+    for (const auto &page : mPages) {
+        munmap(page.first, page.second);
+    }
+#endif
+}
+
+size_t Jit::getAllocatedSize() const {
+    size_t size = mBuffer.capacity();
+    for (const auto &page : mPages) {
+        size += page.second;
+    }
+    return size;
+}
+
+bool Jit::isSupported() {
+    return JIT_SUPPORTED != 0;
+}
+
+bool Jit::compile(const std::vector<Instruction> &code, uint32_t entry, JitFunction &function) {
+    if (!isSupported() || entry >= code.size() || code[entry].opCode != OpCode::Enter) {
+        return false;
+    }
+    mBuffer.clear();
+    mStackSize = 0;
+    mMemoryTop = 0;
+    ScopeIndex scope = code[entry].scope;
+    function.frameSize = code[entry].size;
+    function.outerScopes.clear();
+
+    // Without conditional jumps the body is a single path, jumps over nested functions are followed at compile time
+    std::vector<bool> isVisited(code.size(), false);
+    size_t i = entry + 1;
+    while (i < code.size() && !isVisited[i]) {
+        isVisited[i] = true;
+        const auto &ins = code[i];
+        bool isCompiled = true;
+        switch (ins.opCode) {
+            case OpCode::Jmp: {
+                i = ins.address;
+                continue;
+            }
+            case OpCode::Ret: {
+                mReturn();
+                return mFinish(function);
+            }
+            case OpCode::Push: {
+                isCompiled = mPushConstant(ins.value);
+                break;
+            }
+            case OpCode::Pop: {
+                mPop();
+                break;
+            }
+            case OpCode::LoadLocal: {
+                isCompiled = mLoadLocal(ins.slot);
+                break;
+            }
+            case OpCode::StoreLocal: {
+                mStoreLocal(ins.slot);
+                break;
+            }
+            case OpCode::LoadOuter: {
+                if (ins.scope == scope) {
+                    isCompiled = mLoadLocal(ins.slot);
+                }
+                else {
+                    isCompiled = mLoadOuter(ins.scope, ins.slot);
+                    function.outerScopes.push_back(ins.scope);
+                }
+                break;
+            }
+            case OpCode::Add:
+            case OpCode::Sub:
+            case OpCode::Mul:
+            case OpCode::Div: {
+                mBinOp(ins.opCode);
+                break;
+            }
+            case OpCode::Neg: {
+                // 0 - x, the zero goes on top as the left operand
+                isCompiled = mPushConstant(0.0);
+                mBinOp(OpCode::Sub);
+                break;
+            }
+            case OpCode::LoadLocal2: {
+                isCompiled = mLoadLocal(ins.slot) && mLoadLocal(ins.regs[0]);
+                break;
+            }
+            case OpCode::LoadLocalAdd:
+            case OpCode::LoadLocalSub:
+            case OpCode::LoadLocalMul:
+            case OpCode::LoadLocalDiv: {
+                isCompiled = mLoadLocal(ins.slot);
+                mBinOp(static_cast<OpCode>(static_cast<int>(OpCode::Add) + static_cast<int>(ins.opCode) - static_cast<int>(OpCode::LoadLocalAdd)));
+                break;
+            }
+            case OpCode::LoadLocal2Add:
+            case OpCode::LoadLocal2Sub:
+            case OpCode::LoadLocal2Mul:
+            case OpCode::LoadLocal2Div: {
+                isCompiled = mLoadLocal(ins.slot) && mLoadLocal(ins.regs[0]);
+                mBinOp(static_cast<OpCode>(static_cast<int>(OpCode::Add) + static_cast<int>(ins.opCode) - static_cast<int>(OpCode::LoadLocal2Add)));
+                break;
+            }
+            case OpCode::StoreLocal2: {
+                mStoreLocal(ins.slot);
+                mStoreLocal(ins.regs[0]);
+                break;
+            }
+            case OpCode::PushLoadLocal: {
+                isCompiled = mPushConstant(ins.value) && mLoadLocal(ins.slot);
+                break;
+            }
+            default: {
+                // Calls, interruptions, named variables and register code stay in the interpreter
+                return false;
+            }
+        }
+        if (!isCompiled) {
+            return false;
+        }
+        i++;
+    }
+    // The body loops forever or runs off the end of the code
+    return false;
+}
+
+int Jit::mPopToRegister(int scratch) {
+    if (mStackSize > 0) {
+        return --mStackSize;
+    }
+    mEmitSseMem(0xF2, 0x10, scratch, RegSP, --mMemoryTop*8); // movsd scratch, [rdi + top]
+    return scratch;
+}
+
+bool Jit::mPushConstant(double value) {
+    if (mStackSize == StackRegistersCount) {
+        return false;
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    mEmit(0x48);
+    mEmit(0xB8);
+    mEmit64(bits); // mov rax, imm64
+    mEmit(0x66);
+    mEmitRex(true, mStackSize, 0);
+    mEmit(0x0F);
+    mEmit(0x6E);
+    mEmit(static_cast<uint8_t>(0xC0 | (mStackSize & 7) << 3)); // movq xmm, rax
+    mStackSize++;
+    return true;
+}
+
+bool Jit::mLoadLocal(uint32_t slot) {
+    if (mStackSize == StackRegistersCount) {
+        return false;
+    }
+    mEmitSseMem(0xF2, 0x10, mStackSize++, RegFrame, static_cast<int32_t>(slot*8)); // movsd xmm, [rsi + slot]
+    return true;
+}
+
+bool Jit::mLoadOuter(ScopeIndex scope, uint32_t slot) {
+    if (mStackSize == StackRegistersCount) {
+        return false;
+    }
+    mEmit(0x8B);
+    mEmit(static_cast<uint8_t>(0x80 | RegScopeFrames));
+    mEmit32(static_cast<int32_t>(scope*sizeof(uint32_t))); // mov eax, [rcx + scope]
+    mEmit(0xF2);
+    mEmitRex(false, mStackSize, 0);
+    mEmit(0x0F);
+    mEmit(0x10);
+    mEmit(static_cast<uint8_t>(0x84 | (mStackSize & 7) << 3));
+    mEmit(static_cast<uint8_t>(0xC0 | RegFrames));
+    mEmit32(static_cast<int32_t>(slot*8)); // movsd xmm, [rdx + rax*8 + slot]
+    mStackSize++;
+    return true;
+}
+
+void Jit::mStoreLocal(uint32_t slot) {
+    int reg = mPopToRegister(ScratchA);
+    mEmitSseMem(0xF2, 0x11, reg, RegFrame, static_cast<int32_t>(slot*8)); // movsd [rsi + slot], xmm
+}
+
+void Jit::mPop() {
+    if (mStackSize > 0) {
+        mStackSize--;
+    }
+    else {
+        mMemoryTop--;
+    }
+}
+
+void Jit::mBinOp(OpCode opCode) {
+    uint8_t op = 0x58;
+    bool isCommutative = true;
+    if (opCode == OpCode::Sub) {
+        op = 0x5C;
+        isCommutative = false;
+    }
+    else if (opCode == OpCode::Mul) {
+        op = 0x59;
+    }
+    else if (opCode == OpCode::Div) {
+        op = 0x5E;
+        isCommutative = false;
+    }
+
+    // Same operand order as the interpreter: the top of the stack is the left operand
+    int arg1 = mPopToRegister(ScratchA);
+    int arg2 = mPopToRegister(ScratchB);
+    int dest = mStackSize++;
+    if (arg2 != dest) {
+        if (arg1 != dest) {
+            mEmitSse(0x66, 0x28, dest, arg1); // movapd dest, arg1
+        }
+        mEmitSse(0xF2, op, dest, arg2);
+    }
+    else if (isCommutative) {
+        mEmitSse(0xF2, op, dest, arg1);
+    }
+    else {
+        if (arg1 != ScratchA) {
+            mEmitSse(0x66, 0x28, ScratchA, arg1);
+        }
+        mEmitSse(0xF2, op, ScratchA, arg2);
+        mEmitSse(0x66, 0x28, dest, ScratchA);
+    }
+}
+
+void Jit::mReturn() {
+    // Spill the cached operands back to the memory stack where the interpreter expects them
+    for (int i = 0; i < mStackSize; i++) {
+        mEmitSseMem(0xF2, 0x11, i, RegSP, (mMemoryTop + i)*8); // movsd [rdi + pos], xmm
+    }
+    mEmit(0x48);
+    mEmit(0x8D);
+    mEmit(static_cast<uint8_t>(0x80 | RegSP));
+    mEmit32((mMemoryTop + mStackSize)*8); // lea rax, [rdi + top]
+    mEmit(0xC3); // ret
+}
+
+bool Jit::mFinish(JitFunction &function) {
+#if JIT_SUPPORTED
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t size = (mBuffer.size() + pageSize - 1) / pageSize*pageSize;
+    void *page = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (page == MAP_FAILED) {
+        return false;
+    }
+    memcpy(page, mBuffer.data(), mBuffer.size());
+    if (mprotect(page, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(page, size);
+        return false;
+    }
+    mPages.emplace_back(page, size);
+    function.func = reinterpret_cast<JitFunc>(page);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Jit::mEmit(uint8_t byte) {
+    mBuffer.push_back(byte);
+}
+
+void Jit::mEmit32(int32_t value) {
+    uint8_t bytes[sizeof(value)];
+    memcpy(bytes, &value, sizeof(value));
+    mBuffer.insert(mBuffer.end(), bytes, bytes + sizeof(bytes));
+}
+
+void Jit::mEmit64(uint64_t value) {
+    uint8_t bytes[sizeof(value)];
+    memcpy(bytes, &value, sizeof(value));
+    mBuffer.insert(mBuffer.end(), bytes, bytes + sizeof(bytes));
+}
+
+void Jit::mEmitRex(bool isWide, int reg, int rm) {
+    uint8_t rex = static_cast<uint8_t>(0x40 | (isWide ? 0x08 : 0) | (reg >= 8 ? 0x04 : 0) | (rm >= 8 ? 0x01 : 0));
+    if (rex != 0x40) {
+        mEmit(rex);
+    }
+}
+
+// <prefix> 0F <op> with both operands in xmm registers
+void Jit::mEmitSse(uint8_t prefix, uint8_t op, int reg, int rm) {
+    mEmit(prefix);
+    mEmitRex(false, reg, rm);
+    mEmit(0x0F);
+    mEmit(op);
+    mEmit(static_cast<uint8_t>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+// <prefix> 0F <op> with a [base + disp32] memory operand, base must not need a SIB byte
+void Jit::mEmitSseMem(uint8_t prefix, uint8_t op, int reg, int base, int32_t disp) {
+    mEmit(prefix);
+    mEmitRex(false, reg, base);
+    mEmit(0x0F);
+    mEmit(op);
+    mEmit(static_cast<uint8_t>(0x80 | (reg & 7) << 3 | (base & 7)));
+    mEmit32(disp);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "Instruction.hpp"
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+const uint32_t DefaultJitThreshold = 16;
+
+// Native code of one function: takes the operand stack pointer, the frame of the new activation and what
+// LoadOuter needs, returns the operand stack pointer after ret
+using JitFunc = double *(*)(double *sp, double *frame, double *frames, const uint32_t *scopeFrames);
+
+struct JitFunction {
+    JitFunc func;
+    uint32_t frameSize;
+    // Scopes read by LoadOuter, the VM keeps interpreting while one of them is not active
+    std::vector<ScopeIndex> outerScopes;
+};
+
+struct JitEntry {
+    uint32_t callCount;
+    bool isFailed;
+    JitFunction function;
+};
+
+// Baseline x86-64 compiler for leaf functions of the stack engine. The operand stack is kept in xmm registers
+// at compile time, locals stay in the VM frame.
+class Jit {
+public:
+    Jit();
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit &operator=(const Jit&) = delete;
+
+    static bool isSupported();
+    // Returns false if the function uses anything the JIT can't compile, the caller keeps interpreting it then
+    bool compile(const std::vector<Instruction> &code, uint32_t entry, JitFunction &function);
+    // Bytes of the pages holding compiled code and of the code buffer
+    size_t getAllocatedSize() const;
+
+private:
+    int mPopToRegister(int scratch);
+    bool mPushConstant(double value);
+    bool mLoadLocal(uint32_t slot);
+    bool mLoadOuter(ScopeIndex scope, uint32_t slot);
+    void mStoreLocal(uint32_t slot);
+    void mPop();
+    void mBinOp(OpCode opCode);
+    void mReturn();
+    bool mFinish(JitFunction &function);
+
+    void mEmit(uint8_t byte);
+    void mEmit32(int32_t value);
+    void mEmit64(uint64_t value);
+    void mEmitRex(bool isWide, int reg, int rm);
+    void mEmitSse(uint8_t prefix, uint8_t op, int reg, int rm);
+    void mEmitSseMem(uint8_t prefix, uint8_t op, int reg, int base, int32_t disp);
+
+    std::vector<uint8_t> mBuffer;
+    // Values of the compile-time operand stack live in xmm0..xmm<size - 1>
+    int mStackSize;
+    // Operands below the function entry consumed so far, they are read from the memory stack
+    int mMemoryTop;
+    std::vector<std::pair<void*, size_t>> mPages;
+};
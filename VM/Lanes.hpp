@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+
+// One value per row of a batch, the widest vector the target is compiled for. The default build only has the
+// baseline of the architecture, MATHLANG_SIMD in CMake or MathLangSimd in MSBuild enables AVX2 or AVX-512.
+#if defined(__AVX512F__)
+
+#include <immintrin.h>
+struct Lanes {
+    __m512d vector;
+};
+const size_t LaneWidth = 8;
+inline Lanes lanesBroadcast(double value) { return { _mm512_set1_pd(value) }; }
+inline Lanes lanesLoad(const double *values) { return { _mm512_loadu_pd(values) }; }
+inline void lanesStore(double *values, Lanes lanes) { _mm512_storeu_pd(values, lanes.vector); }
+inline Lanes lanesAdd(Lanes a, Lanes b) { return { _mm512_add_pd(a.vector, b.vector) }; }
+inline Lanes lanesSub(Lanes a, Lanes b) { return { _mm512_sub_pd(a.vector, b.vector) }; }
+inline Lanes lanesMul(Lanes a, Lanes b) { return { _mm512_mul_pd(a.vector, b.vector) }; }
+inline Lanes lanesDiv(Lanes a, Lanes b) { return { _mm512_div_pd(a.vector, b.vector) }; }
+
+#elif defined(__AVX__)
+
+#include <immintrin.h>
+struct Lanes {
+    __m256d vector;
+};
+const size_t LaneWidth = 4;
+inline Lanes lanesBroadcast(double value) { return { _mm256_set1_pd(value) }; }
+inline Lanes lanesLoad(const double *values) { return { _mm256_loadu_pd(values) }; }
+inline void lanesStore(double *values, Lanes lanes) { _mm256_storeu_pd(values, lanes.vector); }
+inline Lanes lanesAdd(Lanes a, Lanes b) { return { _mm256_add_pd(a.vector, b.vector) }; }
+inline Lanes lanesSub(Lanes a, Lanes b) { return { _mm256_sub_pd(a.vector, b.vector) }; }
+inline Lanes lanesMul(Lanes a, Lanes b) { return { _mm256_mul_pd(a.vector, b.vector) }; }
+inline Lanes lanesDiv(Lanes a, Lanes b) { return { _mm256_div_pd(a.vector, b.vector) }; }
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+#include <emmintrin.h>
+struct Lanes {
+    __m128d vector;
+};
+const size_t LaneWidth = 2;
+inline Lanes lanesBroadcast(double value) { return { _mm_set1_pd(value) }; }
+inline Lanes lanesLoad(const double *values) { return { _mm_loadu_pd(values) }; }
+inline void lanesStore(double *values, Lanes lanes) { _mm_storeu_pd(values, lanes.vector); }
+inline Lanes lanesAdd(Lanes a, Lanes b) { return { _mm_add_pd(a.vector, b.vector) }; }
+inline Lanes lanesSub(Lanes a, Lanes b) { return { _mm_sub_pd(a.vector, b.vector) }; }
+inline Lanes lanesMul(Lanes a, Lanes b) { return { _mm_mul_pd(a.vector, b.vector) }; }
+inline Lanes lanesDiv(Lanes a, Lanes b) { return { _mm_div_pd(a.vector, b.vector) }; }
+
+#else
+
+struct Lanes {
+    double value;
+};
+const size_t LaneWidth = 1;
+inline Lanes lanesBroadcast(double value) { return { value }; }
+inline Lanes lanesLoad(const double *values) { return { values[0] }; }
+inline void lanesStore(double *values, Lanes lanes) { values[0] = lanes.value; }
+inline Lanes lanesAdd(Lanes a, Lanes b) { return { a.value + b.value }; }
+inline Lanes lanesSub(Lanes a, Lanes b) { return { a.value - b.value }; }
+inline Lanes lanesMul(Lanes a, Lanes b) { return { a.value*b.value }; }
+inline Lanes lanesDiv(Lanes a, Lanes b) { return { a.value / b.value }; }
+
+#endif
+
+// The last block of a batch may have fewer rows than lanes, the unused lanes are zero and never stored
+inline Lanes lanesLoadPartial(const double *values, size_t count) {
+    if (count == LaneWidth) {
+        return lanesLoad(values);
+    }
+    double buffer[LaneWidth] = {};
+    memcpy(buffer, values, count*sizeof(double));
+    return lanesLoad(buffer);
+}
+
+inline void lanesStorePartial(double *values, size_t count, Lanes lanes) {
+    if (count == LaneWidth) {
+        lanesStore(values, lanes);
+        return;
+    }
+    double buffer[LaneWidth];
+    lanesStore(buffer, lanes);
+    memcpy(values, buffer, count*sizeof(double));
+}
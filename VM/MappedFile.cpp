@@ -0,0 +1,126 @@
+#include "MappedFile.hpp"
+#include <cstdio>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+    mData = nullptr;
+    mSize = 0;
+    mIsMapped = false;
+#if defined(_WIN32)
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string &path) {
+    close();
+    if (mMap(path)) {
+        mIsMapped = true;
+        return true;
+    }
+
+    // Empty files can't be mapped, and some file systems don't support it at all
+    FILE *f = fopen(path.data(), "rb");
+    if (!f) {
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    mBuffer.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    mBuffer.resize(fread(mBuffer.data(), 1, mBuffer.size(), f));
+    fclose(f);
+    mData = mBuffer.data();
+    mSize = mBuffer.size();
+    return true;
+}
+
+void MappedFile::close() {
+    if (mIsMapped) {
+#if defined(_WIN32)
+        UnmapViewOfFile(mData);
+        CloseHandle(mMapping);
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+        mMapping = nullptr;
+#else
+        munmap(const_cast<uint8_t*>(mData), mSize);
+#endif
+    }
+    mBuffer.clear();
+    mData = nullptr;
+    mSize = 0;
+    mIsMapped = false;
+}
+
+BytecodeView MappedFile::getView() const {
+    return BytecodeView(mData, mSize);
+}
+
+bool MappedFile::isMapped() const {
+    return mIsMapped;
+}
+
+bool MappedFile::mMap(const std::string &path) {
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.data(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    mFile = file;
+    mMapping = mapping;
+    mData = static_cast<const uint8_t*>(data);
+    mSize = static_cast<size_t>(size.QuadPart);
+    return true;
+#else
+    int fd = ::open(path.data(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    // The decoder reads the code once from start to end
+    madvise(data, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+    mData = static_cast<const uint8_t*>(data);
+    mSize = static_cast<size_t>(info.st_size);
+    return true;
+#endif
+}
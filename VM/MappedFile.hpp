@@ -0,0 +1,31 @@
+#pragma once
+#include "Program.hpp"
+#include <string>
+
+// Read-only view of a whole file. The file is mapped when the platform allows it, so loading costs no copy;
+// otherwise it is read into memory. Only the raw bytes come from the page cache, and Program reads them once while
+// it loads. The decoded Instruction array that runs belongs to each process and is larger than the file.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    bool open(const std::string &path);
+    void close();
+    BytecodeView getView() const;
+    bool isMapped() const;
+
+private:
+    bool mMap(const std::string &path);
+
+    const uint8_t *mData;
+    size_t mSize;
+    bool mIsMapped;
+    std::vector<uint8_t> mBuffer;
+#if defined(_WIN32)
+    void *mFile;
+    void *mMapping;
+#endif
+};
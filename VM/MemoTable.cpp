@@ -0,0 +1,107 @@
+#include "MemoTable.hpp"
+#include <algorithm>
+#include <cstring>
+
+MemoTable::MemoTable(size_t capacity) {
+    mCapacity = 0;
+    mUsedCount = 0;
+    mHitsCount = 0;
+    mMissesCount = 0;
+    setCapacity(capacity);
+}
+
+void MemoTable::setCapacity(size_t capacity) {
+    size_t size = capacity > 0 ? 1 : 0;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mCapacity = size;
+    mUsedCount = 0;
+    mEntries.clear();
+    mEntries.shrink_to_fit();
+}
+
+size_t MemoTable::getCapacity() const {
+    return mCapacity;
+}
+
+bool MemoTable::find(uint32_t function, const double *args, uint32_t argsCount, double &result) {
+    MemoEntry key;
+    makeKey(key, function, args, argsCount);
+    if (!mEntries.empty()) {
+        const MemoEntry &entry = mEntries[mGetIndex(key)];
+        if (entry.function == function && memcmp(entry.args, key.args, argsCount*sizeof(uint64_t)) == 0) {
+            mHitsCount++;
+            result = entry.result;
+            return true;
+        }
+    }
+    mMissesCount++;
+    return false;
+}
+
+void MemoTable::insert(const MemoEntry &entry) {
+    if (mCapacity == 0) {
+        return;
+    }
+    if (mEntries.empty()) {
+        mResize(std::min(InitialMemoEntriesCount, mCapacity));
+    }
+    MemoEntry &slot = mEntries[mGetIndex(entry)];
+    if (slot.function == UINT32_MAX) {
+        mUsedCount++;
+    }
+    slot = entry;
+    if (mUsedCount*2 > mEntries.size() && mEntries.size() < mCapacity) {
+        mResize(mEntries.size()*2);
+    }
+}
+
+uint64_t MemoTable::getHitsCount() const {
+    return mHitsCount;
+}
+
+uint64_t MemoTable::getMissesCount() const {
+    return mMissesCount;
+}
+
+size_t MemoTable::getAllocatedSize() const {
+    return mEntries.capacity()*sizeof(MemoEntry);
+}
+
+void MemoTable::makeKey(MemoEntry &entry, uint32_t function, const double *args, uint32_t argsCount) {
+    entry.function = function;
+    entry.argsCount = argsCount;
+    memcpy(entry.args, args, argsCount*sizeof(uint64_t));
+    entry.result = 0.0;
+}
+
+size_t MemoTable::mGetIndex(const MemoEntry &key) const {
+    // Every argument goes through the MurmurHash3 finalizer. A small integer differs from its neighbours only in the
+    // high bits of the double, which a multiply alone never carries down to the bits of the index.
+    uint64_t hash = key.function*0x9E3779B97F4A7C15ull;
+    for (uint32_t i = 0; i < key.argsCount; i++) {
+        hash ^= key.args[i];
+        hash = (hash ^ (hash >> 33))*0xFF51AFD7ED558CCDull;
+        hash = (hash ^ (hash >> 33))*0xC4CEB9FE1A85EC53ull;
+        hash ^= hash >> 33;
+    }
+    return static_cast<size_t>(hash) & (mEntries.size() - 1);
+}
+
+void MemoTable::mResize(size_t size) {
+    // Entries that land on the same index of the larger table keep the last one, as an insert would
+    std::vector<MemoEntry> entries(size);
+    for (auto &entry : entries) {
+        entry.function = UINT32_MAX;
+    }
+    entries.swap(mEntries);
+    mUsedCount = 0;
+    for (const auto &entry : entries) {
+        if (entry.function != UINT32_MAX) {
+            MemoEntry &slot = mEntries[mGetIndex(entry)];
+            mUsedCount += slot.function == UINT32_MAX;
+            slot = entry;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "../Bytecode.hpp"
+#include <cstddef>
+#include <vector>
+
+const size_t DefaultMemoCapacity = 1 << 12;
+// Entries of a table after its first insert, it doubles up to the capacity as it fills
+const size_t InitialMemoEntriesCount = 16;
+
+// One remembered call, the whole key and the result fill exactly one cache line
+struct alignas(64) MemoEntry {
+    // Instruction index of the Memo of the function, UINT32_MAX for an empty entry
+    uint32_t function;
+    uint32_t argsCount;
+    // Bits of the arguments, so -0.0 and 0.0 are different keys and a NaN matches only the same NaN
+    uint64_t args[MaxMemoArgsCount];
+    double result;
+};
+static_assert(sizeof(MemoEntry) == 64, "a memo entry must fill one cache line");
+
+// Direct-mapped cache of the results of pure functions: a lookup hashes the key to one entry and reads only
+// that cache line, an insert overwrites whatever was there. The table starts small and doubles while more than half
+// of its entries are used, the memory never grows past the capacity however many calls are made.
+class MemoTable {
+public:
+    // Capacity is rounded up to a power of two, 0 turns memoization off. Entries are allocated on the first insert.
+    MemoTable(size_t capacity = DefaultMemoCapacity);
+
+    void setCapacity(size_t capacity);
+    size_t getCapacity() const;
+    bool find(uint32_t function, const double *args, uint32_t argsCount, double &result);
+    void insert(const MemoEntry &entry);
+    uint64_t getHitsCount() const;
+    uint64_t getMissesCount() const;
+    // Zero until the first insert, at most the capacity
+    size_t getAllocatedSize() const;
+
+    // Fills the key of an entry, the result is set once the call returns
+    static void makeKey(MemoEntry &entry, uint32_t function, const double *args, uint32_t argsCount);
+
+private:
+    size_t mGetIndex(const MemoEntry &key) const;
+    void mResize(size_t size);
+
+    std::vector<MemoEntry> mEntries;
+    size_t mCapacity;
+    size_t mUsedCount;
+    uint64_t mHitsCount;
+    uint64_t mMissesCount;
+};
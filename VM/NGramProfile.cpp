@@ -0,0 +1,54 @@
+#include "NGramProfile.hpp"
+#include "VM.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+
+const size_t MaxNGramLength = 3;
+
+static bool isControlFlow(OpCode opCode) {
+    return opCode == OpCode::Jmp || opCode == OpCode::Call || opCode == OpCode::Ret ||
+           opCode == OpCode::RegCall || opCode == OpCode::RegRet || opCode == OpCode::TailCall || opCode == OpCode::RegTailCall;
+}
+
+void runNGramProfile(BytecodeView bc, size_t top) {
+    // Unfused code, otherwise the profile would only show what is already fused
+    auto vm = VM(bc, false);
+    vm.setPrintEnabled(false);
+    std::vector<OpCode> trace;
+    vm.setTrace(&trace);
+    vm.run(DispatchMode::Table);
+
+    printf("N-gram profile: %llu instructions\n", static_cast<unsigned long long>(trace.size()));
+    for (size_t length = 2; length <= MaxNGramLength; length++) {
+        std::map<std::vector<OpCode>, uint64_t> counts;
+        for (size_t i = 0; i + length <= trace.size(); i++) {
+            // Execution leaves the sequence after a transfer of control, so it can't be fused
+            bool isFusable = true;
+            for (size_t j = 0; j + 1 < length; j++) {
+                isFusable = isFusable && !isControlFlow(trace[i + j]);
+            }
+            if (isFusable) {
+                counts[std::vector<OpCode>(trace.begin() + i, trace.begin() + i + length)]++;
+            }
+        }
+
+        std::vector<std::pair<std::vector<OpCode>, uint64_t>> sorted(counts.begin(), counts.end());
+        std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second > b.second; });
+        if (sorted.size() > top) {
+            sorted.erase(sorted.begin() + top, sorted.end());
+        }
+
+        printf("\n%zu-grams:\n", length);
+        for (const auto &ngram : sorted) {
+            std::string name;
+            for (OpCode opCode : ngram.first) {
+                name += (name.empty() ? "" : " ") + std::string(getOpCodeName(opCode));
+            }
+            // Fusing saves length - 1 dispatches per occurrence
+            printf("%-40s %12llu %6.2f%%\n", name.data(), static_cast<unsigned long long>(ngram.second),
+                   trace.empty() ? 0.0 : 100.0*ngram.second*(length - 1) / trace.size());
+        }
+    }
+}
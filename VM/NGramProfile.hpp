@@ -0,0 +1,5 @@
+#pragma once
+#include "Program.hpp"
+
+// Prints the most frequent executed opcode sequences, the candidates for superinstructions
+void runNGramProfile(BytecodeView bc, size_t top);
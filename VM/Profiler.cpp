@@ -0,0 +1,128 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+#if PROFILER_TSC
+static const char *clockUnit = "cycles";
+#else
+static const char *clockUnit = "ns";
+#endif
+
+Profiler::Profiler() {
+    start(0);
+}
+
+void Profiler::start(uint32_t entry) {
+    for (auto &opCode : mOpCodes) {
+        opCode = {};
+    }
+    mFunctions.clear();
+    mActivations.clear();
+    mEntry = entry;
+    mMaxCallDepth = 0;
+    mTotalClock = 0;
+    mCurrent = &mGetFunction(entry);
+    mCurrent->calls = 1;
+    mCurrent->activeCount = 1;
+    mLastOpCode = OpCode::_Count;
+    mStartClock = readProfilerClock();
+    mLastClock = mStartClock;
+    mActivations.push_back({ mCurrent, mStartClock });
+}
+
+void Profiler::finish() {
+    // The last instruction ran until now, OpCode::_Count only collects the time before the first one
+    uint64_t now = readProfilerClock();
+    mOpCodes[static_cast<size_t>(mLastOpCode)].cycles += now - mLastClock;
+    mCurrent->selfCycles += now - mLastClock;
+    mLastClock = now;
+    // A runtime error leaves activations behind, they end here as if they had returned
+    while (!mActivations.empty()) {
+        leaveFunction();
+    }
+    mTotalClock = mLastClock - mStartClock;
+}
+
+void Profiler::enterFunction(uint32_t entry) {
+    FunctionProfile &function = mGetFunction(entry);
+    function.calls++;
+    function.activeCount++;
+    mActivations.push_back({ &function, mLastClock });
+    mCurrent = &function;
+    // The top level is not a call
+    mMaxCallDepth = std::max(mMaxCallDepth, mActivations.size() - 1);
+}
+
+void Profiler::countNativeCall(uint32_t entry) {
+    mGetFunction(entry).calls++;
+}
+
+void Profiler::leaveFunction() {
+    Activation activation = mActivations.back();
+    mActivations.pop_back();
+    if (--activation.function->activeCount == 0) {
+        activation.function->totalCycles += mLastClock - activation.startClock;
+    }
+    mCurrent = mActivations.empty() ? activation.function : mActivations.back().function;
+}
+
+FunctionProfile &Profiler::mGetFunction(uint32_t entry) {
+    auto it = mFunctions.find(entry);
+    if (it == mFunctions.end()) {
+        it = mFunctions.emplace(entry, FunctionProfile()).first;
+        it->second = {};
+    }
+    return it->second;
+}
+
+static double getPercent(uint64_t part, uint64_t whole) {
+    return whole > 0 ? 100.0*part / whole : 0.0;
+}
+
+void Profiler::print(const Program &program) const {
+    uint64_t instructions = 0;
+    uint64_t calls = 0;
+    for (const auto &opCode : mOpCodes) {
+        instructions += opCode.count;
+    }
+    for (const auto &function : mFunctions) {
+        calls += function.first != mEntry ? function.second.calls : 0;
+    }
+    printf("Profile: %llu instructions, %llu %s, %llu calls, max call depth %zu\n",
+           static_cast<unsigned long long>(instructions), static_cast<unsigned long long>(mTotalClock), clockUnit,
+           static_cast<unsigned long long>(calls), mMaxCallDepth);
+
+    std::vector<size_t> opCodes;
+    for (size_t i = 0; i < static_cast<size_t>(OpCode::_Count); i++) {
+        if (mOpCodes[i].count > 0) {
+            opCodes.push_back(i);
+        }
+    }
+    std::sort(opCodes.begin(), opCodes.end(), [this](size_t a, size_t b) { return mOpCodes[a].cycles > mOpCodes[b].cycles; });
+    printf("\n%-16s %12s %7s %14s %7s %10s\n", "opcode", "count", "%", clockUnit, "%", "per op");
+    for (size_t i : opCodes) {
+        const auto &opCode = mOpCodes[i];
+        printf("%-16s %12llu %6.2f%% %14llu %6.2f%% %10.2f\n", getOpCodeName(static_cast<OpCode>(i)),
+               static_cast<unsigned long long>(opCode.count), getPercent(opCode.count, instructions),
+               static_cast<unsigned long long>(opCode.cycles), getPercent(opCode.cycles, mTotalClock),
+               static_cast<double>(opCode.cycles) / opCode.count);
+    }
+
+    std::vector<std::pair<std::string, const FunctionProfile*>> functions;
+    for (const auto &function : mFunctions) {
+        std::string name = function.first != mEntry ? program.getFunctionName(function.first) : "<top level>";
+        functions.push_back({ name, &function.second });
+    }
+    std::sort(functions.begin(), functions.end(), [](const auto &a, const auto &b) {
+        return a.second->selfCycles > b.second->selfCycles;
+    });
+    printf("\n%-24s %10s %12s %14s %7s %14s %7s\n", "function", "calls", "instructions", "self", "%", "total", "%");
+    for (const auto &function : functions) {
+        const FunctionProfile &profile = *function.second;
+        printf("%-24s %10llu %12llu %14llu %6.2f%% %14llu %6.2f%%\n", function.first.data(),
+               static_cast<unsigned long long>(profile.calls), static_cast<unsigned long long>(profile.instructions),
+               static_cast<unsigned long long>(profile.selfCycles), getPercent(profile.selfCycles, mTotalClock),
+               static_cast<unsigned long long>(profile.totalCycles), getPercent(profile.totalCycles, mTotalClock));
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "Program.hpp"
+#include <chrono>
+#include <map>
+#include <vector>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define PROFILER_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROFILER_TSC 1
+#else
+#define PROFILER_TSC 0
+#endif
+
+// Time-stamp counter ticks where there is one, steady clock nanoseconds otherwise
+inline uint64_t readProfilerClock() {
+#if PROFILER_TSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+struct OpCodeProfile {
+    uint64_t count;
+    uint64_t cycles;
+};
+
+struct FunctionProfile {
+    uint64_t calls;
+    uint64_t instructions;
+    // Spent in the function's own instructions
+    uint64_t selfCycles;
+    // Spent between entry and return including callees, counted once for recursive activations
+    uint64_t totalCycles;
+    uint32_t activeCount;
+};
+
+// Counters filled by the profiled instantiation of the table loop. Every instruction reads the clock once and
+// charges the time since the previous read to the previous instruction, its opcode and its function.
+class Profiler {
+public:
+    Profiler();
+
+    void start(uint32_t entry);
+    void finish();
+    void print(const Program &program) const;
+
+    void step(OpCode opCode) {
+        uint64_t now = readProfilerClock();
+        uint64_t cycles = now - mLastClock;
+        mLastClock = now;
+        mOpCodes[static_cast<size_t>(mLastOpCode)].cycles += cycles;
+        mCurrent->selfCycles += cycles;
+        mOpCodes[static_cast<size_t>(opCode)].count++;
+        mCurrent->instructions++;
+        mLastOpCode = opCode;
+    }
+    // The callee runs in the interpreter from the next step on
+    void enterFunction(uint32_t entry);
+    // The callee ran as native code inside the call instruction, its time stays with the call
+    void countNativeCall(uint32_t entry);
+    void leaveFunction();
+
+private:
+    struct Activation {
+        FunctionProfile *function;
+        uint64_t startClock;
+    };
+
+    FunctionProfile &mGetFunction(uint32_t entry);
+
+    // One more entry for the time before the first instruction
+    OpCodeProfile mOpCodes[static_cast<size_t>(OpCode::_Count) + 1];
+    // Keyed by the instruction index of the function entry, map nodes keep the pointers below valid
+    std::map<uint32_t, FunctionProfile> mFunctions;
+    std::vector<Activation> mActivations;
+    FunctionProfile *mCurrent;
+    OpCode mLastOpCode;
+    uint64_t mLastClock;
+    uint64_t mStartClock;
+    uint64_t mTotalClock;
+    uint32_t mEntry;
+    size_t mMaxCallDepth;
+};
@@ -0,0 +1,567 @@
+#include "Program.hpp"
+#include "Verifier.hpp"
+#include "../Builtins.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+struct FusionRule {
+    OpCode fused;
+    std::vector<OpCode> pattern;
+};
+
+// Chosen from `VM --ngrams` over the compiled samples, these sequences make up most of the dispatches of
+// function bodies. Longer patterns come first so that they win over their own prefixes.
+static const FusionRule fusionRules[] = {
+    { OpCode::LoadLocal2Add, { OpCode::LoadLocal, OpCode::LoadLocal, OpCode::Add } },
+    { OpCode::LoadLocal2Sub, { OpCode::LoadLocal, OpCode::LoadLocal, OpCode::Sub } },
+    { OpCode::LoadLocal2Mul, { OpCode::LoadLocal, OpCode::LoadLocal, OpCode::Mul } },
+    { OpCode::LoadLocal2Div, { OpCode::LoadLocal, OpCode::LoadLocal, OpCode::Div } },
+    { OpCode::LoadLocalAdd, { OpCode::LoadLocal, OpCode::Add } },
+    { OpCode::LoadLocalSub, { OpCode::LoadLocal, OpCode::Sub } },
+    { OpCode::LoadLocalMul, { OpCode::LoadLocal, OpCode::Mul } },
+    { OpCode::LoadLocalDiv, { OpCode::LoadLocal, OpCode::Div } },
+    { OpCode::LoadLocal2, { OpCode::LoadLocal, OpCode::LoadLocal } },
+    { OpCode::StoreLocal2, { OpCode::StoreLocal, OpCode::StoreLocal } },
+    { OpCode::PushLoadLocal, { OpCode::Push, OpCode::LoadLocal } }
+};
+
+bool isCodeAddressOpCode(OpCode opCode) {
+    return opCode == OpCode::Jmp || opCode == OpCode::Call || opCode == OpCode::RegCall ||
+           opCode == OpCode::TailCall || opCode == OpCode::RegTailCall;
+}
+
+const char *getOpCodeName(OpCode opCode) {
+    static const char *names[] = {
+        "jmp", "call", "ret", "add", "sub", "mul", "div", "push", "pop", "set", "get", "unset", "int",
+        "enter", "loadlocal", "storelocal", "loadouter",
+        "r.loadk", "r.mov", "r.add", "r.sub", "r.mul", "r.div", "r.loadouter", "r.call", "r.ret", "r.print",
+        "r.tailcall", "tailcall", "r.native", "native", "memo", "vec", "vdot", "vsum", "r.vec", "r.vdot", "r.vsum", "neg", "r.neg",
+        "loadlocal2", "loadlocal.add", "loadlocal.sub", "loadlocal.mul", "loadlocal.div",
+        "loadlocal2.add", "loadlocal2.sub", "loadlocal2.mul", "loadlocal2.div", "storelocal2", "push.loadlocal", "memo.return"
+    };
+    static_assert(sizeof(names)/sizeof(names[0]) == static_cast<size_t>(OpCode::_Count), "names must cover every opcode");
+    return opCode < OpCode::_Count ? names[static_cast<size_t>(opCode)] : "halt";
+}
+
+Program::Program(BytecodeView bc, bool isFusionEnabled) {
+    mScopesCount = 1;
+    mEntry = 0;
+    mCodeSize = 0;
+    mIsVerified = false;
+    mHasNamedVars = false;
+    mHasVectors = false;
+    mMemoReturn = UINT32_MAX;
+    mHeader = {};
+    // FNV-1a
+    mFingerprint = 14695981039346656037ull;
+    for (size_t i = 0; i < bc.size; i++) {
+        mFingerprint = (mFingerprint ^ bc.data[i])*1099511628211ull;
+    }
+    mFingerprint = (mFingerprint ^ static_cast<uint64_t>(isFusionEnabled))*1099511628211ull;
+    try {
+        mLoad(bc);
+        // Fused code has the same control flow and stack effects, so verifying the decoded form is enough
+        Verifier verifier(mCode, mOffsets, mHeader, mEntry);
+        mIsVerified = verifier.verify();
+        mVerifyError = verifier.getError();
+        for (auto &function : mFunctions) {
+            function.isVerified = mIsVerified && verifier.verifyHostCall(function.entry);
+        }
+        if (isFusionEnabled) {
+            mFuse();
+        }
+    }
+    catch (...) {
+        mHeader = {};
+        mCode.clear();
+        mOffsets.clear();
+        mScopesCount = 1;
+        mEntry = 0;
+        mCodeSize = 0;
+        mSymbols.clear();
+        mFunctions.clear();
+        mIsVerified = false;
+    }
+    // Constants are copied into the instructions that use them
+    mConstants.clear();
+    mConstants.shrink_to_fit();
+
+    // Both dispatch loops stop on this sentinel instead of checking mIP against the code size on every instruction
+    Instruction halt = {};
+    halt.opCode = OpCode::_Count;
+    mCode.push_back(halt);
+    mOffsets.push_back(mCodeSize);
+    bool hasMemo = std::any_of(mCode.begin(), mCode.end(), [](const Instruction &ins) { return ins.opCode == OpCode::Memo; });
+    if (hasMemo) {
+        // Out of reach of the program itself, only the return addresses set by Memo lead there
+        Instruction memoReturn = {};
+        memoReturn.opCode = OpCode::MemoReturn;
+        mMemoReturn = static_cast<uint32_t>(mCode.size());
+        mCode.push_back(memoReturn);
+        mOffsets.push_back(mCodeSize);
+        mCode.push_back(halt);
+        mOffsets.push_back(mCodeSize);
+    }
+}
+
+const std::vector<Instruction> &Program::getCode() const {
+    return mCode;
+}
+
+const std::vector<uint32_t> &Program::getOffsets() const {
+    return mOffsets;
+}
+
+const BytecodeHeader &Program::getHeader() const {
+    return mHeader;
+}
+
+size_t Program::getScopesCount() const {
+    return mScopesCount;
+}
+
+uint32_t Program::getEntry() const {
+    return mEntry;
+}
+
+const std::vector<std::string> &Program::getSymbols() const {
+    return mSymbols;
+}
+
+const std::vector<ProgramFunction> &Program::getFunctions() const {
+    return mFunctions;
+}
+
+const ProgramFunction *Program::findFunction(const std::string &name) const {
+    for (const auto &function : mFunctions) {
+        if (function.name == name) {
+            return &function;
+        }
+    }
+    return nullptr;
+}
+
+std::string Program::getFunctionName(uint32_t entry) const {
+    uint32_t offset = entry < mOffsets.size() ? mOffsets[entry] : 0;
+    for (const auto &function : mFunctions) {
+        if (function.address == offset) {
+            return function.name;
+        }
+    }
+    return "@" + std::to_string(offset);
+}
+
+bool Program::hasNamedVars() const {
+    return mHasNamedVars;
+}
+
+bool Program::hasVectors() const {
+    return mHasVectors;
+}
+
+bool Program::isVerified() const {
+    return mIsVerified;
+}
+
+const std::string &Program::getVerifyError() const {
+    return mVerifyError;
+}
+
+uint32_t Program::getMemoReturn() const {
+    return mMemoReturn;
+}
+
+uint64_t Program::getFingerprint() const {
+    return mFingerprint;
+}
+
+void Program::mLoad(BytecodeView bc) {
+    if (bc.size < sizeof(mHeader)) {
+        mError("bytecode header is missing", 0);
+    }
+    memcpy(&mHeader, bc.data, sizeof(mHeader));
+    if (mHeader.magic != BytecodeMagic) {
+        mError("invalid bytecode magic", 0);
+    }
+    if (mHeader.version != BytecodeVersion) {
+        mError("unsupported bytecode version '" + std::to_string(mHeader.version) + "'", 0);
+    }
+    if (bc.size > UINT32_MAX) {
+        mError("bytecode is too large", 0);
+    }
+    if (mHeader.sectionsCount > (bc.size - sizeof(mHeader)) / sizeof(SectionEntry)) {
+        mError("section table is truncated", 0);
+    }
+    std::vector<SectionEntry> sections(mHeader.sectionsCount);
+    if (!sections.empty()) {
+        memcpy(sections.data(), bc.data + sizeof(mHeader), sections.size()*sizeof(SectionEntry));
+    }
+
+    BytecodeView constants = mGetSection(bc, sections, SectionType::Constants);
+    if (constants.size % sizeof(double) != 0) {
+        mError("constants section size is not a multiple of 8", 0);
+    }
+    mConstants.resize(constants.size / sizeof(double));
+    if (!mConstants.empty()) {
+        memcpy(mConstants.data(), constants.data, constants.size);
+    }
+
+    BytecodeView symbols = mGetSection(bc, sections, SectionType::Symbols);
+    if (symbols.size > 0 && symbols.data[symbols.size - 1] != 0) {
+        mError("symbols section is not null-terminated", 0);
+    }
+    for (size_t pos = 0; pos < symbols.size;) {
+        mSymbols.push_back(reinterpret_cast<const char*>(symbols.data + pos));
+        pos += mSymbols.back().size() + 1;
+    }
+
+    BytecodeView functions = mGetSection(bc, sections, SectionType::Functions);
+    if (functions.size % sizeof(FunctionEntry) != 0) {
+        mError("functions section size is not a multiple of " + std::to_string(sizeof(FunctionEntry)), 0);
+    }
+    for (size_t pos = 0; pos < functions.size; pos += sizeof(FunctionEntry)) {
+        FunctionEntry function;
+        memcpy(&function, functions.data + pos, sizeof(function));
+        if (function.name >= mSymbols.size()) {
+            mError("function name '" + std::to_string(function.name) + "' is out of the symbols", 0);
+        }
+        mFunctions.push_back({ mSymbols[function.name], function.address, 0, false });
+    }
+
+    BytecodeView code = mGetSection(bc, sections, SectionType::Code);
+    if (!code.data) {
+        mError("code section is missing", 0);
+    }
+    mCodeSize = static_cast<uint32_t>(code.size);
+    mDecode(code.data, mCodeSize);
+
+    // Every VM allocates the header capacities up front, so they can't be more than the code could ever use:
+    // a call level per instruction unless the program recurses, at most a value per instruction and the largest
+    // frame per level
+    uint64_t levelsCount = static_cast<uint64_t>(mHeader.callDepth) + 1;
+    uint64_t largestFrame = 0;
+    for (const auto &ins : mCode) {
+        if (ins.opCode == OpCode::Enter) {
+            largestFrame = std::max<uint64_t>(largestFrame, ins.size);
+        }
+    }
+    if (mHeader.callDepth > std::max<uint64_t>(DefaultMaxCallDepth, mCode.size())) {
+        mError("header call depth " + std::to_string(mHeader.callDepth) + " is too large", 0);
+    }
+    if (mHeader.stackDepth > MaxStackDepth || mHeader.stackDepth > levelsCount*(mCode.size() + 1)) {
+        mError("header stack depth " + std::to_string(mHeader.stackDepth) + " is too large", 0);
+    }
+    if (mHeader.frameSlots > MaxFrameSlots || mHeader.frameSlots > levelsCount*largestFrame) {
+        mError("header frame slots " + std::to_string(mHeader.frameSlots) + " are too many", 0);
+    }
+}
+
+BytecodeView Program::mGetSection(BytecodeView bc, const std::vector<SectionEntry> &sections, SectionType type) {
+    BytecodeView view(nullptr, 0);
+    for (const auto &section : sections) {
+        if (section.type != type) {
+            continue;
+        }
+        if (view.data) {
+            mError("duplicate section '" + std::to_string(static_cast<uint32_t>(type)) + "'", 0);
+        }
+        if (section.offset > bc.size || section.size > bc.size - section.offset) {
+            mError("section '" + std::to_string(static_cast<uint32_t>(type)) + "' is out of the file", 0);
+        }
+        view = BytecodeView(bc.data + section.offset, section.size);
+    }
+    return view;
+}
+
+void Program::mDecode(const uint8_t *code, uint32_t size) {
+    mScopesCount = 1;
+    bool isRegister = (mHeader.flags & static_cast<uint16_t>(BytecodeFlags::Register)) != 0;
+
+    // Byte offset -> instruction index, used to relocate jump targets
+    std::vector<uint32_t> indices(size + 1, UINT32_MAX);
+    uint32_t pos = 0;
+    while (pos < size) {
+        uint32_t offset = pos;
+        indices[offset] = static_cast<uint32_t>(mCode.size());
+
+        Instruction ins = {};
+        ins.opCode = static_cast<OpCode>(code[pos++]);
+        switch (ins.opCode) {
+            case OpCode::Jmp:
+            case OpCode::Call:
+            case OpCode::TailCall: {
+                ins.address = mGetValue<LabelAddress>(code, size, pos);
+                break;
+            }
+            case OpCode::RegCall: {
+                ins.address = mGetValue<LabelAddress>(code, size, pos);
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[1] = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::RegTailCall: {
+                ins.address = mGetValue<LabelAddress>(code, size, pos);
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[1] = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::RegNative: {
+                ins.id = mGetBuiltin(mGetValue<uint32_t>(code, size, pos), offset);
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[1] = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::Native: {
+                ins.id = mGetBuiltin(mGetValue<uint32_t>(code, size, pos), offset);
+                break;
+            }
+            case OpCode::RegLoadK: {
+                ins.slot = mGetValue<SlotIndex>(code, size, pos);
+                ins.value = mGetConstant(mGetValue<uint32_t>(code, size, pos), offset);
+                break;
+            }
+            case OpCode::RegAdd:
+            case OpCode::RegSub:
+            case OpCode::RegMul:
+            case OpCode::RegDiv: {
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[1] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[2] = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::RegMove: {
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[1] = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::RegLoadOuter: {
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                ins.scope = mGetValue<ScopeIndex>(code, size, pos);
+                ins.slot = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::RegRet:
+            case OpCode::RegPrint: {
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::Push: {
+                ins.value = mGetConstant(mGetValue<uint32_t>(code, size, pos), offset);
+                break;
+            }
+            case OpCode::Set:
+            case OpCode::Get:
+            case OpCode::Unset: {
+                ins.symbol = mGetValue<uint32_t>(code, size, pos);
+                if (ins.symbol >= mSymbols.size()) {
+                    mError("symbol '" + std::to_string(ins.symbol) + "' is out of the symbols", offset);
+                }
+                mHasNamedVars = true;
+                break;
+            }
+            case OpCode::Int: {
+                ins.id = mGetValue<uint8_t>(code, size, pos);
+                break;
+            }
+            case OpCode::Enter: {
+                ins.scope = mGetValue<ScopeIndex>(code, size, pos);
+                ins.size = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::Memo: {
+                ins.size = mGetValue<SlotIndex>(code, size, pos);
+                if (ins.size > MaxMemoArgsCount) {
+                    mError("memo of " + std::to_string(ins.size) + " arguments, at most " + std::to_string(MaxMemoArgsCount) +
+                           " are supported", offset);
+                }
+                break;
+            }
+            case OpCode::Vec: {
+                ins.size = mGetValue<SlotIndex>(code, size, pos);
+                if (ins.size == 0) {
+                    mError("vec of no elements", offset);
+                }
+                mHasVectors = true;
+                break;
+            }
+            case OpCode::RegVec: {
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[1] = mGetValue<SlotIndex>(code, size, pos);
+                ins.size = mGetValue<SlotIndex>(code, size, pos);
+                if (ins.size == 0) {
+                    mError("vec of no elements", offset);
+                }
+                mHasVectors = true;
+                break;
+            }
+            case OpCode::RegVecDot: {
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[1] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[2] = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::RegVecSum:
+            case OpCode::RegNeg: {
+                ins.regs[0] = mGetValue<SlotIndex>(code, size, pos);
+                ins.regs[1] = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::LoadLocal:
+            case OpCode::StoreLocal: {
+                ins.slot = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::LoadOuter: {
+                ins.scope = mGetValue<ScopeIndex>(code, size, pos);
+                ins.slot = mGetValue<SlotIndex>(code, size, pos);
+                break;
+            }
+            case OpCode::Ret:
+            case OpCode::Add:
+            case OpCode::Sub:
+            case OpCode::Mul:
+            case OpCode::Div:
+            case OpCode::VecDot:
+            case OpCode::VecSum:
+            case OpCode::Neg:
+            case OpCode::Pop: {
+                break;
+            }
+            default: {
+                mError("unknown opcode '" + std::to_string(static_cast<uint32_t>(ins.opCode)) + "'", offset);
+            }
+        }
+        // Jmp, Enter and Memo are shared, every other opcode belongs to exactly one engine
+        bool isRegisterOpCode = (ins.opCode >= OpCode::RegLoadK && ins.opCode <= OpCode::RegTailCall) ||
+                                ins.opCode == OpCode::RegNative ||
+                                (ins.opCode >= OpCode::RegVec && ins.opCode <= OpCode::RegVecSum) || ins.opCode == OpCode::RegNeg;
+        bool isSharedOpCode = ins.opCode == OpCode::Jmp || ins.opCode == OpCode::Enter || ins.opCode == OpCode::Memo;
+        if (!isSharedOpCode && isRegisterOpCode != isRegister) {
+            mError("opcode '" + std::to_string(static_cast<uint32_t>(ins.opCode)) + "' doesn't belong to the " +
+                   (isRegister ? "register" : "stack") + " engine", offset);
+        }
+        mScopesCount = std::max(mScopesCount, static_cast<size_t>(ins.scope) + 1);
+        mCode.push_back(ins);
+        mOffsets.push_back(offset);
+    }
+    indices[size] = static_cast<uint32_t>(mCode.size());
+
+    for (size_t i = 0; i < mCode.size(); i++) {
+        auto &ins = mCode[i];
+        if (isCodeAddressOpCode(ins.opCode)) {
+            if (ins.address > size || indices[ins.address] == UINT32_MAX) {
+                mError("invalid jump address '" + std::to_string(ins.address) + "'", mOffsets[i]);
+            }
+            ins.address = indices[ins.address];
+        }
+    }
+    if (mHeader.entry > size || indices[mHeader.entry] == UINT32_MAX) {
+        mError("invalid entry address '" + std::to_string(mHeader.entry) + "'", 0);
+    }
+    mEntry = indices[mHeader.entry];
+    for (auto &function : mFunctions) {
+        if (function.address >= size || indices[function.address] == UINT32_MAX) {
+            mError("invalid address '" + std::to_string(function.address) + "' of function '" + function.name + "'", 0);
+        }
+        function.entry = indices[function.address];
+    }
+}
+
+uint8_t Program::mGetBuiltin(uint32_t symbol, uint32_t offset) {
+    if (symbol >= mSymbols.size()) {
+        mError("symbol '" + std::to_string(symbol) + "' is out of the symbols", offset);
+    }
+    size_t builtin = findBuiltin(mSymbols[symbol].data());
+    if (builtin == BuiltinsCount) {
+        mError("unknown builtin '" + mSymbols[symbol] + "'", offset);
+    }
+    return static_cast<uint8_t>(builtin);
+}
+
+double Program::mGetConstant(uint32_t index, uint32_t offset) {
+    if (index >= mConstants.size()) {
+        mError("constant '" + std::to_string(index) + "' is out of the pool", offset);
+    }
+    return mConstants[index];
+}
+
+void Program::mFuse() {
+    // A sequence may start at a jump target but must not run into one
+    std::vector<bool> isTarget(mCode.size() + 1, false);
+    for (const auto &ins : mCode) {
+        if (isCodeAddressOpCode(ins.opCode)) {
+            isTarget[ins.address] = true;
+        }
+    }
+
+    std::vector<Instruction> code;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> indices(mCode.size() + 1);
+    size_t i = 0;
+    while (i < mCode.size()) {
+        const FusionRule *match = nullptr;
+        for (const auto &rule : fusionRules) {
+            size_t length = rule.pattern.size();
+            if (i + length > mCode.size()) {
+                continue;
+            }
+            bool isMatch = true;
+            for (size_t j = 0; j < length && isMatch; j++) {
+                isMatch = mCode[i + j].opCode == rule.pattern[j] && (j == 0 || !isTarget[i + j]);
+            }
+            if (isMatch) {
+                match = &rule;
+                break;
+            }
+        }
+
+        indices[i] = static_cast<uint32_t>(code.size());
+        if (!match) {
+            code.push_back(mCode[i]);
+            offsets.push_back(mOffsets[i]);
+            i++;
+            continue;
+        }
+
+        Instruction fused = {};
+        fused.opCode = match->fused;
+        size_t slotsCount = 0;
+        for (size_t j = 0; j < match->pattern.size(); j++) {
+            const auto &ins = mCode[i + j];
+            if (ins.opCode == OpCode::Push) {
+                fused.value = ins.value;
+            }
+            else if (ins.opCode == OpCode::LoadLocal || ins.opCode == OpCode::StoreLocal) {
+                if (slotsCount++ == 0) {
+                    fused.slot = ins.slot;
+                }
+                else {
+                    fused.regs[0] = static_cast<SlotIndex>(ins.slot);
+                }
+            }
+        }
+        code.push_back(fused);
+        offsets.push_back(mOffsets[i]);
+        i += match->pattern.size();
+    }
+    indices[mCode.size()] = static_cast<uint32_t>(code.size());
+    mEntry = indices[mEntry];
+    for (auto &function : mFunctions) {
+        function.entry = indices[function.entry];
+    }
+
+    for (auto &ins : code) {
+        if (isCodeAddressOpCode(ins.opCode)) {
+            ins.address = indices[ins.address];
+        }
+    }
+    mCode = std::move(code);
+    mOffsets = std::move(offsets);
+}
+
+void Program::mError(const std::string &text, uint32_t offset) {
+    printf("RuntimeError(%d): %s\n", offset, text.data());
+    throw std::runtime_error("runtime error");
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include "../Bytecode.hpp"
+#include "Instruction.hpp"
+#include <vector>
+#include <string>
+#include <cstring>
+
+const char *getOpCodeName(OpCode opCode);
+// Jmp and the calls, the opcodes whose address operand is relocated to an instruction index
+bool isCodeAddressOpCode(OpCode opCode);
+
+// Bytecode that the caller keeps alive while a Program is built from it: a vector, a mapped file or any buffer.
+// Nothing refers to it once the constructor returns.
+struct BytecodeView {
+    BytecodeView(const uint8_t *data, size_t size) : data(data), size(size) {}
+    BytecodeView(const std::vector<uint8_t> &bc) : data(bc.data()), size(bc.size()) {}
+
+    const uint8_t *data;
+    size_t size;
+};
+
+// Named function of the program, address is the code address the Translator gave its label
+struct ProgramFunction {
+    std::string name;
+    uint32_t address;
+    // Instruction index of the first instruction
+    uint32_t entry;
+    // A host call of the function runs without the runtime checks, see VM::call
+    bool isVerified;
+};
+
+// Decoded bytecode, read-only after construction so that one Program can be shared by any number of VMs.
+// A program that fails to load holds only the halt sentinel.
+class Program {
+public:
+    Program(BytecodeView bc, bool isFusionEnabled = true);
+
+    const std::vector<Instruction> &getCode() const;
+    const std::vector<uint32_t> &getOffsets() const;
+    const BytecodeHeader &getHeader() const;
+    size_t getScopesCount() const;
+    // Instruction index the program starts at
+    uint32_t getEntry() const;
+    // Names of the variables and functions, Set/Get/Unset refer to them by index
+    const std::vector<std::string> &getSymbols() const;
+    // Whether any Set/Get/Unset is in the code, otherwise a VM needs no variable stacks
+    bool hasNamedVars() const;
+    // Whether any Vec/RegVec is in the code, such a program may hold vector values
+    bool hasVectors() const;
+    const std::vector<ProgramFunction> &getFunctions() const;
+    // Returns nullptr if the program has no function with this name
+    const ProgramFunction *findFunction(const std::string &name) const;
+    // Label name of the function entered at an instruction index, or @offset if it has none
+    std::string getFunctionName(uint32_t entry) const;
+    // A verified program runs without the per-instruction checks
+    bool isVerified() const;
+    const std::string &getVerifyError() const;
+    // Instruction index of the MemoReturn behind the halt sentinel, UINT32_MAX if the program has no Memo
+    uint32_t getMemoReturn() const;
+    // Hash of the bytecode and of whether it was fused, instruction indices saved by a VM are only valid for
+    // a program with the same fingerprint
+    uint64_t getFingerprint() const;
+
+private:
+    template<typename T>
+    T mGetValue(const uint8_t *code, uint32_t size, uint32_t &pos) {
+        if (size - pos < sizeof(T)) {
+            mError("unexpected end of bytecode", pos);
+        }
+        T value;
+        memcpy(&value, code + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    void mLoad(BytecodeView bc);
+    BytecodeView mGetSection(BytecodeView bc, const std::vector<SectionEntry> &sections, SectionType type);
+    void mDecode(const uint8_t *code, uint32_t size);
+    uint8_t mGetBuiltin(uint32_t symbol, uint32_t offset);
+    double mGetConstant(uint32_t index, uint32_t offset);
+    void mFuse();
+    void mError(const std::string &text, uint32_t offset);
+
+    std::vector<Instruction> mCode;
+    std::vector<uint32_t> mOffsets;
+    BytecodeHeader mHeader;
+    size_t mScopesCount;
+    uint32_t mEntry;
+    uint32_t mCodeSize;
+    std::vector<double> mConstants;
+    std::vector<std::string> mSymbols;
+    std::vector<ProgramFunction> mFunctions;
+    bool mIsVerified;
+    bool mHasNamedVars;
+    bool mHasVectors;
+    uint32_t mMemoReturn;
+    std::string mVerifyError;
+    uint64_t mFingerprint;
+};
@@ -0,0 +1,117 @@
+#include "Scheduler.hpp"
+#include <algorithm>
+
+Scheduler::Scheduler(size_t threadsCount, uint64_t sliceFuel) {
+    mSliceFuel = std::max<uint64_t>(sliceFuel, 1);
+    mActiveCount = 0;
+    mSlicesCount = 0;
+    mIsStopping = false;
+    threadsCount = std::max<size_t>(threadsCount, 1);
+    for (size_t i = 0; i < threadsCount; i++) {
+        mThreads.emplace_back(&Scheduler::mWorkerLoop, this);
+    }
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mIsStopping = true;
+    }
+    mQueueCondition.notify_all();
+    for (auto &thread : mThreads) {
+        thread.join();
+    }
+}
+
+size_t Scheduler::getThreadsCount() const {
+    return mThreads.size();
+}
+
+TaskId Scheduler::spawn(std::unique_ptr<VM> vm, uint64_t fuelLimit) {
+    TaskId id;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        id = mTasks.size();
+        mTasks.push_back({ std::move(vm), fuelLimit, TaskState::Queued, false });
+        mQueue.push_back(&mTasks.back());
+        mActiveCount++;
+    }
+    mQueueCondition.notify_one();
+    return id;
+}
+
+void Scheduler::cancel(TaskId id) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto &task = mTasks[id];
+    if (task.state == TaskState::Queued) {
+        mQueue.erase(std::find(mQueue.begin(), mQueue.end(), &task));
+        mFinishTask(task, TaskState::Cancelled);
+    }
+    else if (task.state == TaskState::Running) {
+        task.isCancelling = true;
+    }
+}
+
+TaskState Scheduler::getState(TaskId id) const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mTasks[id].state;
+}
+
+VM &Scheduler::getVM(TaskId id) {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return *mTasks[id].vm;
+}
+
+void Scheduler::wait() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDoneCondition.wait(lock, [this]() { return mActiveCount == 0; });
+}
+
+uint64_t Scheduler::getSlicesCount() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSlicesCount;
+}
+
+void Scheduler::mWorkerLoop() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        mQueueCondition.wait(lock, [this]() { return mIsStopping || !mQueue.empty(); });
+        if (mIsStopping) {
+            return;
+        }
+        Task &task = *mQueue.front();
+        mQueue.pop_front();
+        task.state = TaskState::Running;
+        uint64_t fuel = std::min(mSliceFuel, task.fuelLeft);
+        lock.unlock();
+
+        // The task is only touched by this thread while it runs, cancel() just marks it
+        uint64_t executedCount = task.vm->getExecutedCount();
+        RunState state = task.vm->run(fuel);
+        executedCount = task.vm->getExecutedCount() - executedCount;
+
+        lock.lock();
+        mSlicesCount++;
+        task.fuelLeft -= std::min(executedCount, task.fuelLeft);
+        if (state == RunState::Finished) {
+            mFinishTask(task, TaskState::Finished);
+        }
+        else if (state == RunState::Failed) {
+            mFinishTask(task, TaskState::Failed);
+        }
+        else if (task.isCancelling || task.fuelLeft == 0) {
+            mFinishTask(task, TaskState::Cancelled);
+        }
+        else {
+            task.state = TaskState::Queued;
+            mQueue.push_back(&task);
+        }
+    }
+}
+
+void Scheduler::mFinishTask(Task &task, TaskState state) {
+    task.state = state;
+    if (--mActiveCount == 0) {
+        mDoneCondition.notify_all();
+    }
+}
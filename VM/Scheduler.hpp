@@ -0,0 +1,71 @@
+#pragma once
+#include "VM.hpp"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Instructions a VM runs before it goes back to the end of the queue: a fair share for a few microseconds of work,
+// while the queue costs one lock per slice
+const uint64_t DefaultSliceFuel = 10000;
+
+enum class TaskState {
+    Queued,
+    Running,
+    Finished,
+    Failed,
+    Cancelled
+};
+
+using TaskId = size_t;
+
+// Multiplexes any number of VMs over a fixed set of threads. A VM runs sliceFuel instructions with VM::run(fuel)
+// and goes to the back of a single FIFO queue, so every runnable VM gets the same share of the threads and a script
+// that never ends only slows the others down. The VMs keep all of their state between slices, a thread holds none.
+class Scheduler {
+public:
+    Scheduler(size_t threadsCount = std::thread::hardware_concurrency(), uint64_t sliceFuel = DefaultSliceFuel);
+    // Stops the threads once their current slices are done, queued VMs are not run any further
+    ~Scheduler();
+    Scheduler(const Scheduler&) = delete;
+    Scheduler &operator=(const Scheduler&) = delete;
+
+    size_t getThreadsCount() const;
+    // The VM goes on from its current state, start() it first for a fresh run. A task that runs fuelLimit
+    // instructions without finishing is cancelled.
+    TaskId spawn(std::unique_ptr<VM> vm, uint64_t fuelLimit = UINT64_MAX);
+    // A queued task is dropped at once, a running one at the end of its slice
+    void cancel(TaskId id);
+    TaskState getState(TaskId id) const;
+    // Only safe to use once the task is no longer queued or running
+    VM &getVM(TaskId id);
+    // Blocks until every task spawned so far is finished, failed or cancelled
+    void wait();
+    uint64_t getSlicesCount() const;
+
+private:
+    struct Task {
+        std::unique_ptr<VM> vm;
+        uint64_t fuelLeft;
+        TaskState state;
+        bool isCancelling;
+    };
+
+    void mWorkerLoop();
+    void mFinishTask(Task &task, TaskState state);
+
+    uint64_t mSliceFuel;
+    std::vector<std::thread> mThreads;
+    mutable std::mutex mMutex;
+    std::condition_variable mQueueCondition;
+    std::condition_variable mDoneCondition;
+    // A deque keeps the tasks in place as more are spawned, the queue refers to them
+    std::deque<Task> mTasks;
+    std::deque<Task*> mQueue;
+    // Tasks queued or running
+    size_t mActiveCount;
+    uint64_t mSlicesCount;
+    bool mIsStopping;
+};
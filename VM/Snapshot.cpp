@@ -0,0 +1,201 @@
+#include "VM.hpp"
+#include <algorithm>
+
+// Byte offsets of the arrays that follow the header, the last one is the total size
+struct SnapshotLayout {
+    size_t stack;
+    size_t frames;
+    size_t varValues;
+    size_t vectorValues;
+    size_t calls;
+    size_t scopeFrames;
+    size_t varDepths;
+    size_t vectorLengths;
+    size_t size;
+};
+
+static SnapshotLayout getSnapshotLayout(const SnapshotHeader &header) {
+    auto align = [](size_t offset) { return (offset + 7) & ~static_cast<size_t>(7); };
+    SnapshotLayout layout;
+    layout.stack = align(sizeof(SnapshotHeader));
+    layout.frames = align(layout.stack + header.stackSize*sizeof(double));
+    layout.varValues = align(layout.frames + header.frameTop*sizeof(double));
+    layout.vectorValues = align(layout.varValues + static_cast<size_t>(header.varValuesCount)*sizeof(double));
+    layout.calls = align(layout.vectorValues + static_cast<size_t>(header.vectorValuesCount)*sizeof(double));
+    layout.scopeFrames = align(layout.calls + header.callsCount*sizeof(SnapshotCall));
+    layout.varDepths = align(layout.scopeFrames + header.scopesCount*sizeof(uint32_t));
+    layout.vectorLengths = align(layout.varDepths + header.varsCount*sizeof(uint32_t));
+    layout.size = align(layout.vectorLengths + static_cast<size_t>(header.vectorsCount)*sizeof(uint32_t));
+    return layout;
+}
+
+std::vector<uint8_t> VM::saveSnapshot() const {
+    SnapshotHeader header = {};
+    header.magic = SnapshotMagic;
+    header.version = SnapshotVersion;
+    header.programFingerprint = mProgram->getFingerprint();
+    header.executedCount = mExecutedCount;
+    // A finished VM has already stepped past a halt sentinel, resuming on it stops at once all the same.
+    // A paused one only stands behind a sentinel when a Ret has just gone to MemoReturn.
+    const auto &code = mProgram->getCode();
+    bool isHalted = mRunState != RunState::Paused && mIP > 0 && mIP <= code.size() && code[mIP - 1].opCode == OpCode::_Count;
+    header.ip = isHalted ? mIP - 1 : mIP;
+    // The memo calls aren't saved, calls waiting for MemoReturn go back to their real return address and
+    // their results are just not remembered
+    auto memoCall = mMemoCalls.rbegin();
+    if (header.ip == mProgram->getMemoReturn()) {
+        header.ip = (memoCall++)->retIP;
+    }
+    header.frameBase = mFrameBase;
+    // Frames above the top belong to calls that already returned
+    header.frameTop = mFrameTop;
+    header.stackSize = static_cast<uint32_t>(mSP - mStack.data());
+    header.callsCount = static_cast<uint32_t>(mRP - mRetStack.data() + 1);
+    header.scopesCount = static_cast<uint32_t>(mScopeFrames.size());
+    header.varsCount = static_cast<uint32_t>(mVars.size());
+    std::vector<double> varValues;
+    std::vector<uint32_t> varDepths;
+    for (auto var : mVars) {
+        // Bottom of the stack first, so that restoring pushes them back in order
+        size_t begin = varValues.size();
+        varDepths.push_back(static_cast<uint32_t>(var.size()));
+        for (; !var.empty(); var.pop()) {
+            varValues.push_back(var.top());
+        }
+        std::reverse(varValues.begin() + begin, varValues.end());
+    }
+    header.varValuesCount = static_cast<uint32_t>(varValues.size());
+    std::vector<double> vectorValues;
+    std::vector<uint32_t> vectorLengths;
+    for (size_t i = 0; i < mVectorPool.getCount(); i++) {
+        const VectorRef *vector = mVectorPool.find(makeVectorValue(static_cast<uint32_t>(i)));
+        vectorLengths.push_back(vector->length);
+        vectorValues.insert(vectorValues.end(), vector->data, vector->data + vector->length);
+    }
+    header.vectorsCount = static_cast<uint32_t>(vectorLengths.size());
+    header.vectorValuesCount = static_cast<uint32_t>(vectorValues.size());
+    std::vector<SnapshotCall> calls;
+    for (const CallFrame *rp = mRP; rp >= mRetStack.data(); rp--) {
+        uint32_t retIP = rp->retIP == mProgram->getMemoReturn() ? (memoCall++)->retIP : rp->retIP;
+        calls.push_back({ retIP, rp->frameBase, rp->frameTop, rp->scopeFrame, rp->scope, rp->retSlot });
+    }
+    std::reverse(calls.begin(), calls.end());
+
+    SnapshotLayout layout = getSnapshotLayout(header);
+    std::vector<uint8_t> snapshot(layout.size, 0);
+    auto write = [&](size_t offset, const void *data, size_t size) {
+        if (size > 0) {
+            memcpy(snapshot.data() + offset, data, size);
+        }
+    };
+    write(0, &header, sizeof(header));
+    write(layout.stack, mStack.data(), header.stackSize*sizeof(double));
+    write(layout.frames, mFrames.data(), header.frameTop*sizeof(double));
+    write(layout.varValues, varValues.data(), varValues.size()*sizeof(double));
+    write(layout.vectorValues, vectorValues.data(), vectorValues.size()*sizeof(double));
+    write(layout.calls, calls.data(), calls.size()*sizeof(SnapshotCall));
+    write(layout.scopeFrames, mScopeFrames.data(), mScopeFrames.size()*sizeof(uint32_t));
+    write(layout.varDepths, varDepths.data(), varDepths.size()*sizeof(uint32_t));
+    write(layout.vectorLengths, vectorLengths.data(), vectorLengths.size()*sizeof(uint32_t));
+    return snapshot;
+}
+
+bool VM::loadSnapshot(BytecodeView snapshot) {
+    SnapshotHeader header;
+    if (snapshot.size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, snapshot.data, sizeof(header));
+    // Everything is checked before the state is touched, a snapshot is trusted no more than bytecode is
+    if (header.magic != SnapshotMagic || header.version != SnapshotVersion ||
+        header.programFingerprint != mProgram->getFingerprint() || header.ip >= mProgram->getCode().size() ||
+        header.ip == mProgram->getMemoReturn() ||
+        header.stackSize > mStack.size() || header.callsCount == 0 || header.callsCount > mRetStack.size() ||
+        header.frameTop > mFrames.size() || header.frameBase > header.frameTop ||
+        header.scopesCount != mScopeFrames.size() || header.varsCount != mVars.size()) {
+        return false;
+    }
+    SnapshotLayout layout = getSnapshotLayout(header);
+    if (snapshot.size < layout.size) {
+        return false;
+    }
+    const uint8_t *data = snapshot.data;
+    std::vector<SnapshotCall> calls(header.callsCount);
+    memcpy(calls.data(), data + layout.calls, calls.size()*sizeof(SnapshotCall));
+    // Frame bases are read without checks by verified code, none may point past the frames
+    auto isFrameValid = [&](uint32_t base) { return base == UINT32_MAX || base <= mFrames.size(); };
+    for (const auto &call : calls) {
+        if (call.retIP >= mProgram->getCode().size() || call.retIP == mProgram->getMemoReturn() || call.frameBase > call.frameTop || call.frameTop > mFrames.size() ||
+            call.scope >= mScopeFrames.size() || !isFrameValid(call.scopeFrame)) {
+            return false;
+        }
+    }
+    std::vector<uint32_t> scopeFrames(header.scopesCount);
+    memcpy(scopeFrames.data(), data + layout.scopeFrames, scopeFrames.size()*sizeof(uint32_t));
+    if (!std::all_of(scopeFrames.begin(), scopeFrames.end(), isFrameValid)) {
+        return false;
+    }
+    std::vector<uint32_t> varDepths(header.varsCount);
+    if (!varDepths.empty()) {
+        memcpy(varDepths.data(), data + layout.varDepths, varDepths.size()*sizeof(uint32_t));
+    }
+    uint64_t varValuesCount = 0;
+    for (uint32_t depth : varDepths) {
+        varValuesCount += depth;
+    }
+    if (varValuesCount != header.varValuesCount) {
+        return false;
+    }
+    std::vector<uint32_t> vectorLengths(header.vectorsCount);
+    if (!vectorLengths.empty()) {
+        memcpy(vectorLengths.data(), data + layout.vectorLengths, vectorLengths.size()*sizeof(uint32_t));
+    }
+    uint64_t vectorValuesCount = 0;
+    for (uint32_t length : vectorLengths) {
+        vectorValuesCount += length;
+    }
+    if (vectorValuesCount != header.vectorValuesCount) {
+        return false;
+    }
+
+    mExecutedCount = header.executedCount;
+    mIP = header.ip;
+    mFrameBase = header.frameBase;
+    mFrameTop = header.frameTop;
+    mSP = mStack.data() + header.stackSize;
+    if (header.stackSize > 0) {
+        memcpy(mStack.data(), data + layout.stack, header.stackSize*sizeof(double));
+    }
+    // Enter doesn't clear its frame, so the slots above the top must look as after run() cleared them
+    std::fill(mFrames.begin(), mFrames.end(), 0.0);
+    if (header.frameTop > 0) {
+        memcpy(mFrames.data(), data + layout.frames, header.frameTop*sizeof(double));
+    }
+    mScopeFrames = scopeFrames;
+    for (size_t i = 0; i < calls.size(); i++) {
+        const auto &call = calls[i];
+        mRetStack[i] = { call.retIP, call.frameBase, call.frameTop, call.scope, call.scopeFrame, call.retSlot };
+    }
+    mRP = mRetStack.data() + calls.size() - 1;
+    mMemoCalls.clear();
+    // A halted VM is saved at its halt sentinel, so the next run(fuel) finishes it
+    mRunState = RunState::Paused;
+    const double *varValues = reinterpret_cast<const double*>(data + layout.varValues);
+    for (size_t i = 0; i < mVars.size(); i++) {
+        mVars[i] = {};
+        for (uint32_t j = 0; j < varDepths[i]; j++) {
+            double value;
+            memcpy(&value, varValues++, sizeof(value));
+            mVars[i].push(value);
+        }
+    }
+    mVectorPool.release(0);
+    const uint8_t *vectorValues = data + layout.vectorValues;
+    for (uint32_t length : vectorLengths) {
+        double *values;
+        mVectorPool.create(length, values);
+        memcpy(values, vectorValues, length*sizeof(double));
+        vectorValues += length*sizeof(double);
+    }
+    return true;
+}
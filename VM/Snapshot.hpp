@@ -0,0 +1,39 @@
+#pragma once
+#include "../Bytecode.hpp"
+
+const uint32_t SnapshotMagic = 0x53534C4D; // "MLSS"
+const uint16_t SnapshotVersion = 2;
+
+// Leading header of a VM snapshot. The arrays follow in this order, each one 8-byte aligned so that a mapped
+// file can be read in place: operand stack, frames, variable values and vector elements (double), return stack
+// (SnapshotCall), scope frames, the depth of every variable and the length of every vector (uint32_t).
+struct SnapshotHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    // Program::getFingerprint of the program the VM ran, instruction indices are meaningless for any other
+    uint64_t programFingerprint;
+    uint64_t executedCount;
+    uint32_t ip;
+    uint32_t frameBase;
+    uint32_t frameTop;
+    uint32_t stackSize;
+    // Return stack entries in use, the root entry of the top level included
+    uint32_t callsCount;
+    uint32_t scopesCount;
+    uint32_t varsCount;
+    uint32_t varValuesCount;
+    // Vectors of the VectorPool in creation order, so that the vector values in the stack and frames stay valid
+    uint32_t vectorsCount;
+    uint32_t vectorValuesCount;
+};
+
+// CallFrame without its padding
+struct SnapshotCall {
+    uint32_t retIP;
+    uint32_t frameBase;
+    uint32_t frameTop;
+    uint32_t scopeFrame;
+    ScopeIndex scope;
+    SlotIndex retSlot;
+};
@@ -0,0 +1,90 @@
+#include "TraceWriter.hpp"
+
+TraceWriter::TraceWriter(const Program &program, const std::string &path, size_t capacity) : mProgram(program) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    mEvents.resize(size);
+    mMask = size - 1;
+    mHead = 0;
+    mTail = 0;
+    mIsStopping = false;
+    mStallCount = 0;
+    mIsFirstEvent = true;
+    mStartTime = std::chrono::steady_clock::now();
+    mFile = fopen(path.data(), "wb");
+    if (mFile) {
+        fprintf(mFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        mThread = std::thread(&TraceWriter::mWriterLoop, this);
+    }
+}
+
+TraceWriter::~TraceWriter() {
+    if (!mFile) {
+        return;
+    }
+    mIsStopping = true;
+    mThread.join();
+    fprintf(mFile, "\n]}\n");
+    fclose(mFile);
+}
+
+bool TraceWriter::isOpen() const {
+    return mFile != nullptr;
+}
+
+uint64_t TraceWriter::getStallCount() const {
+    return mStallCount;
+}
+
+void TraceWriter::mWriterLoop() {
+    while (true) {
+        bool isStopping = mIsStopping;
+        // Everything recorded before the stop request is drained before the thread ends
+        if (!mDrain()) {
+            if (isStopping) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+bool TraceWriter::mDrain() {
+    uint64_t tail = mTail.load(std::memory_order_relaxed);
+    uint64_t head = mHead.load(std::memory_order_acquire);
+    if (tail == head) {
+        return false;
+    }
+    for (; tail != head; tail++) {
+        mWrite(mEvents[tail & mMask]);
+        // Frees the slot as soon as it is formatted, a waiting VM can go on before the whole batch is written
+        mTail.store(tail + 1, std::memory_order_release);
+    }
+    return true;
+}
+
+void TraceWriter::mWrite(const TraceEvent &event) {
+    // Trace-event timestamps are microseconds
+    double ts = event.time / 1000.0;
+    const char *separator = mIsFirstEvent ? "" : ",\n";
+    mIsFirstEvent = false;
+    switch (event.type) {
+        case TraceEventType::CallBegin: {
+            fprintf(mFile, "%s{\"name\":\"%s\",\"cat\":\"call\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":1}", separator,
+                    mProgram.getFunctionName(event.id).data(), ts);
+            break;
+        }
+        case TraceEventType::IntBegin: {
+            fprintf(mFile, "%s{\"name\":\"%s\",\"cat\":\"int\",\"ph\":\"B\",\"ts\":%.3f,\"pid\":1,\"tid\":1}", separator,
+                    event.id == 0 ? "print" : ("int " + std::to_string(event.id)).data(), ts);
+            break;
+        }
+        case TraceEventType::CallEnd:
+        case TraceEventType::IntEnd: {
+            fprintf(mFile, "%s{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":1}", separator, ts);
+            break;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "Program.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+const size_t DefaultTraceCapacity = 1 << 20;
+
+enum class TraceEventType : uint8_t {
+    CallBegin,
+    CallEnd,
+    IntBegin,
+    IntEnd
+};
+
+struct TraceEvent {
+    // Nanoseconds since the writer was created
+    uint64_t time;
+    // Instruction index of the callee for CallBegin, interruption id for IntBegin
+    uint32_t id;
+    TraceEventType type;
+};
+
+// Writes a Chrome trace-event JSON file (chrome://tracing, ui.perfetto.dev) with a begin/end pair for every call
+// and interruption. The VM thread only stores events into a preallocated ring buffer, a writer thread formats and
+// writes them, so tracing costs a clock read and a store per event. The VM waits only when the ring is full.
+class TraceWriter {
+public:
+    // Capacity is rounded up to a power of two
+    TraceWriter(const Program &program, const std::string &path, size_t capacity = DefaultTraceCapacity);
+    ~TraceWriter();
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter &operator=(const TraceWriter&) = delete;
+
+    bool isOpen() const;
+    // Events the VM had to wait for because the writer fell behind
+    uint64_t getStallCount() const;
+
+    void record(TraceEventType type, uint32_t id) {
+        uint64_t head = mHead.load(std::memory_order_relaxed);
+        if (head - mTail.load(std::memory_order_acquire) == mEvents.size()) {
+            mStallCount++;
+            while (head - mTail.load(std::memory_order_acquire) == mEvents.size()) {
+                std::this_thread::yield();
+            }
+        }
+        auto time = std::chrono::steady_clock::now() - mStartTime;
+        mEvents[head & mMask] = { static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count()),
+                                  id, type };
+        mHead.store(head + 1, std::memory_order_release);
+    }
+
+private:
+    void mWriterLoop();
+    bool mDrain();
+    void mWrite(const TraceEvent &event);
+
+    const Program &mProgram;
+    FILE *mFile;
+    std::vector<TraceEvent> mEvents;
+    uint64_t mMask;
+    // Written by the VM thread only
+    std::atomic<uint64_t> mHead;
+    // Written by the writer thread only
+    std::atomic<uint64_t> mTail;
+    std::atomic<bool> mIsStopping;
+    uint64_t mStallCount;
+    bool mIsFirstEvent;
+    std::chrono::steady_clock::time_point mStartTime;
+    std::thread mThread;
+};
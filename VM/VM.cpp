@@ -1,136 +1,1248 @@
 #include "VM.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
 
-VM::VM(const std::vector<uint8_t> &bc) : mBC(bc) {
-    mIP = 0;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Jmp)] = &VM::mOpCodeJmp;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Call)] = &VM::mOpCodeCall;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Ret)] = &VM::mOpCodeRet;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Add)] = &VM::mOpCodeAdd;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Sub)] = &VM::mOpCodeSub;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Mul)] = &VM::mOpCodeMul;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Div)] = &VM::mOpCodeDiv;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Push)] = &VM::mOpCodePush;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Pop)] = &VM::mOpCodePop;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Set)] = &VM::mOpCodeSet;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Get)] = &VM::mOpCodeGet;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Unset)] = &VM::mOpCodeUnset;
-    mOpCodeFuncs[static_cast<size_t>(OpCode::Int)] = &VM::mOpCodeInt;
-}
-
-void VM::run() {
+VM::VM(BytecodeView bc, bool isFusionEnabled) : VM(std::make_shared<const Program>(bc, isFusionEnabled)) {
+}
+
+VM::VM(std::shared_ptr<const Program> program) {
+    mProgram = std::move(program);
+    mCode = mProgram->getCode().data();
+    mOffsets = mProgram->getOffsets().data();
+    mHeader = mProgram->getHeader();
     mIP = 0;
+    mIsPrintEnabled = true;
+    mTrace = nullptr;
+    mProfiler = nullptr;
+    mTraceWriter = nullptr;
+    mJitThreshold = 0;
+    mIsCheckEnabled = false;
+    mExecutedCount = 0;
+    mFuelEnd = 0;
+    mRunState = RunState::Finished;
+
+    mScopeFrames.resize(mProgram->getScopesCount());
+    // A stack per symbol is a lot for a small VM, and most programs only use frames
+    if (mProgram->hasNamedVars()) {
+        mVars.resize(mProgram->getSymbols().size());
+    }
+
+    // Calls never allocate: the stacks and frames are allocated once for the VM lifetime,
+    // the return stack has an extra root entry for the top level
+    mStack.resize(mHeader.stackDepth);
+    mRetStack.resize(mHeader.callDepth + 1);
+    mFrames.resize(mHeader.frameSlots);
+}
+
+template<bool IsChecked>
+void VM::mInitOpCodeFuncs(OpCodeFunc *funcs) {
+    funcs[static_cast<size_t>(OpCode::Jmp)] = &VM::mOpCodeJmp;
+    funcs[static_cast<size_t>(OpCode::Call)] = &VM::mOpCodeCall<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Ret)] = &VM::mOpCodeRet<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Add)] = &VM::mOpCodeAdd<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Sub)] = &VM::mOpCodeSub<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Mul)] = &VM::mOpCodeMul<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Div)] = &VM::mOpCodeDiv<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Push)] = &VM::mOpCodePush<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Pop)] = &VM::mOpCodePop<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Set)] = &VM::mOpCodeSet<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Get)] = &VM::mOpCodeGet<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Unset)] = &VM::mOpCodeUnset;
+    funcs[static_cast<size_t>(OpCode::Int)] = &VM::mOpCodeInt<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Enter)] = &VM::mOpCodeEnter<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocal)] = &VM::mOpCodeLoadLocal<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::StoreLocal)] = &VM::mOpCodeStoreLocal<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadOuter)] = &VM::mOpCodeLoadOuter<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegLoadK)] = &VM::mOpCodeRegLoadK<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegMove)] = &VM::mOpCodeRegMove<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegAdd)] = &VM::mOpCodeRegAdd<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegSub)] = &VM::mOpCodeRegSub<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegMul)] = &VM::mOpCodeRegMul<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegDiv)] = &VM::mOpCodeRegDiv<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegLoadOuter)] = &VM::mOpCodeRegLoadOuter<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegCall)] = &VM::mOpCodeRegCall<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegRet)] = &VM::mOpCodeRegRet<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegPrint)] = &VM::mOpCodeRegPrint<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegTailCall)] = &VM::mOpCodeRegTailCall<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::TailCall)] = &VM::mOpCodeTailCall<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegNative)] = &VM::mOpCodeRegNative<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Native)] = &VM::mOpCodeNative<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Memo)] = &VM::mOpCodeMemo<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Vec)] = &VM::mOpCodeVec<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::VecDot)] = &VM::mOpCodeVecDot<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::VecSum)] = &VM::mOpCodeVecSum<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegVec)] = &VM::mOpCodeRegVec<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegVecDot)] = &VM::mOpCodeRegVecDot<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegVecSum)] = &VM::mOpCodeRegVecSum<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::Neg)] = &VM::mOpCodeNeg<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::RegNeg)] = &VM::mOpCodeRegNeg<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocal2)] = &VM::mOpCodeLoadLocal2<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocalAdd)] = &VM::mOpCodeLoadLocalAdd<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocalSub)] = &VM::mOpCodeLoadLocalSub<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocalMul)] = &VM::mOpCodeLoadLocalMul<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocalDiv)] = &VM::mOpCodeLoadLocalDiv<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocal2Add)] = &VM::mOpCodeLoadLocal2Add<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocal2Sub)] = &VM::mOpCodeLoadLocal2Sub<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocal2Mul)] = &VM::mOpCodeLoadLocal2Mul<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::LoadLocal2Div)] = &VM::mOpCodeLoadLocal2Div<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::StoreLocal2)] = &VM::mOpCodeStoreLocal2<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::PushLoadLocal)] = &VM::mOpCodePushLoadLocal<IsChecked>;
+    funcs[static_cast<size_t>(OpCode::MemoReturn)] = &VM::mOpCodeMemoReturn<IsChecked>;
+}
+
+template<bool IsChecked>
+const VM::OpCodeFunc *VM::mGetOpCodeFuncs() {
+    // One table for all VMs instead of a copy in every one of them
+    static const auto funcs = []() {
+        std::array<OpCodeFunc, static_cast<size_t>(OpCode::_Count)> funcs;
+        mInitOpCodeFuncs<IsChecked>(funcs.data());
+        return funcs;
+    }();
+    return funcs.data();
+}
+
+void VM::run(DispatchMode mode) {
+    start();
+    resume(mode);
+}
+
+void VM::start() {
+    mIP = mProgram->getEntry();
+    mExecutedCount = 0;
+    mSP = mStack.data();
+    for (auto &var : mVars) {
+        var = {};
+    }
+    mFrameBase = 0;
+    mFrameTop = 0;
+    // Enter can't clear its frame, a register call has already written the arguments there
+    std::fill(mFrames.begin(), mFrames.end(), 0.0);
+    std::fill(mScopeFrames.begin(), mScopeFrames.end(), UINT32_MAX);
+    mScopeFrames[0] = 0;
+    // Root entry for the top level, its Enter records the global scope here
+    mRP = mRetStack.data();
+    *mRP = { static_cast<uint32_t>(mProgram->getCode().size() - 1), 0, 0, 0, 0, 0 };
+    mMemoCalls.clear();
+    mVectorPool.release(0);
+    mRunState = RunState::Paused;
+}
+
+void VM::resume(DispatchMode mode) {
+    bool isChecked = mIsCheckEnabled || !mProgram->isVerified();
     try {
-        while (mIP < mBC.size()) {
-            size_t opcode = mBC[mIP++];
-            if (opcode >= static_cast<size_t>(OpCode::_Count)) {
-                mError("unknown opcode '" + std::to_string(static_cast<uint32_t>(opcode)) + "'");
+        if (mProfiler || mTraceWriter) {
+            // A separate instantiation, so that the other loops don't even test for the profiler or the trace
+            if (mProfiler) {
+                mProfiler->start(mIP);
             }
-            else {
-                (this->*mOpCodeFuncs[opcode])();
+            isChecked ? mRunTable<true, true>() : mRunTable<false, true>();
+        }
+        else if (mode == DispatchMode::Table) {
+            isChecked ? mRunTable<true, false>() : mRunTable<false, false>();
+        }
+        else {
+            isChecked ? mRunThreaded<true, false>() : mRunThreaded<false, false>();
+        }
+        mRunState = RunState::Finished;
+    }
+    catch (...) {
+        mRunState = RunState::Failed;
+    }
+    if (mProfiler) {
+        mProfiler->finish();
+    }
+    // After a runtime error the calls still on the return stack never returned, close them to keep the trace nested
+    if (mTraceWriter) {
+        for (const CallFrame *rp = mRP; rp > mRetStack.data(); rp--) {
+            mTraceWriter->record(TraceEventType::CallEnd, 0);
+        }
+    }
+}
+
+bool VM::call(const ProgramFunction &function, const double *args, size_t argsCount, double &result) {
+    bool isRegister = (mHeader.flags & static_cast<uint16_t>(BytecodeFlags::Register)) != 0;
+    // The halt sentinel is the return address, so the loop stops as soon as the function returns
+    uint32_t halt = static_cast<uint32_t>(mProgram->getCode().size() - 1);
+    mSP = mStack.data();
+    mRP = mRetStack.data();
+    mMemoCalls.clear();
+    uint32_t argBase = mFrameTop;
+    size_t vectorsCount = mVectorPool.getCount();
+    try {
+        if (isRegister) {
+            if (mFrames.size() - argBase < argsCount) {
+                mError("frame stack overflow", function.address);
+            }
+            std::copy(args, args + argsCount, mFrames.begin() + argBase);
+        }
+        else {
+            if (mStack.size() < argsCount) {
+                mError("operand stack overflow", function.address);
             }
+            mSP = std::copy(args, args + argsCount, mSP);
+        }
+        // Same entry as a call from the top level, RegRet writes the result to the first argument register
+        *++mRP = { halt, mFrameBase, mFrameTop, 0, mScopeFrames[0], static_cast<SlotIndex>(argBase - mFrameBase) };
+        mIP = function.entry;
+        bool isChecked = mIsCheckEnabled || !function.isVerified;
+        isChecked ? mRunThreaded<true, false>() : mRunThreaded<false, false>();
+        if (mRP != mRetStack.data() || (!isRegister && mSP == mStack.data())) {
+            mError("function '" + function.name + "' returned no value", function.address);
+        }
+        result = isRegister ? mFrames[argBase] : *--mSP;
+        mVectorPool.release(vectorsCount);
+    }
+    catch (...) {
+        // Drop what the failed call left behind, the globals of the top level stay
+        mRP = mRetStack.data();
+        mFrameBase = 0;
+        mFrameTop = argBase;
+        std::fill(mScopeFrames.begin() + 1, mScopeFrames.end(), UINT32_MAX);
+        mVectorPool.release(vectorsCount);
+        return false;
+    }
+    return true;
+}
+
+RunState VM::run(uint64_t fuel) {
+    if (mRunState != RunState::Paused) {
+        return mRunState;
+    }
+    bool isChecked = mIsCheckEnabled || !mProgram->isVerified();
+    mFuelEnd = mExecutedCount + fuel;
+    try {
+        bool isHalted = isChecked ? mRunThreaded<true, true>() : mRunThreaded<false, true>();
+        if (isHalted) {
+            mRunState = RunState::Finished;
         }
     }
     catch (...) {
+        mRunState = RunState::Failed;
+    }
+    return mRunState;
+}
+
+RunState VM::getRunState() const {
+    return mRunState;
+}
+
+void VM::setCheckEnabled(bool enabled) {
+    mIsCheckEnabled = enabled;
+}
+
+void VM::setPrintEnabled(bool enabled) {
+    mIsPrintEnabled = enabled;
+}
+
+void VM::setTrace(std::vector<OpCode> *trace) {
+    mTrace = trace;
+}
+
+void VM::setProfiler(Profiler *profiler) {
+    mProfiler = profiler;
+}
+
+void VM::setTraceWriter(TraceWriter *writer) {
+    mTraceWriter = writer;
+}
+
+void VM::setJitThreshold(uint32_t threshold) {
+    // Compiled code has no slow path for vector operands
+    if (!Jit::isSupported() || mProgram->hasVectors()) {
+        threshold = 0;
+    }
+    mJitThreshold = threshold;
+    if (mJitThreshold != 0 && !mJit) {
+        mJit = std::make_unique<Jit>();
+        mJitEntries.assign(mProgram->getCode().size(), JitEntry());
+    }
+}
+
+void VM::setMemoCapacity(size_t capacity) {
+    mMemo.setCapacity(capacity);
+}
+
+uint64_t VM::getMemoHitsCount() const {
+    return mMemo.getHitsCount();
+}
+
+uint64_t VM::getMemoMissesCount() const {
+    return mMemo.getMissesCount();
+}
+
+uint64_t VM::getExecutedCount() const {
+    return mExecutedCount;
+}
+
+size_t VM::getMemoryFootprint() const {
+    size_t size = sizeof(VM);
+    size += mStack.capacity()*sizeof(double);
+    size += mRetStack.capacity()*sizeof(CallFrame);
+    size += mFrames.capacity()*sizeof(double);
+    size += mScopeFrames.capacity()*sizeof(uint32_t);
+    size += mVars.capacity()*sizeof(std::stack<double>);
+    for (const auto &var : mVars) {
+        size += var.size()*sizeof(double);
+    }
+    size += mJitEntries.capacity()*sizeof(JitEntry);
+    if (mJit) {
+        size += mJit->getAllocatedSize();
+    }
+    size += (mBatchStack.capacity() + mBatchFrames.capacity())*sizeof(Lanes);
+    size += mBatchCalls.capacity()*sizeof(CallFrame);
+    size += mMemo.getAllocatedSize();
+    size += mMemoCalls.capacity()*sizeof(MemoCall);
+    size += mVectorPool.getAllocatedSize();
+    return size;
+}
+
+bool VM::mJitCall(uint32_t entry) {
+    auto &jitEntry = mJitEntries[entry];
+    if (!jitEntry.function.func) {
+        if (jitEntry.isFailed || ++jitEntry.callCount < mJitThreshold) {
+            return false;
+        }
+        if (!mJit->compile(mProgram->getCode(), entry, jitEntry.function)) {
+            jitEntry.isFailed = true;
+            return false;
+        }
+    }
+
+    const auto &function = jitEntry.function;
+    if (mFrames.size() - mFrameTop < function.frameSize) {
+        mError("frame stack overflow");
     }
+    // Let the interpreter report the inactive scope
+    for (ScopeIndex scope : function.outerScopes) {
+        if (mScopeFrames[scope] == UINT32_MAX) {
+            return false;
+        }
+    }
+    mSP = function.func(mSP, mFrames.data() + mFrameTop, mFrames.data(), mScopeFrames.data());
+    return true;
 }
 
+template<bool IsChecked, bool IsInstrumented>
+void VM::mRunTable() {
+    const OpCodeFunc *funcs = mGetOpCodeFuncs<IsChecked>();
+    while (true) {
+        const auto &ins = mCode[mIP++];
+        if (ins.opCode == OpCode::_Count) {
+            break;
+        }
+        mExecutedCount++;
+        if (mTrace) {
+            mTrace->push_back(ins.opCode);
+        }
+        if constexpr (IsInstrumented) {
+            if (mProfiler) {
+                mProfiler->step(ins.opCode);
+            }
+            if (mTraceWriter && ins.opCode == OpCode::Int) {
+                mTraceWriter->record(TraceEventType::IntBegin, ins.id);
+            }
+            // Calls and returns are seen as moves of the return stack, whatever opcode made them
+            const CallFrame *rp = mRP;
+            (this->*funcs[static_cast<size_t>(ins.opCode)])(ins);
+            if (mRP > rp) {
+                if (mProfiler) {
+                    mProfiler->enterFunction(ins.address);
+                }
+                if (mTraceWriter) {
+                    mTraceWriter->record(TraceEventType::CallBegin, ins.address);
+                }
+            }
+            else if (mRP < rp) {
+                if (mProfiler) {
+                    mProfiler->leaveFunction();
+                }
+                if (mTraceWriter) {
+                    mTraceWriter->record(TraceEventType::CallEnd, 0);
+                }
+            }
+            else if (ins.opCode == OpCode::TailCall || ins.opCode == OpCode::RegTailCall) {
+                // The same return stack entry now belongs to the callee
+                if (mProfiler) {
+                    mProfiler->leaveFunction();
+                    mProfiler->enterFunction(ins.address);
+                }
+                if (mTraceWriter) {
+                    mTraceWriter->record(TraceEventType::CallEnd, 0);
+                    mTraceWriter->record(TraceEventType::CallBegin, ins.address);
+                }
+            }
+            else if (mProfiler && (ins.opCode == OpCode::Call || ins.opCode == OpCode::RegCall)) {
+                mProfiler->countNativeCall(ins.address);
+            }
+            if (mTraceWriter && ins.opCode == OpCode::Int) {
+                mTraceWriter->record(TraceEventType::IntEnd, ins.id);
+            }
+        }
+        else {
+            (this->*funcs[static_cast<size_t>(ins.opCode)])(ins);
+        }
+    }
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+
+template<bool IsChecked, bool IsFueled>
+bool VM::mRunThreaded() {
+    // Indexed by OpCode, the decoder guarantees that no other values reach the loop
+    static const void *labels[] = {
+        &&opJmp, &&opCall, &&opRet, &&opAdd, &&opSub, &&opMul, &&opDiv,
+        &&opPush, &&opPop, &&opSet, &&opGet, &&opUnset, &&opInt,
+        &&opEnter, &&opLoadLocal, &&opStoreLocal, &&opLoadOuter,
+        &&opRegLoadK, &&opRegMove, &&opRegAdd, &&opRegSub, &&opRegMul, &&opRegDiv,
+        &&opRegLoadOuter, &&opRegCall, &&opRegRet, &&opRegPrint, &&opRegTailCall, &&opTailCall,
+        &&opRegNative, &&opNative, &&opMemo,
+        &&opVec, &&opVecDot, &&opVecSum, &&opRegVec, &&opRegVecDot, &&opRegVecSum, &&opNeg, &&opRegNeg,
+        &&opLoadLocal2, &&opLoadLocalAdd, &&opLoadLocalSub, &&opLoadLocalMul, &&opLoadLocalDiv,
+        &&opLoadLocal2Add, &&opLoadLocal2Sub, &&opLoadLocal2Mul, &&opLoadLocal2Div, &&opStoreLocal2, &&opPushLoadLocal,
+        &&opMemoReturn, &&opHalt
+    };
+    static_assert(sizeof(labels)/sizeof(labels[0]) == static_cast<size_t>(OpCode::_Count) + 1, "labels must cover every opcode");
+
+    // Every handler ends with its own indirect jump, so the branch predictor sees one site per opcode.
+    // Out of fuel, the loop returns before fetching, so mIP is where the next slice starts.
+    const Instruction *ins;
+    #define DISPATCH() if (IsFueled && mExecutedCount == mFuelEnd) return false; \
+        ins = &mCode[mIP++]; mExecutedCount++; goto *labels[static_cast<size_t>(ins->opCode)]
+
+    DISPATCH();
+opJmp: mOpCodeJmp(*ins); DISPATCH();
+opCall: mOpCodeCall<IsChecked>(*ins); DISPATCH();
+opRet: mOpCodeRet<IsChecked>(*ins); DISPATCH();
+opAdd: mOpCodeAdd<IsChecked>(*ins); DISPATCH();
+opSub: mOpCodeSub<IsChecked>(*ins); DISPATCH();
+opMul: mOpCodeMul<IsChecked>(*ins); DISPATCH();
+opDiv: mOpCodeDiv<IsChecked>(*ins); DISPATCH();
+opPush: mOpCodePush<IsChecked>(*ins); DISPATCH();
+opPop: mOpCodePop<IsChecked>(*ins); DISPATCH();
+opSet: mOpCodeSet<IsChecked>(*ins); DISPATCH();
+opGet: mOpCodeGet<IsChecked>(*ins); DISPATCH();
+opUnset: mOpCodeUnset(*ins); DISPATCH();
+opInt: mOpCodeInt<IsChecked>(*ins); DISPATCH();
+opEnter: mOpCodeEnter<IsChecked>(*ins); DISPATCH();
+opLoadLocal: mOpCodeLoadLocal<IsChecked>(*ins); DISPATCH();
+opStoreLocal: mOpCodeStoreLocal<IsChecked>(*ins); DISPATCH();
+opLoadOuter: mOpCodeLoadOuter<IsChecked>(*ins); DISPATCH();
+opRegLoadK: mOpCodeRegLoadK<IsChecked>(*ins); DISPATCH();
+opRegMove: mOpCodeRegMove<IsChecked>(*ins); DISPATCH();
+opRegAdd: mOpCodeRegAdd<IsChecked>(*ins); DISPATCH();
+opRegSub: mOpCodeRegSub<IsChecked>(*ins); DISPATCH();
+opRegMul: mOpCodeRegMul<IsChecked>(*ins); DISPATCH();
+opRegDiv: mOpCodeRegDiv<IsChecked>(*ins); DISPATCH();
+opRegLoadOuter: mOpCodeRegLoadOuter<IsChecked>(*ins); DISPATCH();
+opRegCall: mOpCodeRegCall<IsChecked>(*ins); DISPATCH();
+opRegRet: mOpCodeRegRet<IsChecked>(*ins); DISPATCH();
+opRegPrint: mOpCodeRegPrint<IsChecked>(*ins); DISPATCH();
+opRegTailCall: mOpCodeRegTailCall<IsChecked>(*ins); DISPATCH();
+opTailCall: mOpCodeTailCall<IsChecked>(*ins); DISPATCH();
+opRegNative: mOpCodeRegNative<IsChecked>(*ins); DISPATCH();
+opNative: mOpCodeNative<IsChecked>(*ins); DISPATCH();
+opMemo: mOpCodeMemo<IsChecked>(*ins); DISPATCH();
+opVec: mOpCodeVec<IsChecked>(*ins); DISPATCH();
+opVecDot: mOpCodeVecDot<IsChecked>(*ins); DISPATCH();
+opVecSum: mOpCodeVecSum<IsChecked>(*ins); DISPATCH();
+opRegVec: mOpCodeRegVec<IsChecked>(*ins); DISPATCH();
+opRegVecDot: mOpCodeRegVecDot<IsChecked>(*ins); DISPATCH();
+opRegVecSum: mOpCodeRegVecSum<IsChecked>(*ins); DISPATCH();
+opNeg: mOpCodeNeg<IsChecked>(*ins); DISPATCH();
+opRegNeg: mOpCodeRegNeg<IsChecked>(*ins); DISPATCH();
+opLoadLocal2: mOpCodeLoadLocal2<IsChecked>(*ins); DISPATCH();
+opLoadLocalAdd: mOpCodeLoadLocalAdd<IsChecked>(*ins); DISPATCH();
+opLoadLocalSub: mOpCodeLoadLocalSub<IsChecked>(*ins); DISPATCH();
+opLoadLocalMul: mOpCodeLoadLocalMul<IsChecked>(*ins); DISPATCH();
+opLoadLocalDiv: mOpCodeLoadLocalDiv<IsChecked>(*ins); DISPATCH();
+opLoadLocal2Add: mOpCodeLoadLocal2Add<IsChecked>(*ins); DISPATCH();
+opLoadLocal2Sub: mOpCodeLoadLocal2Sub<IsChecked>(*ins); DISPATCH();
+opLoadLocal2Mul: mOpCodeLoadLocal2Mul<IsChecked>(*ins); DISPATCH();
+opLoadLocal2Div: mOpCodeLoadLocal2Div<IsChecked>(*ins); DISPATCH();
+opStoreLocal2: mOpCodeStoreLocal2<IsChecked>(*ins); DISPATCH();
+opPushLoadLocal: mOpCodePushLoadLocal<IsChecked>(*ins); DISPATCH();
+opMemoReturn: mOpCodeMemoReturn<IsChecked>(*ins); DISPATCH();
+opHalt:
+    mExecutedCount--;
+    return true;
+
+    #undef DISPATCH
+}
+
+#else
+
+template<bool IsChecked, bool IsFueled>
+bool VM::mRunThreaded() {
+    while (true) {
+        if (IsFueled && mExecutedCount == mFuelEnd) {
+            return false;
+        }
+        const auto &ins = mCode[mIP++];
+        mExecutedCount++;
+        switch (ins.opCode) {
+            case OpCode::Jmp: mOpCodeJmp(ins); break;
+            case OpCode::Call: mOpCodeCall<IsChecked>(ins); break;
+            case OpCode::Ret: mOpCodeRet<IsChecked>(ins); break;
+            case OpCode::Add: mOpCodeAdd<IsChecked>(ins); break;
+            case OpCode::Sub: mOpCodeSub<IsChecked>(ins); break;
+            case OpCode::Mul: mOpCodeMul<IsChecked>(ins); break;
+            case OpCode::Div: mOpCodeDiv<IsChecked>(ins); break;
+            case OpCode::Push: mOpCodePush<IsChecked>(ins); break;
+            case OpCode::Pop: mOpCodePop<IsChecked>(ins); break;
+            case OpCode::Set: mOpCodeSet<IsChecked>(ins); break;
+            case OpCode::Get: mOpCodeGet<IsChecked>(ins); break;
+            case OpCode::Unset: mOpCodeUnset(ins); break;
+            case OpCode::Int: mOpCodeInt<IsChecked>(ins); break;
+            case OpCode::Enter: mOpCodeEnter<IsChecked>(ins); break;
+            case OpCode::LoadLocal: mOpCodeLoadLocal<IsChecked>(ins); break;
+            case OpCode::StoreLocal: mOpCodeStoreLocal<IsChecked>(ins); break;
+            case OpCode::LoadOuter: mOpCodeLoadOuter<IsChecked>(ins); break;
+            case OpCode::RegLoadK: mOpCodeRegLoadK<IsChecked>(ins); break;
+            case OpCode::RegMove: mOpCodeRegMove<IsChecked>(ins); break;
+            case OpCode::RegAdd: mOpCodeRegAdd<IsChecked>(ins); break;
+            case OpCode::RegSub: mOpCodeRegSub<IsChecked>(ins); break;
+            case OpCode::RegMul: mOpCodeRegMul<IsChecked>(ins); break;
+            case OpCode::RegDiv: mOpCodeRegDiv<IsChecked>(ins); break;
+            case OpCode::RegLoadOuter: mOpCodeRegLoadOuter<IsChecked>(ins); break;
+            case OpCode::RegCall: mOpCodeRegCall<IsChecked>(ins); break;
+            case OpCode::RegRet: mOpCodeRegRet<IsChecked>(ins); break;
+            case OpCode::RegPrint: mOpCodeRegPrint<IsChecked>(ins); break;
+            case OpCode::RegTailCall: mOpCodeRegTailCall<IsChecked>(ins); break;
+            case OpCode::TailCall: mOpCodeTailCall<IsChecked>(ins); break;
+            case OpCode::RegNative: mOpCodeRegNative<IsChecked>(ins); break;
+            case OpCode::Native: mOpCodeNative<IsChecked>(ins); break;
+            case OpCode::Memo: mOpCodeMemo<IsChecked>(ins); break;
+            case OpCode::Vec: mOpCodeVec<IsChecked>(ins); break;
+            case OpCode::VecDot: mOpCodeVecDot<IsChecked>(ins); break;
+            case OpCode::VecSum: mOpCodeVecSum<IsChecked>(ins); break;
+            case OpCode::RegVec: mOpCodeRegVec<IsChecked>(ins); break;
+            case OpCode::RegVecDot: mOpCodeRegVecDot<IsChecked>(ins); break;
+            case OpCode::RegVecSum: mOpCodeRegVecSum<IsChecked>(ins); break;
+            case OpCode::Neg: mOpCodeNeg<IsChecked>(ins); break;
+            case OpCode::RegNeg: mOpCodeRegNeg<IsChecked>(ins); break;
+            case OpCode::LoadLocal2: mOpCodeLoadLocal2<IsChecked>(ins); break;
+            case OpCode::LoadLocalAdd: mOpCodeLoadLocalAdd<IsChecked>(ins); break;
+            case OpCode::LoadLocalSub: mOpCodeLoadLocalSub<IsChecked>(ins); break;
+            case OpCode::LoadLocalMul: mOpCodeLoadLocalMul<IsChecked>(ins); break;
+            case OpCode::LoadLocalDiv: mOpCodeLoadLocalDiv<IsChecked>(ins); break;
+            case OpCode::LoadLocal2Add: mOpCodeLoadLocal2Add<IsChecked>(ins); break;
+            case OpCode::LoadLocal2Sub: mOpCodeLoadLocal2Sub<IsChecked>(ins); break;
+            case OpCode::LoadLocal2Mul: mOpCodeLoadLocal2Mul<IsChecked>(ins); break;
+            case OpCode::LoadLocal2Div: mOpCodeLoadLocal2Div<IsChecked>(ins); break;
+            case OpCode::StoreLocal2: mOpCodeStoreLocal2<IsChecked>(ins); break;
+            case OpCode::PushLoadLocal: mOpCodePushLoadLocal<IsChecked>(ins); break;
+            case OpCode::MemoReturn: mOpCodeMemoReturn<IsChecked>(ins); break;
+            default: {
+                mExecutedCount--;
+                return true;
+            }
+        }
+    }
+}
+
+#endif
+
 void VM::mError(const std::string &text) {
-    printf("RuntimeError(%d): %s\n", mIP, text.data());
-    throw std::exception("runtime error");
+    mError(text, mOffsets[mIP - 1]);
+}
+
+void VM::mError(const std::string &text, uint32_t offset) {
+    printf("RuntimeError(%d): %s\n", offset, text.data());
+    throw std::runtime_error("runtime error");
 }
 
 double VM::mStackPop() {
-    double value = mStack.top();
-    mStack.pop();
+    return *--mSP;
+}
+
+void VM::mStackPush(double value) {
+    *mSP++ = value;
+}
+
+template<bool IsChecked>
+void VM::mCheckStack(uint32_t popCount, uint32_t pushCount) {
+    if constexpr (IsChecked) {
+        size_t depth = static_cast<size_t>(mSP - mStack.data());
+        if (depth < popCount) {
+            mError("operand stack underflow");
+        }
+        if (mStack.size() - depth + popCount < pushCount) {
+            mError("operand stack overflow");
+        }
+    }
+}
+
+template<bool IsChecked>
+void VM::mCheckSlots(uint32_t base, uint32_t slot, uint32_t count) {
+    if constexpr (IsChecked) {
+        if (static_cast<uint64_t>(base) + slot + count > mFrames.size()) {
+            mError("slot '" + std::to_string(slot) + "' is out of the frame stack");
+        }
+    }
+}
+
+template<VectorOp Op>
+double VM::mArith(double lhs, double rhs) {
+    double result = scalarApply<Op>(lhs, rhs);
+    // A vector operand always gives a NaN, scalar arithmetic pays for one compare
+    if (std::isnan(result)) {
+        return mVectorArith<Op>(lhs, rhs, result);
+    }
+    return result;
+}
+
+template<VectorOp Op>
+double VM::mVectorArith(double lhs, double rhs, double result) {
+    bool isVectorLhs = isVectorValue(lhs);
+    bool isVectorRhs = isVectorValue(rhs);
+    if (!isVectorLhs && !isVectorRhs) {
+        return result;
+    }
+    const double *a = &lhs;
+    const double *b = &rhs;
+    uint32_t length = 0;
+    if (isVectorLhs) {
+        const VectorRef &vector = mGetVector(lhs);
+        a = vector.data;
+        length = vector.length;
+    }
+    if (isVectorRhs) {
+        const VectorRef &vector = mGetVector(rhs);
+        if (isVectorLhs && vector.length != length) {
+            mError("vector lengths differ: " + std::to_string(length) + " and " + std::to_string(vector.length));
+        }
+        b = vector.data;
+        length = vector.length;
+    }
+    double *data;
+    double value = mVectorPool.create(length, data);
+    vectorApply<Op>(data, a, isVectorLhs, b, isVectorRhs, length);
+    return value;
+}
+
+const VectorRef &VM::mGetVector(double value) {
+    const VectorRef *vector = mVectorPool.find(value);
+    if (!vector) {
+        mError("invalid vector value");
+    }
+    return *vector;
+}
+
+double VM::mVectorCreate(const double *values, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (isVectorValue(values[i])) {
+            mError("vector element " + std::to_string(i) + " is a vector");
+        }
+    }
+    double *data;
+    double value = mVectorPool.create(count, data);
+    memcpy(data, values, count*sizeof(double));
+    return value;
+}
+
+double VM::mVectorDot(double lhs, double rhs) {
+    if (isVectorValue(lhs) && isVectorValue(rhs)) {
+        const VectorRef &a = mGetVector(lhs);
+        const VectorRef &b = mGetVector(rhs);
+        if (a.length != b.length) {
+            mError("vector lengths differ: " + std::to_string(a.length) + " and " + std::to_string(b.length));
+        }
+        return vectorDot(a.data, b.data, a.length);
+    }
+    // With a scalar operand it is the sum of the broadcast product
+    return mVectorSum(mArith<VectorOp::Mul>(lhs, rhs));
+}
+
+double VM::mVectorSum(double value) {
+    if (!isVectorValue(value)) {
+        return value;
+    }
+    const VectorRef &vector = mGetVector(value);
+    return vectorSum(vector.data, vector.length);
+}
+
+double VM::mCallBuiltin(const Builtin &builtin, const double *args) {
+    // Tested before the call, fmin and fmax would drop a vector argument as any other NaN
+    for (uint32_t i = 0; i < builtin.argsCount; i++) {
+        if (isVectorValue(args[i])) {
+            return mVectorBuiltin(builtin, args);
+        }
+    }
+    return builtin.func(args);
+}
+
+double VM::mVectorBuiltin(const Builtin &builtin, const double *args) {
+    // Applied per element, scalar arguments are the same for every element
+    const double *vectors[MaxBuiltinArgsCount] = {};
+    uint32_t length = 0;
+    for (uint32_t i = 0; i < builtin.argsCount; i++) {
+        if (!isVectorValue(args[i])) {
+            continue;
+        }
+        const VectorRef &vector = mGetVector(args[i]);
+        if (length != 0 && vector.length != length) {
+            mError("vector lengths differ: " + std::to_string(length) + " and " + std::to_string(vector.length));
+        }
+        vectors[i] = vector.data;
+        length = vector.length;
+    }
+    double *data;
+    double value = mVectorPool.create(length, data);
+    double elementArgs[MaxBuiltinArgsCount];
+    for (uint32_t j = 0; j < length; j++) {
+        for (uint32_t i = 0; i < builtin.argsCount; i++) {
+            elementArgs[i] = vectors[i] ? vectors[i][j] : args[i];
+        }
+        data[j] = builtin.func(elementArgs);
+    }
     return value;
 }
 
-void VM::mOpCodeJmp() {
-    mIP = mGetValue<LabelAddress>();
+void VM::mOpCodeJmp(const Instruction &ins) {
+    mIP = ins.address;
 }
 
-void VM::mOpCodeCall() {
-    auto address = mGetValue<LabelAddress>();
-    mRetStack.push(mIP);
-    mIP = address;
+template<bool IsChecked>
+void VM::mOpCodeCall(const Instruction &ins) {
+    if constexpr (IsChecked) {
+        if (mRP == &mRetStack.back()) {
+            mError("call stack overflow");
+        }
+    }
+    if (!IsChecked && mJitThreshold != 0 && mJitCall(ins.address)) {
+        return;
+    }
+    *++mRP = { mIP, mFrameBase, mFrameTop, 0, mScopeFrames[0], 0 };
+    mIP = ins.address;
 }
 
-void VM::mOpCodeRet() {
-    mIP = mRetStack.top();
-    mRetStack.pop();
+template<bool IsChecked>
+void VM::mOpCodeTailCall(const Instruction &ins) {
+    if constexpr (IsChecked) {
+        if (mRP == mRetStack.data()) {
+            mError("tail call outside of function");
+        }
+    }
+    // Leave the current function as Ret would but keep its return stack entry, the callee returns to our caller
+    auto &frame = *mRP;
+    mFrameBase = frame.frameBase;
+    mFrameTop = frame.frameTop;
+    mScopeFrames[frame.scope] = frame.scopeFrame;
+    if (!IsChecked && mJitThreshold != 0 && mJitCall(ins.address)) {
+        mIP = frame.retIP;
+        mRP--;
+        return;
+    }
+    frame.scope = 0;
+    frame.scopeFrame = mScopeFrames[0];
+    mIP = ins.address;
 }
 
-void VM::mOpCodeAdd() {
+template<bool IsChecked>
+void VM::mOpCodeRet(const Instruction &ins) {
+    if constexpr (IsChecked) {
+        if (mRP == mRetStack.data()) {
+            mError("ret outside of function");
+        }
+    }
+    const auto &frame = *mRP--;
+    mIP = frame.retIP;
+    mFrameBase = frame.frameBase;
+    mFrameTop = frame.frameTop;
+    mScopeFrames[frame.scope] = frame.scopeFrame;
+}
+
+template<bool IsChecked>
+void VM::mOpCodeNative(const Instruction &ins) {
+    // The arguments are on the stack in source order, the result takes the place of the first one
+    const Builtin &builtin = builtins[ins.id];
+    mCheckStack<IsChecked>(builtin.argsCount, 1);
+    mSP -= builtin.argsCount;
+    *mSP = mCallBuiltin(builtin, mSP);
+    mSP++;
+}
+
+template<bool IsChecked>
+void VM::mOpCodeAdd(const Instruction &ins) {
+    mCheckStack<IsChecked>(2, 1);
     double arg1 = mStackPop();
     double arg2 = mStackPop();
-    mStack.push(arg1 + arg2);
+    mStackPush(mArith<VectorOp::Add>(arg1, arg2));
 }
 
-void VM::mOpCodeSub() {
+template<bool IsChecked>
+void VM::mOpCodeSub(const Instruction &ins) {
+    mCheckStack<IsChecked>(2, 1);
     double arg1 = mStackPop();
     double arg2 = mStackPop();
-    mStack.push(arg1 - arg2);
+    mStackPush(mArith<VectorOp::Sub>(arg1, arg2));
 }
 
-void VM::mOpCodeMul() {
+template<bool IsChecked>
+void VM::mOpCodeMul(const Instruction &ins) {
+    mCheckStack<IsChecked>(2, 1);
     double arg1 = mStackPop();
     double arg2 = mStackPop();
-    mStack.push(arg1*arg2);
+    mStackPush(mArith<VectorOp::Mul>(arg1, arg2));
 }
 
-void VM::mOpCodeDiv() {
+template<bool IsChecked>
+void VM::mOpCodeDiv(const Instruction &ins) {
+    mCheckStack<IsChecked>(2, 1);
     double arg1 = mStackPop();
     double arg2 = mStackPop();
-    mStack.push(arg1 / arg2);
+    mStackPush(mArith<VectorOp::Div>(arg1, arg2));
 }
 
-void VM::mOpCodePush() {
-    auto value = mGetValue<double>();
-    mStack.push(value);
+template<bool IsChecked>
+void VM::mOpCodeNeg(const Instruction &ins) {
+    mCheckStack<IsChecked>(1, 1);
+    mStackPush(mArith<VectorOp::Sub>(0.0, mStackPop()));
 }
 
-void VM::mOpCodePop() {
-    mStack.pop();
+template<bool IsChecked>
+void VM::mOpCodePush(const Instruction &ins) {
+    mCheckStack<IsChecked>(0, 1);
+    mStackPush(ins.value);
 }
 
-void VM::mOpCodeSet() {
+template<bool IsChecked>
+void VM::mOpCodePop(const Instruction &ins) {
+    mCheckStack<IsChecked>(1, 0);
+    mSP--;
+}
+
+template<bool IsChecked>
+void VM::mOpCodeSet(const Instruction &ins) {
+    mCheckStack<IsChecked>(1, 0);
     double arg1 = mStackPop();
-    auto hash = mGetValue<uint64_t>();
-    mVars[hash].push(arg1);
+    mVars[ins.symbol].push(arg1);
 }
 
-void VM::mOpCodeGet() {
-    auto hash = mGetValue<uint64_t>();
-    auto it = mVars.find(hash);
-    if (it != mVars.end() && !it->second.empty()) {
-        mStack.push(mVars[hash].top());
+template<bool IsChecked>
+void VM::mOpCodeGet(const Instruction &ins) {
+    auto &var = mVars[ins.symbol];
+    if (!var.empty()) {
+        mCheckStack<IsChecked>(0, 1);
+        mStackPush(var.top());
     }
     else {
-        mError("variable '" + std::to_string(hash) + "' not found (get)");
+        mError("variable '" + mProgram->getSymbols()[ins.symbol] + "' not found (get)");
     }
 }
 
-void VM::mOpCodeUnset() {
-    auto hash = mGetValue<uint64_t>();
-    auto it = mVars.find(hash);
-    if (it != mVars.end() && !it->second.empty()) {
-        it->second.pop();
-        if (it->second.empty()) {
-            mVars.erase(hash);
-        }
+void VM::mOpCodeUnset(const Instruction &ins) {
+    auto &var = mVars[ins.symbol];
+    if (!var.empty()) {
+        var.pop();
     }
     else {
-        mError("variable '" + std::to_string(hash) + "' not found (unset)");
+        mError("variable '" + mProgram->getSymbols()[ins.symbol] + "' not found (unset)");
     }
 }
 
-void VM::mOpCodeInt() {
-    auto id = mGetValue<uint8_t>();
-    if (id == 0) {
-        double arg1 = mStackPop();
-        printf("=> %f\n", arg1);
+template<bool IsChecked>
+void VM::mOpCodeInt(const Instruction &ins) {
+    if (!IsChecked || ins.id == 0) {
+        mCheckStack<IsChecked>(1, 0);
+        mPrint(mStackPop());
     }
     else {
-        mError("unknown interruption '" + std::to_string(id) + "'");
+        mError("unknown interruption '" + std::to_string(ins.id) + "'");
+    }
+}
+
+template<bool IsChecked>
+void VM::mOpCodeEnter(const Instruction &ins) {
+    if constexpr (IsChecked) {
+        if (mFrames.size() - mFrameTop < ins.size) {
+            mError("frame stack overflow");
+        }
+    }
+    auto &frame = *mRP;
+    frame.scope = ins.scope;
+    frame.scopeFrame = mScopeFrames[ins.scope];
+    mFrameBase = mFrameTop;
+    mFrameTop += ins.size;
+    mScopeFrames[ins.scope] = mFrameBase;
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadLocal(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.slot);
+    mCheckStack<IsChecked>(0, 1);
+    mStackPush(mFrames[mFrameBase + ins.slot]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeStoreLocal(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.slot);
+    mCheckStack<IsChecked>(1, 0);
+    mFrames[mFrameBase + ins.slot] = mStackPop();
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadOuter(const Instruction &ins) {
+    uint32_t base = mScopeFrames[ins.scope];
+    if constexpr (IsChecked) {
+        if (base == UINT32_MAX) {
+            mError("scope '" + std::to_string(ins.scope) + "' is not active (loadouter)");
+        }
+    }
+    mCheckSlots<IsChecked>(base, ins.slot);
+    mCheckStack<IsChecked>(0, 1);
+    mStackPush(mFrames[base + ins.slot]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegLoadK(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.slot);
+    mFrames[mFrameBase + ins.slot] = ins.value;
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegMove(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max(ins.regs[0], ins.regs[1]));
+    mFrames[mFrameBase + ins.regs[0]] = mFrames[mFrameBase + ins.regs[1]];
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegAdd(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max({ ins.regs[0], ins.regs[1], ins.regs[2] }));
+    double *regs = &mFrames[mFrameBase];
+    regs[ins.regs[0]] = mArith<VectorOp::Add>(regs[ins.regs[1]], regs[ins.regs[2]]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegSub(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max({ ins.regs[0], ins.regs[1], ins.regs[2] }));
+    double *regs = &mFrames[mFrameBase];
+    regs[ins.regs[0]] = mArith<VectorOp::Sub>(regs[ins.regs[1]], regs[ins.regs[2]]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegMul(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max({ ins.regs[0], ins.regs[1], ins.regs[2] }));
+    double *regs = &mFrames[mFrameBase];
+    regs[ins.regs[0]] = mArith<VectorOp::Mul>(regs[ins.regs[1]], regs[ins.regs[2]]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegDiv(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max({ ins.regs[0], ins.regs[1], ins.regs[2] }));
+    double *regs = &mFrames[mFrameBase];
+    regs[ins.regs[0]] = mArith<VectorOp::Div>(regs[ins.regs[1]], regs[ins.regs[2]]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegNeg(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max(ins.regs[0], ins.regs[1]));
+    double *regs = &mFrames[mFrameBase];
+    regs[ins.regs[0]] = mArith<VectorOp::Sub>(0.0, regs[ins.regs[1]]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegLoadOuter(const Instruction &ins) {
+    uint32_t base = mScopeFrames[ins.scope];
+    if constexpr (IsChecked) {
+        if (base == UINT32_MAX) {
+            mError("scope '" + std::to_string(ins.scope) + "' is not active (loadouter)");
+        }
+    }
+    mCheckSlots<IsChecked>(base, ins.slot);
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[0]);
+    mFrames[mFrameBase + ins.regs[0]] = mFrames[base + ins.slot];
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegCall(const Instruction &ins) {
+    if constexpr (IsChecked) {
+        if (mRP == &mRetStack.back()) {
+            mError("call stack overflow");
+        }
+    }
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[0]);
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[1], 0);
+    *++mRP = { mIP, mFrameBase, mFrameTop, 0, mScopeFrames[0], ins.regs[0] };
+    // The callee Enter starts its frame at the argument registers, so they become its first registers
+    mFrameTop = mFrameBase + ins.regs[1];
+    mIP = ins.address;
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegTailCall(const Instruction &ins) {
+    if constexpr (IsChecked) {
+        if (mRP == mRetStack.data()) {
+            mError("tail call outside of function");
+        }
+    }
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[0], ins.regs[1]);
+    // The arguments move down to r0.., where the callee Enter starts its frame in place of the current one
+    double *frame = mFrames.data() + mFrameBase;
+    memmove(frame, frame + ins.regs[0], ins.regs[1]*sizeof(double));
+    auto &callFrame = *mRP;
+    mScopeFrames[callFrame.scope] = callFrame.scopeFrame;
+    callFrame.scope = 0;
+    callFrame.scopeFrame = mScopeFrames[0];
+    mFrameTop = mFrameBase;
+    mIP = ins.address;
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegRet(const Instruction &ins) {
+    if constexpr (IsChecked) {
+        if (mRP == mRetStack.data()) {
+            mError("ret outside of function");
+        }
+    }
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[0]);
+    double value = mFrames[mFrameBase + ins.regs[0]];
+    const auto &frame = *mRP--;
+    mIP = frame.retIP;
+    mFrameBase = frame.frameBase;
+    mFrameTop = frame.frameTop;
+    mScopeFrames[frame.scope] = frame.scopeFrame;
+    mCheckSlots<IsChecked>(mFrameBase, frame.retSlot);
+    mFrames[mFrameBase + frame.retSlot] = value;
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegNative(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[0]);
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[1], builtins[ins.id].argsCount);
+    double *frame = mFrames.data() + mFrameBase;
+    frame[ins.regs[0]] = mCallBuiltin(builtins[ins.id], frame + ins.regs[1]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeMemo(const Instruction &ins) {
+    if constexpr (IsChecked) {
+        if (mRP == mRetStack.data()) {
+            mError("memo outside of function");
+        }
+        if (mFrameTop - mFrameBase < ins.size) {
+            mError("arguments of the memo are out of the frame");
+        }
+    }
+    if (mMemo.getCapacity() == 0) {
+        return;
     }
+    // The arguments are the first slots of the frame, the Memo itself identifies the function
+    bool isRegister = (mHeader.flags & static_cast<uint16_t>(BytecodeFlags::Register)) != 0;
+    const double *args = mFrames.data() + mFrameBase;
+    // A vector is keyed by its index, which the next run reuses for another vector
+    if (std::any_of(args, args + ins.size, isVectorValue)) {
+        return;
+    }
+    uint32_t function = mIP - 1;
+    double result;
+    if (mMemo.find(function, args, ins.size, result)) {
+        if constexpr (IsChecked) {
+            if (!isRegister && mSP == mStack.data() + mStack.size()) {
+                mError("operand stack overflow");
+            }
+        }
+        // Return as Ret or RegRet would with the remembered result
+        const auto &frame = *mRP--;
+        mIP = frame.retIP;
+        mFrameBase = frame.frameBase;
+        mFrameTop = frame.frameTop;
+        mScopeFrames[frame.scope] = frame.scopeFrame;
+        if (isRegister) {
+            mCheckSlots<IsChecked>(mFrameBase, frame.retSlot);
+            mFrames[mFrameBase + frame.retSlot] = result;
+        }
+        else {
+            mStackPush(result);
+        }
+        return;
+    }
+    // A function tail called by another memoized one returns its result for the caller's key, one is enough
+    auto &frame = *mRP;
+    if (frame.retIP == mProgram->getMemoReturn()) {
+        return;
+    }
+    mMemoCalls.emplace_back();
+    MemoCall &call = mMemoCalls.back();
+    MemoTable::makeKey(call.key, function, args, ins.size);
+    call.retIP = frame.retIP;
+    call.retSlot = frame.retSlot;
+    frame.retIP = mProgram->getMemoReturn();
+}
+
+template<bool IsChecked>
+void VM::mOpCodeMemoReturn(const Instruction &ins) {
+    if constexpr (IsChecked) {
+        if (mMemoCalls.empty()) {
+            mError("memo return without a memoized call");
+        }
+    }
+    // Ret has already restored the caller, the result is where the caller expects it
+    MemoCall &call = mMemoCalls.back();
+    bool isRegister = (mHeader.flags & static_cast<uint16_t>(BytecodeFlags::Register)) != 0;
+    if (!isRegister && mSP == mStack.data()) {
+        mError("memoized function returned no value");
+    }
+    if (isRegister) {
+        mCheckSlots<IsChecked>(mFrameBase, call.retSlot);
+    }
+    call.key.result = isRegister ? mFrames[mFrameBase + call.retSlot] : mSP[-1];
+    if (!isVectorValue(call.key.result)) {
+        mMemo.insert(call.key);
+    }
+    mIP = call.retIP;
+    mMemoCalls.pop_back();
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegPrint(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[0]);
+    mPrint(mFrames[mFrameBase + ins.regs[0]]);
+}
+
+void VM::mPrint(double value) {
+    if (!mIsPrintEnabled) {
+        return;
+    }
+    if (!isVectorValue(value)) {
+        printf("=> %f\n", value);
+        return;
+    }
+    const VectorRef &vector = mGetVector(value);
+    printf("=> [");
+    for (uint32_t i = 0; i < vector.length; i++) {
+        printf(i == 0 ? "%f" : ", %f", vector.data[i]);
+    }
+    printf("]\n");
+}
+
+template<bool IsChecked>
+void VM::mOpCodeVec(const Instruction &ins) {
+    mCheckStack<IsChecked>(ins.size, 1);
+    mSP -= ins.size;
+    double value = mVectorCreate(mSP, ins.size);
+    mStackPush(value);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeVecDot(const Instruction &ins) {
+    mCheckStack<IsChecked>(2, 1);
+    double arg1 = mStackPop();
+    double arg2 = mStackPop();
+    mStackPush(mVectorDot(arg1, arg2));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeVecSum(const Instruction &ins) {
+    mCheckStack<IsChecked>(1, 1);
+    mStackPush(mVectorSum(mStackPop()));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegVec(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[0]);
+    mCheckSlots<IsChecked>(mFrameBase, ins.regs[1], ins.size);
+    double *regs = &mFrames[mFrameBase];
+    regs[ins.regs[0]] = mVectorCreate(regs + ins.regs[1], ins.size);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegVecDot(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max({ ins.regs[0], ins.regs[1], ins.regs[2] }));
+    double *regs = &mFrames[mFrameBase];
+    regs[ins.regs[0]] = mVectorDot(regs[ins.regs[1]], regs[ins.regs[2]]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeRegVecSum(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max(ins.regs[0], ins.regs[1]));
+    double *regs = &mFrames[mFrameBase];
+    regs[ins.regs[0]] = mVectorSum(regs[ins.regs[1]]);
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadLocal2(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max<uint32_t>(ins.slot, ins.regs[0]));
+    mCheckStack<IsChecked>(0, 2);
+    mStackPush(mFrames[mFrameBase + ins.slot]);
+    mStackPush(mFrames[mFrameBase + ins.regs[0]]);
+}
+
+// The fused forms keep the operand order of the original sequence: the last loaded value is the first operand
+template<bool IsChecked>
+void VM::mOpCodeLoadLocalAdd(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.slot);
+    mCheckStack<IsChecked>(1, 1);
+    double arg2 = mStackPop();
+    mStackPush(mArith<VectorOp::Add>(mFrames[mFrameBase + ins.slot], arg2));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadLocalSub(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.slot);
+    mCheckStack<IsChecked>(1, 1);
+    double arg2 = mStackPop();
+    mStackPush(mArith<VectorOp::Sub>(mFrames[mFrameBase + ins.slot], arg2));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadLocalMul(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.slot);
+    mCheckStack<IsChecked>(1, 1);
+    double arg2 = mStackPop();
+    mStackPush(mArith<VectorOp::Mul>(mFrames[mFrameBase + ins.slot], arg2));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadLocalDiv(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.slot);
+    mCheckStack<IsChecked>(1, 1);
+    double arg2 = mStackPop();
+    mStackPush(mArith<VectorOp::Div>(mFrames[mFrameBase + ins.slot], arg2));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadLocal2Add(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max<uint32_t>(ins.slot, ins.regs[0]));
+    mCheckStack<IsChecked>(0, 1);
+    mStackPush(mArith<VectorOp::Add>(mFrames[mFrameBase + ins.regs[0]], mFrames[mFrameBase + ins.slot]));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadLocal2Sub(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max<uint32_t>(ins.slot, ins.regs[0]));
+    mCheckStack<IsChecked>(0, 1);
+    mStackPush(mArith<VectorOp::Sub>(mFrames[mFrameBase + ins.regs[0]], mFrames[mFrameBase + ins.slot]));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadLocal2Mul(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max<uint32_t>(ins.slot, ins.regs[0]));
+    mCheckStack<IsChecked>(0, 1);
+    mStackPush(mArith<VectorOp::Mul>(mFrames[mFrameBase + ins.regs[0]], mFrames[mFrameBase + ins.slot]));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeLoadLocal2Div(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max<uint32_t>(ins.slot, ins.regs[0]));
+    mCheckStack<IsChecked>(0, 1);
+    mStackPush(mArith<VectorOp::Div>(mFrames[mFrameBase + ins.regs[0]], mFrames[mFrameBase + ins.slot]));
+}
+
+template<bool IsChecked>
+void VM::mOpCodeStoreLocal2(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, std::max<uint32_t>(ins.slot, ins.regs[0]));
+    mCheckStack<IsChecked>(2, 0);
+    mFrames[mFrameBase + ins.slot] = mStackPop();
+    mFrames[mFrameBase + ins.regs[0]] = mStackPop();
+}
+
+template<bool IsChecked>
+void VM::mOpCodePushLoadLocal(const Instruction &ins) {
+    mCheckSlots<IsChecked>(mFrameBase, ins.slot);
+    mCheckStack<IsChecked>(0, 2);
+    mStackPush(ins.value);
+    mStackPush(mFrames[mFrameBase + ins.slot]);
 }
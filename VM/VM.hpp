@@ -1,51 +1,280 @@
 #pragma once
 #include "../Bytecode.hpp"
+#include "../Builtins.hpp"
+#include "Program.hpp"
+#include "Jit.hpp"
+#include "Lanes.hpp"
+#include "Profiler.hpp"
+#include "TraceWriter.hpp"
+#include "Snapshot.hpp"
+#include "MemoTable.hpp"
+#include "VectorPool.hpp"
+#include "VectorKernels.hpp"
 #include <vector>
 #include <stack>
 #include <string>
 #include <map>
+#include <cstring>
+#include <memory>
+
+enum class DispatchMode {
+    Table,
+    Threaded
+};
+
+// Where run(fuel) left the VM: Paused can go on with the next run(fuel), the others stay until start()
+enum class RunState {
+    Paused,
+    Finished,
+    Failed
+};
+
+// Return stack entry, restores the caller frame on ret
+struct CallFrame {
+    uint32_t retIP;
+    uint32_t frameBase;
+    uint32_t frameTop;
+    ScopeIndex scope;
+    uint32_t scopeFrame;
+    // Caller register that receives the result of RegRet
+    SlotIndex retSlot;
+};
+
+// Call of a memoized function that hasn't returned yet, its return stack entry returns to MemoReturn instead
+struct MemoCall {
+    MemoEntry key;
+    uint32_t retIP;
+    // Caller register of the result in the register engine
+    SlotIndex retSlot;
+};
 
 class VM {
-    using OpCodeFunc = void(VM::*)();
+    using OpCodeFunc = void(VM::*)(const Instruction&);
 
 public:
-    VM(const std::vector<uint8_t> &bc);
+    VM(BytecodeView bc, bool isFusionEnabled = true);
+    // Execution context over a shared program, any number of VMs can run one Program on different threads
+    VM(std::shared_ptr<const Program> program);
 
-    void run();
+    void run(DispatchMode mode = DispatchMode::Threaded);
+    // Goes on from the current state instead of starting over, for a VM restored from a snapshot
+    void resume(DispatchMode mode = DispatchMode::Threaded);
+    // Resets the VM to the program entry without running anything, run(fuel) then executes it in slices
+    void start();
+    // Executes at most fuel instructions from the current state and returns Paused if the program isn't done yet,
+    // the next call goes on from there. A call into compiled code counts as one instruction. Always threaded,
+    // a profiler or a trace writer needs run(mode).
+    RunState run(uint64_t fuel);
+    RunState getRunState() const;
+    // Calls one function of the program on top of the state the last run() left, so it sees the globals of the
+    // top level. args are in source order and there must be as many as the function has parameters.
+    // Returns false on a runtime error, the VM stays usable for the next call. Vectors created by the call are
+    // released when it returns, a vector result reads as NaN.
+    bool call(const ProgramFunction &function, const double *args, size_t argsCount, double &result);
+    // Whole execution state, see Snapshot.hpp for the layout
+    std::vector<uint8_t> saveSnapshot() const;
+    // Replaces the execution state with a snapshot of a VM over the same program, the view can be a mapped file.
+    // Returns false and keeps the current state if the snapshot doesn't belong to this program.
+    bool loadSnapshot(BytecodeView snapshot);
+    // Calls the function at a code address once per row, columns[i][row] is argument i of the call in source order.
+    // Rows are evaluated LaneWidth at a time, returns false on a runtime error.
+    bool runBatch(uint32_t address, const std::vector<const double*> &columns, size_t rows, double *results);
+    // Keeps the runtime checks even for a verified program
+    void setCheckEnabled(bool enabled);
+    void setPrintEnabled(bool enabled);
+    // Records every opcode executed in table mode, used by the n-gram profile
+    void setTrace(std::vector<OpCode> *trace);
+    // Runs in table mode with per-opcode and per-function counters, nullptr turns profiling off
+    void setProfiler(Profiler *profiler);
+    // Records calls and interruptions in table mode, nullptr turns tracing off
+    void setTraceWriter(TraceWriter *writer);
+    // Functions called this many times are compiled to native code, 0 keeps everything interpreted. Compiled code has
+    // no runtime checks, so checked runs stay interpreted.
+    void setJitThreshold(uint32_t threshold);
+    // Entries of the memo table for the functions the Compiler found pure, 0 turns memoization off
+    void setMemoCapacity(size_t capacity);
+    uint64_t getMemoHitsCount() const;
+    uint64_t getMemoMissesCount() const;
+    uint64_t getExecutedCount() const;
+    // Bytes held by the VM itself and by its stacks, tables and compiled code, the shared Program is not counted.
+    // The memo table, the vector pool and the JIT allocate as the program runs.
+    size_t getMemoryFootprint() const;
 
 private:
-    template<typename T>
-    T mGetValue() {
-        T value;
-        for (int i = 0; i < sizeof(T); i++) {
-            if (mIP >= mBC.size()) {
-                mError("unexpected end of bytecode");
-            }
-            reinterpret_cast<uint8_t*>(&value)[i] = mBC[mIP++];
-        }
-        return value;
-    }
-
+    bool mJitCall(uint32_t entry);
+    void mRunBatch(uint32_t entry);
+    Lanes mBatchPop();
+    Lanes mBatchNative(const Builtin &builtin, const Lanes *args);
+    template<bool IsChecked>
+    static void mInitOpCodeFuncs(OpCodeFunc *funcs);
+    template<bool IsChecked>
+    static const OpCodeFunc *mGetOpCodeFuncs();
+    template<bool IsChecked, bool IsInstrumented>
+    void mRunTable();
+    // Returns true at the halt sentinel. A fueled loop returns false once mExecutedCount reaches mFuelEnd,
+    // with mIP at the next instruction.
+    template<bool IsChecked, bool IsFueled>
+    bool mRunThreaded();
     void mError(const std::string &text);
+    void mError(const std::string &text, uint32_t offset);
+    template<VectorOp Op>
+    double mArith(double lhs, double rhs);
+    template<VectorOp Op>
+    double mVectorArith(double lhs, double rhs, double result);
+    const VectorRef &mGetVector(double value);
+    double mVectorCreate(const double *values, uint32_t count);
+    double mVectorDot(double lhs, double rhs);
+    double mVectorSum(double value);
+    double mCallBuiltin(const Builtin &builtin, const double *args);
+    double mVectorBuiltin(const Builtin &builtin, const double *args);
     double mStackPop();
-    void mOpCodeJmp();
-    void mOpCodeCall();
-    void mOpCodeRet();
-    void mOpCodeAdd();
-    void mOpCodeSub();
-    void mOpCodeMul();
-    void mOpCodeDiv();
-    void mOpCodePush();
-    void mOpCodePop();
-    void mOpCodeSet();
-    void mOpCodeGet();
-    void mOpCodeUnset();
-    void mOpCodeInt();
-
-    std::vector<uint8_t> mBC;
+    void mStackPush(double value);
+    // Only checked runs test the operands, a malformed program then fails with a runtime error instead of reaching
+    // outside of the stacks
+    template<bool IsChecked>
+    void mCheckStack(uint32_t popCount, uint32_t pushCount);
+    template<bool IsChecked>
+    void mCheckSlots(uint32_t base, uint32_t slot, uint32_t count = 1);
+    void mOpCodeJmp(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeCall(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRet(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeTailCall(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeNative(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeAdd(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeSub(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeMul(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeDiv(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodePush(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodePop(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeSet(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeGet(const Instruction &ins);
+    void mOpCodeUnset(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeInt(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeEnter(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocal(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeStoreLocal(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadOuter(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegLoadK(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegMove(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegAdd(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegSub(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegMul(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegDiv(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegLoadOuter(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegCall(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegRet(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegPrint(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegTailCall(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegNative(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeMemo(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeMemoReturn(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeVec(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeVecDot(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeVecSum(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegVec(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegVecDot(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegVecSum(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeNeg(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeRegNeg(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocal2(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocalAdd(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocalSub(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocalMul(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocalDiv(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocal2Add(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocal2Sub(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocal2Mul(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeLoadLocal2Div(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodeStoreLocal2(const Instruction &ins);
+    template<bool IsChecked>
+    void mOpCodePushLoadLocal(const Instruction &ins);
+    void mPrint(double value);
+
+    std::shared_ptr<const Program> mProgram;
+    const Instruction *mCode;
+    const uint32_t *mOffsets;
     uint32_t mIP;
-    std::stack<double> mStack;
-    std::stack<LabelAddress> mRetStack;
-    OpCodeFunc mOpCodeFuncs[static_cast<size_t>(OpCode::_Count)];
-    std::map<uint64_t, std::stack<double>> mVars;
-};
\ No newline at end of file
+    BytecodeHeader mHeader;
+    // Both stacks are sized by the header, so only checked runs test pushes and slots against them
+    std::vector<double> mStack;
+    double *mSP;
+    std::vector<CallFrame> mRetStack;
+    CallFrame *mRP;
+    std::vector<double> mFrames;
+    uint32_t mFrameBase;
+    uint32_t mFrameTop;
+    // Frame base of the most recent activation of every scope, used by LoadOuter
+    std::vector<uint32_t> mScopeFrames;
+    // Indexed by symbol, empty if the program has no named variables
+    std::vector<std::stack<double>> mVars;
+    bool mIsPrintEnabled;
+    bool mIsCheckEnabled;
+    std::vector<OpCode> *mTrace;
+    Profiler *mProfiler;
+    TraceWriter *mTraceWriter;
+    uint32_t mJitThreshold;
+    std::unique_ptr<Jit> mJit;
+    // Indexed by the instruction index of the function entry
+    std::vector<JitEntry> mJitEntries;
+    // Lane-wide counterparts of the stacks and frames, used by runBatch
+    std::vector<Lanes> mBatchStack;
+    std::vector<Lanes> mBatchFrames;
+    std::vector<CallFrame> mBatchCalls;
+    // Survives run(), results of pure functions stay valid. Calls are pushed on a miss and popped by MemoReturn.
+    MemoTable mMemo;
+    std::vector<MemoCall> mMemoCalls;
+    // Storage of every vector value, released by start()
+    VectorPool mVectorPool;
+    uint64_t mExecutedCount;
+    uint64_t mFuelEnd;
+    RunState mRunState;
+};
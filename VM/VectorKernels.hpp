@@ -0,0 +1,102 @@
+#pragma once
+#include "Lanes.hpp"
+#include "VectorPool.hpp"
+#include <cstdint>
+
+// Elementwise arithmetic and reductions over the 64-byte aligned storage of VectorPool, LaneWidth doubles at a time
+// with the widest Lanes the target is compiled for. Storage is padded to whole blocks, so the last partial lanes
+// need no scalar tail: the reductions read zeros there and the elementwise kernels clear what they wrote past length.
+
+enum class VectorOp {
+    Add,
+    Sub,
+    Mul,
+    Div
+};
+
+template<VectorOp Op>
+inline double scalarApply(double a, double b) {
+    if constexpr (Op == VectorOp::Add) {
+        return a + b;
+    }
+    else if constexpr (Op == VectorOp::Sub) {
+        return a - b;
+    }
+    else if constexpr (Op == VectorOp::Mul) {
+        return a*b;
+    }
+    else {
+        return a / b;
+    }
+}
+
+template<VectorOp Op>
+inline Lanes lanesApply(Lanes a, Lanes b) {
+    if constexpr (Op == VectorOp::Add) {
+        return lanesAdd(a, b);
+    }
+    else if constexpr (Op == VectorOp::Sub) {
+        return lanesSub(a, b);
+    }
+    else if constexpr (Op == VectorOp::Mul) {
+        return lanesMul(a, b);
+    }
+    else {
+        return lanesDiv(a, b);
+    }
+}
+
+template<VectorOp Op, bool IsVectorA, bool IsVectorB>
+inline void vectorApply(double *out, const double *a, const double *b, uint32_t length) {
+    size_t end = (length + LaneWidth - 1) / LaneWidth*LaneWidth;
+    Lanes scalarA = lanesBroadcast(*a);
+    Lanes scalarB = lanesBroadcast(*b);
+    for (size_t i = 0; i < end; i += LaneWidth) {
+        Lanes lanesA = IsVectorA ? lanesLoad(a + i) : scalarA;
+        Lanes lanesB = IsVectorB ? lanesLoad(b + i) : scalarB;
+        lanesStore(out + i, lanesApply<Op>(lanesA, lanesB));
+    }
+    for (size_t i = length; i < end; i++) {
+        out[i] = 0;
+    }
+}
+
+// An operand that is not a vector points to a scalar, which is broadcast to every element
+template<VectorOp Op>
+inline void vectorApply(double *out, const double *a, bool isVectorA, const double *b, bool isVectorB, uint32_t length) {
+    if (isVectorA && isVectorB) {
+        vectorApply<Op, true, true>(out, a, b, length);
+    }
+    else if (isVectorA) {
+        vectorApply<Op, true, false>(out, a, b, length);
+    }
+    else {
+        vectorApply<Op, false, true>(out, a, b, length);
+    }
+}
+
+inline double lanesSum(Lanes lanes) {
+    double values[LaneWidth];
+    lanesStore(values, lanes);
+    double sum = 0;
+    for (size_t i = 0; i < LaneWidth; i++) {
+        sum += values[i];
+    }
+    return sum;
+}
+
+inline double vectorDot(const double *a, const double *b, uint32_t length) {
+    Lanes sum = lanesBroadcast(0);
+    for (size_t i = 0; i < length; i += LaneWidth) {
+        sum = lanesAdd(sum, lanesMul(lanesLoad(a + i), lanesLoad(b + i)));
+    }
+    return lanesSum(sum);
+}
+
+inline double vectorSum(const double *a, uint32_t length) {
+    Lanes sum = lanesBroadcast(0);
+    for (size_t i = 0; i < length; i += LaneWidth) {
+        sum = lanesAdd(sum, lanesLoad(a + i));
+    }
+    return lanesSum(sum);
+}
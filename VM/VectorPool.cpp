@@ -0,0 +1,55 @@
+#include "VectorPool.hpp"
+#include <algorithm>
+
+VectorPool::VectorPool() {
+    mChunk = 0;
+    mBlock = 0;
+}
+
+double VectorPool::create(uint32_t length, double *&data) {
+    size_t blocksCount = std::max<size_t>((length + VectorBlockWidth - 1) / VectorBlockWidth, 1);
+    // A chunk too small for the vector is skipped, the next release() makes it usable again
+    while (mChunk < mChunks.size() && mBlock + blocksCount > mChunks[mChunk].size) {
+        mChunk++;
+        mBlock = 0;
+    }
+    if (mChunk == mChunks.size()) {
+        size_t size = std::max(VectorChunkBlocks, blocksCount);
+        mChunks.push_back({ std::make_unique<VectorBlock[]>(size), size });
+    }
+    VectorBlock *blocks = mChunks[mChunk].blocks.get() + mBlock;
+    memset(blocks + blocksCount - 1, 0, sizeof(VectorBlock));
+    data = blocks->values;
+    mVectors.push_back({ data, length, mChunk, mBlock });
+    mBlock += static_cast<uint32_t>(blocksCount);
+    return makeVectorValue(static_cast<uint32_t>(mVectors.size() - 1));
+}
+
+const VectorRef *VectorPool::find(double value) const {
+    if (!isVectorValue(value)) {
+        return nullptr;
+    }
+    uint32_t index = getVectorIndex(value);
+    return index < mVectors.size() ? &mVectors[index] : nullptr;
+}
+
+size_t VectorPool::getCount() const {
+    return mVectors.size();
+}
+
+void VectorPool::release(size_t count) {
+    if (count >= mVectors.size()) {
+        return;
+    }
+    mChunk = mVectors[count].chunk;
+    mBlock = mVectors[count].block;
+    mVectors.resize(count);
+}
+
+size_t VectorPool::getAllocatedSize() const {
+    size_t size = mVectors.capacity()*sizeof(VectorRef) + mChunks.capacity()*sizeof(Chunk);
+    for (const auto &chunk : mChunks) {
+        size += chunk.size*sizeof(VectorBlock);
+    }
+    return size;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// A vector value is a quiet NaN no arithmetic produces by itself: the tag in the high bits and the index of the
+// vector in the VectorPool of its VM in the low ones. It moves through stacks, frames and calls as any other
+// double, and a NaN result of + - * / is the only sign that the operands may have been vectors.
+const uint64_t VectorTag = 0x7FFC000000000000ull;
+const uint64_t VectorTagMask = 0xFFFF000000000000ull;
+// Doubles per 64-byte block, every vector starts on a cache line and is padded with zeros to a whole block
+const size_t VectorBlockWidth = 8;
+// Blocks the pool allocates at once, 32 KB
+const size_t VectorChunkBlocks = 512;
+
+inline bool isVectorValue(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & VectorTagMask) == VectorTag;
+}
+
+inline uint32_t getVectorIndex(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return static_cast<uint32_t>(bits);
+}
+
+inline double makeVectorValue(uint32_t index) {
+    uint64_t bits = VectorTag | index;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+struct alignas(64) VectorBlock {
+    double values[VectorBlockWidth];
+};
+
+struct VectorRef {
+    double *data;
+    uint32_t length;
+    // Where the vector was allocated, release() rewinds the pool there
+    uint32_t chunk;
+    uint32_t block;
+};
+
+// Bump allocator for the vectors of one VM. Vectors are never freed one by one: VM::start releases all of them and
+// VM::call those the call created, while the chunks stay for the next run, so a warm VM computes without allocating.
+class VectorPool {
+public:
+    VectorPool();
+
+    // Returns the new vector value, data receives its length elements. The padding after them is already zero.
+    double create(uint32_t length, double *&data);
+    // nullptr if the value is not a vector of this pool
+    const VectorRef *find(double value) const;
+    // Vectors created so far, a mark for release()
+    size_t getCount() const;
+    // Drops every vector created after the first count
+    void release(size_t count);
+    size_t getAllocatedSize() const;
+
+private:
+    struct Chunk {
+        std::unique_ptr<VectorBlock[]> blocks;
+        size_t size;
+    };
+
+    std::vector<Chunk> mChunks;
+    std::vector<VectorRef> mVectors;
+    // Next free block
+    uint32_t mChunk;
+    uint32_t mBlock;
+};
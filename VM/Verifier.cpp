@@ -0,0 +1,325 @@
+#include "Verifier.hpp"
+#include "../Builtins.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+static void getStackEffect(const Instruction &ins, int32_t &pops, int32_t &pushes) {
+    pops = 0;
+    pushes = 0;
+    switch (ins.opCode) {
+        case OpCode::Add:
+        case OpCode::Sub:
+        case OpCode::Mul:
+        case OpCode::Div:
+        case OpCode::VecDot: {
+            pops = 2;
+            pushes = 1;
+            break;
+        }
+        case OpCode::Push:
+        case OpCode::Get:
+        case OpCode::LoadLocal:
+        case OpCode::LoadOuter: {
+            pushes = 1;
+            break;
+        }
+        case OpCode::Pop:
+        case OpCode::Set:
+        case OpCode::Int:
+        case OpCode::StoreLocal: {
+            pops = 1;
+            break;
+        }
+        case OpCode::Native: {
+            pops = static_cast<int32_t>(builtins[ins.id].argsCount);
+            pushes = 1;
+            break;
+        }
+        case OpCode::Vec: {
+            pops = static_cast<int32_t>(ins.size);
+            pushes = 1;
+            break;
+        }
+        case OpCode::VecSum:
+        case OpCode::Neg: {
+            pops = 1;
+            pushes = 1;
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+Verifier::Verifier(const std::vector<Instruction> &code, const std::vector<uint32_t> &offsets, const BytecodeHeader &header,
+                   uint32_t entry)
+    : mCode(code), mOffsets(offsets), mHeader(header) {
+    mEntry = entry;
+}
+
+bool Verifier::verify() {
+    mSummaries.clear();
+    mScopeSizes.clear();
+    mErrorText.clear();
+    if (mCode.empty()) {
+        return true;
+    }
+    try {
+        for (const auto &ins : mCode) {
+            if (ins.opCode == OpCode::Enter) {
+                mScopeSizes[ins.scope] = std::max(mScopeSizes[ins.scope], ins.size);
+            }
+        }
+
+        const FunctionSummary &root = mVerifyFunction(mEntry);
+        // The global scope is active before its Enter, run() starts with frame base 0
+        for (ScopeIndex scope : root.outerScopes) {
+            if (scope != 0) {
+                mError(mEntry, "scope '" + std::to_string(scope) + "' may be read while it is not active");
+            }
+        }
+        if (root.maxDepth > static_cast<int32_t>(mHeader.stackDepth)) {
+            mError(mEntry, "header stack depth " + std::to_string(mHeader.stackDepth) + " is less than " + std::to_string(root.maxDepth));
+        }
+        if (root.callDepth > mHeader.callDepth) {
+            mError(mEntry, "header call depth " + std::to_string(mHeader.callDepth) + " is less than " + std::to_string(root.callDepth));
+        }
+        if (root.frameSlots > mHeader.frameSlots) {
+            mError(mEntry, "header frame slots " + std::to_string(mHeader.frameSlots) + " are less than " + std::to_string(root.frameSlots));
+        }
+    }
+    catch (...) {
+        return false;
+    }
+    return true;
+}
+
+bool Verifier::verifyHostCall(uint32_t entry) {
+    auto root = mSummaries.find(mEntry);
+    if (root == mSummaries.end()) {
+        return false;
+    }
+    try {
+        auto it = mSummaries.find(entry);
+        const FunctionSummary &summary = it != mSummaries.end() ? it->second : mVerifyFunction(entry);
+        // The call starts above the values and the frame the top level left, with only the global scope active
+        for (ScopeIndex scope : summary.outerScopes) {
+            if (scope != 0) {
+                mError(entry, "scope '" + std::to_string(scope) + "' may be read while it is not active");
+            }
+        }
+        if (root->second.netDepth - summary.minDepth + summary.maxDepth > static_cast<int32_t>(mHeader.stackDepth)) {
+            mError(entry, "header stack depth " + std::to_string(mHeader.stackDepth) + " is too small for a host call");
+        }
+        if (summary.callDepth + 1 > mHeader.callDepth) {
+            mError(entry, "header call depth " + std::to_string(mHeader.callDepth) + " is too small for a host call");
+        }
+        if (mScopeSizes[0] + summary.frameSlots > mHeader.frameSlots) {
+            mError(entry, "header frame slots " + std::to_string(mHeader.frameSlots) + " are too few for a host call");
+        }
+    }
+    catch (...) {
+        return false;
+    }
+    return true;
+}
+
+const std::string &Verifier::getError() const {
+    return mErrorText;
+}
+
+const FunctionSummary &Verifier::mVerifyFunction(size_t entry) {
+    FunctionSummary &summary = mSummaries[entry];
+    summary.isVisiting = true;
+
+    int32_t depth = 0;
+    uint32_t frameSlots = 0;
+    bool hasFrame = false;
+    ScopeIndex scope = 0;
+    // Stack depth at the Memo of the function, a remembered result is pushed there and returned at once
+    bool hasMemo = false;
+    int32_t memoDepth = 0;
+    bool isRegister = (mHeader.flags & static_cast<uint16_t>(BytecodeFlags::Register)) != 0;
+    std::vector<bool> isVisited(mCode.size(), false);
+    size_t i = entry;
+    while (true) {
+        // Running off the end of the code halts the program
+        if (i >= mCode.size()) {
+            summary.isDiverging = true;
+            break;
+        }
+        // Every pass of a loop may push, enter or call once more, and the compiler never emits one
+        if (isVisited[i]) {
+            mError(i, "loop in the code");
+        }
+        isVisited[i] = true;
+
+        const auto &ins = mCode[i];
+        if (ins.opCode == OpCode::Jmp) {
+            i = ins.address;
+            continue;
+        }
+        else if (ins.opCode == OpCode::Call || ins.opCode == OpCode::RegCall || ins.opCode == OpCode::TailCall ||
+                 ins.opCode == OpCode::RegTailCall) {
+            bool isTailCall = ins.opCode == OpCode::TailCall || ins.opCode == OpCode::RegTailCall;
+            if (isTailCall && entry == mEntry) {
+                mError(i, "tail call outside of function");
+            }
+            // A stack tail call really puts the callee frame at the current base, above it is a safe bound
+            uint32_t calleeBase = frameSlots;
+            if (ins.opCode == OpCode::RegTailCall) {
+                if (ins.regs[0] + ins.regs[1] > frameSlots) {
+                    mError(i, "arguments of the tail call are out of the frame");
+                }
+                calleeBase = 0;
+            }
+            else if (ins.opCode == OpCode::RegCall) {
+                mCheckOperand(i, ins.regs[0], frameSlots);
+                if (ins.regs[1] > frameSlots) {
+                    mError(i, "register 'r" + std::to_string(ins.regs[1]) + "' is out of the frame");
+                }
+                calleeBase = ins.regs[1];
+            }
+            auto it = mSummaries.find(ins.address);
+            if (it != mSummaries.end() && it->second.isVisiting) {
+                // Not an error, but the depth of a recursion can only be checked while it runs
+                mError(i, "recursive call");
+            }
+            const FunctionSummary &callee = it != mSummaries.end() ? it->second : mVerifyFunction(ins.address);
+            summary.minDepth = std::min(summary.minDepth, depth + callee.minDepth);
+            if (entry == mEntry && summary.minDepth < 0) {
+                mError(i, "operand stack underflow");
+            }
+            summary.maxDepth = std::max(summary.maxDepth, depth + callee.maxDepth);
+            summary.frameSlots = std::max(summary.frameSlots, calleeBase + callee.frameSlots);
+            summary.callDepth = std::max(summary.callDepth, callee.callDepth + 1);
+            for (ScopeIndex outer : callee.outerScopes) {
+                // The caller of a tail call has already left its scope
+                if (!hasFrame || outer != scope || isTailCall) {
+                    summary.outerScopes.insert(outer);
+                }
+            }
+            if (callee.isDiverging) {
+                summary.isDiverging = true;
+                break;
+            }
+            depth += callee.netDepth;
+            if (isTailCall) {
+                break;
+            }
+        }
+        else if (ins.opCode == OpCode::Ret || ins.opCode == OpCode::RegRet) {
+            if (entry == mEntry) {
+                mError(i, "ret outside of function");
+            }
+            if (ins.opCode == OpCode::RegRet) {
+                mCheckOperand(i, ins.regs[0], frameSlots);
+            }
+            break;
+        }
+        else if (ins.opCode == OpCode::Enter) {
+            if (hasFrame) {
+                mError(i, "second enter in one function");
+            }
+            hasFrame = true;
+            scope = ins.scope;
+            frameSlots = ins.size;
+            summary.frameSlots = std::max(summary.frameSlots, frameSlots);
+        }
+        else if (ins.opCode == OpCode::LoadOuter || ins.opCode == OpCode::RegLoadOuter) {
+            if (ins.slot >= mScopeSizes[ins.scope]) {
+                mError(i, "slot '" + std::to_string(ins.slot) + "' is out of the frame of scope '" + std::to_string(ins.scope) + "'");
+            }
+            if (!hasFrame || ins.scope != scope) {
+                summary.outerScopes.insert(ins.scope);
+            }
+            if (ins.opCode == OpCode::RegLoadOuter) {
+                mCheckOperand(i, ins.regs[0], frameSlots);
+            }
+        }
+        else if (ins.opCode == OpCode::LoadLocal || ins.opCode == OpCode::StoreLocal || ins.opCode == OpCode::RegLoadK) {
+            mCheckOperand(i, ins.slot, frameSlots);
+        }
+        else if (ins.opCode == OpCode::RegAdd || ins.opCode == OpCode::RegSub || ins.opCode == OpCode::RegMul || ins.opCode == OpCode::RegDiv) {
+            mCheckOperand(i, ins.regs[0], frameSlots);
+            mCheckOperand(i, ins.regs[1], frameSlots);
+            mCheckOperand(i, ins.regs[2], frameSlots);
+        }
+        else if (ins.opCode == OpCode::RegVecDot) {
+            mCheckOperand(i, ins.regs[0], frameSlots);
+            mCheckOperand(i, ins.regs[1], frameSlots);
+            mCheckOperand(i, ins.regs[2], frameSlots);
+        }
+        else if (ins.opCode == OpCode::RegMove || ins.opCode == OpCode::RegVecSum || ins.opCode == OpCode::RegNeg) {
+            mCheckOperand(i, ins.regs[0], frameSlots);
+            mCheckOperand(i, ins.regs[1], frameSlots);
+        }
+        else if (ins.opCode == OpCode::RegPrint) {
+            mCheckOperand(i, ins.regs[0], frameSlots);
+        }
+        else if (ins.opCode == OpCode::RegNative) {
+            mCheckOperand(i, ins.regs[0], frameSlots);
+            if (ins.regs[1] + builtins[ins.id].argsCount > frameSlots) {
+                mError(i, "arguments of the builtin are out of the frame");
+            }
+        }
+        else if (ins.opCode == OpCode::RegVec) {
+            mCheckOperand(i, ins.regs[0], frameSlots);
+            if (ins.regs[1] + ins.size > frameSlots) {
+                mError(i, "elements of the vector are out of the frame");
+            }
+        }
+        else if (ins.opCode == OpCode::Memo) {
+            if (entry == mEntry) {
+                mError(i, "memo outside of function");
+            }
+            if (ins.size > frameSlots) {
+                mError(i, "arguments of the memo are out of the frame");
+            }
+            if (hasMemo) {
+                mError(i, "second memo in one function");
+            }
+            hasMemo = true;
+            memoDepth = depth;
+            if (!isRegister) {
+                summary.maxDepth = std::max(summary.maxDepth, depth + 1);
+            }
+        }
+        else if (ins.opCode == OpCode::Int && ins.id != 0) {
+            mError(i, "unknown interruption '" + std::to_string(ins.id) + "'");
+        }
+        else if (ins.opCode == OpCode::Get || ins.opCode == OpCode::Unset) {
+            mError(i, "named variables are only checked at runtime");
+        }
+
+        int32_t pops, pushes;
+        getStackEffect(ins, pops, pushes);
+        summary.minDepth = std::min(summary.minDepth, depth - pops);
+        depth += pushes - pops;
+        summary.maxDepth = std::max(summary.maxDepth, depth);
+        // Only the top level starts with an empty stack, functions may pop their arguments
+        if (entry == mEntry && summary.minDepth < 0) {
+            mError(i, "operand stack underflow");
+        }
+        i++;
+    }
+    // The caller must find the same stack whether the result was remembered or computed
+    if (!isRegister && hasMemo && !summary.isDiverging && depth != memoDepth + 1) {
+        mError(entry, "function leaves " + std::to_string(depth - memoDepth) + " values where its memo leaves one");
+    }
+    summary.netDepth = depth;
+    summary.isVisiting = false;
+    return summary;
+}
+
+void Verifier::mCheckOperand(size_t index, uint32_t operand, uint32_t frameSlots) {
+    if (operand >= frameSlots) {
+        mError(index, "operand '" + std::to_string(operand) + "' is out of the frame");
+    }
+}
+
+void Verifier::mError(size_t index, const std::string &text) {
+    mErrorText = "VerifyError(" + std::to_string(mOffsets[index]) + "): " + text;
+    throw std::runtime_error("verify error");
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "Instruction.hpp"
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+
+struct FunctionSummary {
+    // Operand stack depths relative to the function entry, a function may pop its arguments
+    int32_t minDepth;
+    int32_t maxDepth;
+    int32_t netDepth;
+    uint32_t frameSlots;
+    uint32_t callDepth;
+    // Scopes read by LoadOuter here or in callees that the function itself doesn't activate
+    std::set<ScopeIndex> outerScopes;
+    bool isVisiting;
+    // The program never comes back from the function: it loops forever or runs off the end of the code
+    bool isDiverging;
+};
+
+// Proves once at load time what the interpreter would otherwise check on every instruction: the header capacities
+// are enough for the stacks and frames, every operand is inside its frame, the top level never returns and every
+// scope read by LoadOuter is active. Opcodes, operand sizes and jump targets are already checked by the decoder.
+class Verifier {
+public:
+    Verifier(const std::vector<Instruction> &code, const std::vector<uint32_t> &offsets, const BytecodeHeader &header, uint32_t entry);
+
+    // Returns false if the program has to keep the runtime checks, getError tells why
+    bool verify();
+    // Whether a host may call the function at entry without the runtime checks once the top level has finished.
+    // Only meaningful after verify() succeeded.
+    bool verifyHostCall(uint32_t entry);
+    const std::string &getError() const;
+
+private:
+    const FunctionSummary &mVerifyFunction(size_t entry);
+    void mCheckOperand(size_t index, uint32_t operand, uint32_t frameSlots);
+    void mError(size_t index, const std::string &text);
+
+    const std::vector<Instruction> &mCode;
+    const std::vector<uint32_t> &mOffsets;
+    const BytecodeHeader &mHeader;
+    // The top level, the only code that starts with an empty operand stack
+    uint32_t mEntry;
+    // Largest Enter of every scope, bounds the slots of LoadOuter
+    std::map<ScopeIndex, uint32_t> mScopeSizes;
+    std::map<size_t, FunctionSummary> mSummaries;
+    std::string mErrorText;
+};
@@ -0,0 +1,104 @@
+#include "WorkerPool.hpp"
+#include <algorithm>
+
+WorkerPool::WorkerPool(std::shared_ptr<const Program> program, size_t threadsCount) {
+    mProgram = std::move(program);
+    mQueuedCount = 0;
+    mPendingCount = 0;
+    mNextWorker = 0;
+    mIsStopping = false;
+    threadsCount = std::max<size_t>(threadsCount, 1);
+    for (size_t i = 0; i < threadsCount; i++) {
+        mWorkers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threadsCount; i++) {
+        mThreads.emplace_back(&WorkerPool::mWorkerLoop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mIsStopping = true;
+    }
+    mJobCondition.notify_all();
+    for (auto &thread : mThreads) {
+        thread.join();
+    }
+}
+
+size_t WorkerPool::getThreadsCount() const {
+    return mThreads.size();
+}
+
+void WorkerPool::submit(PoolJob job) {
+    size_t index;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        index = mNextWorker++ % mWorkers.size();
+        mPendingCount++;
+        mQueuedCount++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mWorkers[index]->mutex);
+        mWorkers[index]->jobs.push_back(std::move(job));
+    }
+    mJobCondition.notify_one();
+}
+
+void WorkerPool::wait() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDoneCondition.wait(lock, [this]() { return mPendingCount == 0; });
+}
+
+void WorkerPool::mWorkerLoop(size_t index) {
+    VM vm(mProgram);
+
+    while (true) {
+        PoolJob job;
+        if (mTakeJob(index, job)) {
+            try {
+                job(vm);
+            }
+            catch (...) {
+            }
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (--mPendingCount == 0) {
+                mDoneCondition.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mJobCondition.wait(lock, [this]() { return mIsStopping || mQueuedCount > 0; });
+        if (mIsStopping && mQueuedCount == 0) {
+            return;
+        }
+    }
+}
+
+bool WorkerPool::mTakeJob(size_t index, PoolJob &job) {
+    {
+        // Newest own job first, it is the most likely to still be in cache
+        auto &worker = *mWorkers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.jobs.empty()) {
+            job = std::move(worker.jobs.back());
+            worker.jobs.pop_back();
+            mQueuedCount--;
+            return true;
+        }
+    }
+    for (size_t i = 1; i < mWorkers.size(); i++) {
+        // Oldest job of the victim, the owner keeps working on the other end
+        auto &victim = *mWorkers[(index + i) % mWorkers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            mQueuedCount--;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "VM.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A job gets the VM of the worker that runs it, every worker owns one execution context over the shared program
+using PoolJob = std::function<void(VM &vm)>;
+
+// Fixed set of threads running jobs against one Program. Each worker has its own deque: it takes work from the
+// back of it and, once it is empty, steals from the front of the others, so a burst of jobs submitted at once
+// spreads over all cores without a single shared queue.
+class WorkerPool {
+public:
+    WorkerPool(std::shared_ptr<const Program> program, size_t threadsCount = std::thread::hardware_concurrency());
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool &operator=(const WorkerPool&) = delete;
+
+    size_t getThreadsCount() const;
+    void submit(PoolJob job);
+    // Blocks until every job submitted so far has finished
+    void wait();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<PoolJob> jobs;
+    };
+
+    void mWorkerLoop(size_t index);
+    bool mTakeJob(size_t index, PoolJob &job);
+
+    std::shared_ptr<const Program> mProgram;
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::vector<std::thread> mThreads;
+    std::mutex mMutex;
+    std::condition_variable mJobCondition;
+    std::condition_variable mDoneCondition;
+    // Jobs submitted but not taken yet, grows under mMutex so that sleeping workers can't miss a job
+    std::atomic<size_t> mQueuedCount;
+    size_t mPendingCount;
+    size_t mNextWorker;
+    bool mIsStopping;
+};
@@ -1,19 +1,38 @@
 #include "VM.hpp"
+#include "Benchmark.hpp"
+#include "NGramProfile.hpp"
+#include "MappedFile.hpp"
+#include "Scheduler.hpp"
 #include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <thread>
 
 int main(int argc, char **argv) {
-    std::vector<uint8_t> bc;
+    MappedFile file;
+    int benchmarkIterations = 0;
+    size_t ngramsTop = 0;
+    uint32_t jitThreshold = 0;
+    bool isBatch = false;
+    std::string batchFunction;
+    size_t batchArgsCount = 0;
+    size_t batchRows = 1000000;
+    size_t threadsCount = 0;
+    size_t tenants = 0;
+    uint64_t sliceFuel = DefaultSliceFuel;
+    bool isChecked = false;
+    bool isVerifyOnly = false;
+    bool isProfiled = false;
+    std::string tracePath;
+    size_t traceCapacity = DefaultTraceCapacity;
+    std::string saveSnapshotPath;
+    std::string loadSnapshotPath;
+    size_t memoCapacity = DefaultMemoCapacity;
+    DispatchMode mode = DispatchMode::Threaded;
 
-    if (argc > 0) {
-        FILE *f = fopen(argv[1], "rb");
-        if (f) {
-            fseek(f, 0, SEEK_END);
-            bc.resize(ftell(f));
-            fseek(f, 0, SEEK_SET);
-            fread(bc.data(), 1, bc.size(), f);
-            fclose(f);
-        }
-        else {
+    if (argc > 1) {
+        if (!file.open(argv[1])) {
             printf("Error: file not found\n");
         }
     }
@@ -21,9 +40,196 @@ int main(int argc, char **argv) {
         printf("Error: bytecode does not loaded\n");
     }
 
-    auto vm = VM(bc);
-    vm.run();
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--benchmark") == 0) {
+            benchmarkIterations = 100000;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                benchmarkIterations = std::stoi(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--ngrams") == 0) {
+            ngramsTop = 20;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                ngramsTop = std::stoi(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--jit") == 0) {
+            jitThreshold = DefaultJitThreshold;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                jitThreshold = std::stoi(argv[++i]);
+            }
+            if (!Jit::isSupported()) {
+                printf("Warning: JIT is not supported on this platform\n");
+            }
+        }
+        else if (strcmp(argv[i], "--batch") == 0) {
+            if (i + 2 >= argc) {
+                printf("Error: --batch expects a function name or address and an arguments count\n");
+                break;
+            }
+            isBatch = true;
+            batchFunction = argv[++i];
+            batchArgsCount = std::stoi(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                batchRows = std::stoi(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--threads") == 0) {
+            threadsCount = std::thread::hardware_concurrency();
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                threadsCount = std::stoi(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--tenants") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --tenants expects a number of VMs\n");
+                break;
+            }
+            tenants = std::stoul(argv[++i]);
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                sliceFuel = std::stoull(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--checked") == 0) {
+            isChecked = true;
+        }
+        else if (strcmp(argv[i], "--profile") == 0) {
+            isProfiled = true;
+        }
+        else if (strcmp(argv[i], "--trace") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --trace expects a file path\n");
+                break;
+            }
+            tracePath = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                traceCapacity = std::stoul(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--save-snapshot") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --save-snapshot expects a file path\n");
+                break;
+            }
+            saveSnapshotPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--load-snapshot") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --load-snapshot expects a file path\n");
+                break;
+            }
+            loadSnapshotPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--memo") == 0) {
+            if (i + 1 >= argc) {
+                printf("Error: --memo expects a number of entries, 0 turns memoization off\n");
+                break;
+            }
+            memoCapacity = std::stoul(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--verify") == 0) {
+            isVerifyOnly = true;
+        }
+        else if (strcmp(argv[i], "--table") == 0) {
+            mode = DispatchMode::Table;
+        }
+        else {
+            printf("Error: unknown option '%s'\n", argv[i]);
+        }
+    }
+
+    BytecodeView bc = file.getView();
+    if (isVerifyOnly) {
+        Program program(bc);
+        if (program.isVerified()) {
+            printf("Verified, running without runtime checks\n");
+        }
+        else {
+            printf("Not verified, running with runtime checks: %s\n", program.getVerifyError().data());
+        }
+    }
+    else if (isBatch) {
+        Program program(bc, false);
+        const ProgramFunction *function = program.findFunction(batchFunction);
+        if (function) {
+            runBatchBenchmark(bc, function->address, batchArgsCount, batchRows);
+        }
+        else if (isdigit(static_cast<unsigned char>(batchFunction[0]))) {
+            runBatchBenchmark(bc, std::stoi(batchFunction), batchArgsCount, batchRows);
+        }
+        else {
+            printf("Error: unknown function '%s'\n", batchFunction.data());
+        }
+    }
+    else if (ngramsTop > 0) {
+        runNGramProfile(bc, ngramsTop);
+    }
+    else if (tenants > 0) {
+        runSchedulerBenchmark(bc, tenants, threadsCount > 0 ? threadsCount : std::thread::hardware_concurrency(), sliceFuel,
+                              memoCapacity);
+    }
+    else if (benchmarkIterations > 0 && threadsCount > 0) {
+        runPoolBenchmark(bc, benchmarkIterations, threadsCount);
+    }
+    else if (benchmarkIterations > 0) {
+        runBenchmark(bc, benchmarkIterations);
+    }
+    else {
+        auto program = std::make_shared<const Program>(bc);
+        auto vm = VM(program);
+        vm.setJitThreshold(jitThreshold);
+        vm.setCheckEnabled(isChecked);
+        vm.setMemoCapacity(memoCapacity);
+        Profiler profiler;
+        if (isProfiled) {
+            vm.setProfiler(&profiler);
+        }
+        std::unique_ptr<TraceWriter> traceWriter;
+        if (!tracePath.empty()) {
+            traceWriter = std::make_unique<TraceWriter>(*program, tracePath, traceCapacity);
+            if (traceWriter->isOpen()) {
+                vm.setTraceWriter(traceWriter.get());
+            }
+            else {
+                printf("Error: can't create trace file '%s'\n", tracePath.data());
+            }
+        }
+        // A restored VM goes on from the saved instruction instead of running the top level again
+        MappedFile snapshotFile;
+        if (!loadSnapshotPath.empty() && (!snapshotFile.open(loadSnapshotPath) || !vm.loadSnapshot(snapshotFile.getView()))) {
+            printf("Error: can't load snapshot '%s', running from the start\n", loadSnapshotPath.data());
+            loadSnapshotPath.clear();
+        }
+        if (loadSnapshotPath.empty()) {
+            vm.run(mode);
+        }
+        else {
+            vm.resume(mode);
+        }
+        if (!saveSnapshotPath.empty()) {
+            std::vector<uint8_t> snapshot = vm.saveSnapshot();
+            FILE *f = fopen(saveSnapshotPath.data(), "wb");
+            if (f) {
+                fwrite(snapshot.data(), 1, snapshot.size(), f);
+                fclose(f);
+            }
+            else {
+                printf("Error: can't create snapshot file '%s'\n", saveSnapshotPath.data());
+            }
+        }
+        if (isProfiled) {
+            profiler.print(*program);
+            if (program->getMemoReturn() != UINT32_MAX) {
+                printf("Memo: %llu hits, %llu misses\n", static_cast<unsigned long long>(vm.getMemoHitsCount()),
+                       static_cast<unsigned long long>(vm.getMemoMissesCount()));
+            }
+        }
+        if (traceWriter && traceWriter->getStallCount() > 0) {
+            printf("Warning: the trace writer fell behind %llu times, raise the trace capacity\n",
+                   static_cast<unsigned long long>(traceWriter->getStallCount()));
+        }
+    }
 
     getchar();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,56 @@
+# Compiles SOURCE and checks that the VM prints the same with VM_ARGS as without them, and that the plain run
+# prints something and fails nowhere. With OTHER_COMPILER_ARGS the source is compiled a second time with them
+# instead, and the plain runs of both compiles must print the same. Run as a script:
+#   cmake -DCOMPILER=<path> -DVM=<path> -DSOURCE=<file.mls> -DWORK_DIR=<dir>
+#         [-DCOMPILER_ARGS=<args>] [-DVM_ARGS=<args> | -DOTHER_COMPILER_ARGS=<args>] -P CompareRuns.cmake
+# The arguments are separated by spaces.
+
+separate_arguments(compilerArgs UNIX_COMMAND "${COMPILER_ARGS}")
+separate_arguments(otherCompilerArgs UNIX_COMMAND "${OTHER_COMPILER_ARGS}")
+separate_arguments(vmArgs UNIX_COMMAND "${VM_ARGS}")
+
+get_filename_component(stem ${SOURCE} NAME_WE)
+
+# The compiler writes next to the source, so each compile gets its own directory
+function(compile dir args)
+    file(MAKE_DIRECTORY ${dir})
+    configure_file(${SOURCE} ${dir}/${stem}.mls COPYONLY)
+    # Every tool waits for a key before it exits
+    file(WRITE ${dir}/stdin.txt "\n")
+    execute_process(COMMAND ${COMPILER} ${stem}.mls ${args}
+                    WORKING_DIRECTORY ${dir} INPUT_FILE ${dir}/stdin.txt
+                    OUTPUT_VARIABLE compilerOutput RESULT_VARIABLE result)
+    if(NOT result EQUAL 0 OR NOT EXISTS ${dir}/${stem}.mlb)
+        message(FATAL_ERROR "Compiler ${args} failed on ${SOURCE}:\n${compilerOutput}")
+    endif()
+endfunction()
+
+function(run_vm dir args outputVar)
+    execute_process(COMMAND ${VM} ${stem}.mlb ${args}
+                    WORKING_DIRECTORY ${dir} INPUT_FILE ${dir}/stdin.txt
+                    OUTPUT_VARIABLE output RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "VM ${args} exited with '${result}' on ${SOURCE}:\n${output}")
+    endif()
+    # Only on platforms without a JIT, the run is interpreted then
+    string(REGEX REPLACE "Warning: JIT is not supported[^\n]*\n" "" output "${output}")
+    set(${outputVar} "${output}" PARENT_SCOPE)
+endfunction()
+
+compile(${WORK_DIR} "${compilerArgs}")
+run_vm(${WORK_DIR} "" expected)
+if(expected STREQUAL "" OR expected MATCHES "Error")
+    message(FATAL_ERROR "VM failed on ${SOURCE}:\n${expected}")
+endif()
+if(DEFINED OTHER_COMPILER_ARGS)
+    compile(${WORK_DIR}/other "${otherCompilerArgs}")
+    run_vm(${WORK_DIR}/other "" actual)
+    if(NOT actual STREQUAL expected)
+        message(FATAL_ERROR "Compiler ${OTHER_COMPILER_ARGS} on ${SOURCE} printed:\n${actual}\ninstead of:\n${expected}")
+    endif()
+else()
+    run_vm(${WORK_DIR} "${vmArgs}" actual)
+    if(NOT actual STREQUAL expected)
+        message(FATAL_ERROR "VM ${VM_ARGS} on ${SOURCE} printed:\n${actual}\ninstead of:\n${expected}")
+    endif()
+endif()
@@ -0,0 +1,141 @@
+#include "Compiler/Lexer.hpp"
+#include "Compiler/Parser.hpp"
+#include "Compiler/CodeBuilder.hpp"
+#include "Compiler/RegisterCodeBuilder.hpp"
+#include "VM/VM.hpp"
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Damaged .mlb files must end in a load error or a runtime error, never in a crash. Valid programs of both engines
+// are damaged on purpose, then run with fuel so that a jump made into a loop ends too.
+
+const char *Source =
+    "k = 10;\n"
+    "def f(a, b) {\n"
+    "    def inner(x) {\n"
+    "        return x * k + a;\n"
+    "    }\n"
+    "    q = a * b + 1;\n"
+    "    return sqrt(q) - inner(b) / 2;\n"
+    "}\n"
+    "def g(n) {\n"
+    "    return f(n, 3) + f(3, n) * min(n, 2);\n"
+    "}\n"
+    "print(g(4));\n"
+    "print(f(1.5, -2));\n";
+
+const uint64_t Fuel = 100000;
+
+static int failuresCount = 0;
+
+static void check(bool condition, const std::string &text) {
+    if (!condition) {
+        printf("FAILED: %s\n", text.data());
+        failuresCount++;
+    }
+}
+
+static std::vector<uint8_t> compile(bool isRegister) {
+    Lexer lexer(Source);
+    Parser parser(lexer.process());
+    std::unique_ptr<ASTRoot> root = parser.process();
+    std::unique_ptr<CodeBuilder> builder;
+    if (isRegister) {
+        builder = std::make_unique<RegisterCodeBuilder>();
+    }
+    else {
+        builder = std::make_unique<CodeBuilder>();
+    }
+    root->codegen(*builder);
+    return builder->getBytecode();
+}
+
+static const SectionEntry *findCode(const std::vector<uint8_t> &bc) {
+    const auto &header = *reinterpret_cast<const BytecodeHeader*>(bc.data());
+    const auto *sections = reinterpret_cast<const SectionEntry*>(bc.data() + sizeof(BytecodeHeader));
+    for (uint32_t i = 0; i < header.sectionsCount; i++) {
+        if (sections[i].type == SectionType::Code) {
+            return &sections[i];
+        }
+    }
+    return nullptr;
+}
+
+static RunState run(const std::vector<uint8_t> &bc, DispatchMode mode) {
+    auto program = std::make_shared<const Program>(bc);
+    VM vm(program);
+    vm.setPrintEnabled(false);
+    vm.setMemoCapacity(64);
+    if (mode == DispatchMode::Table) {
+        vm.run(DispatchMode::Table);
+        return vm.getRunState();
+    }
+    vm.start();
+    return vm.run(Fuel);
+}
+
+// The reported case: a slot far beyond the frame stack in the first instruction that reads one
+static void testSlotOutOfFrame(bool isRegister) {
+    std::string name = isRegister ? "register" : "stack";
+    std::vector<uint8_t> bc = compile(isRegister);
+    check(run(bc, DispatchMode::Threaded) == RunState::Finished, name + " program doesn't run");
+
+    const SectionEntry *code = findCode(bc);
+    Program program(bc, false);
+    OpCode target = isRegister ? OpCode::RegAdd : OpCode::LoadLocal;
+    size_t i = 0;
+    while (i < program.getCode().size() && program.getCode()[i].opCode != target) {
+        i++;
+    }
+    check(i < program.getCode().size(), name + " program has no " + getOpCodeName(target));
+    if (i == program.getCode().size()) {
+        return;
+    }
+    // Every slot operand is a SlotIndex right after the opcode
+    SlotIndex slot = 33280;
+    memcpy(bc.data() + code->offset + program.getOffsets()[i] + 1, &slot, sizeof(slot));
+
+    check(!Program(bc).isVerified(), name + " program with slot 33280 is verified");
+    check(run(bc, DispatchMode::Threaded) == RunState::Failed, name + " program with slot 33280 doesn't fail");
+    check(run(bc, DispatchMode::Table) == RunState::Failed, name + " program with slot 33280 doesn't fail in table mode");
+}
+
+// A header asking for more than the VM can allocate leaves only the halt sentinel
+static void testHugeHeader(bool isRegister) {
+    std::vector<uint8_t> bc = compile(isRegister);
+    auto &header = *reinterpret_cast<BytecodeHeader*>(bc.data());
+    header.stackDepth = UINT32_MAX;
+    check(Program(bc).getCode().size() == 1, "program with a huge stack depth is loaded");
+    check(run(bc, DispatchMode::Threaded) == RunState::Finished, "program with a huge stack depth doesn't halt");
+}
+
+// Every byte of the code flipped a few ways, the results don't matter as long as every run returns. Only fueled runs,
+// a damaged jump may loop forever.
+static void testDamagedCode(bool isRegister) {
+    const uint8_t masks[] = { 0x01, 0x02, 0x10, 0x80, 0xFF };
+    std::vector<uint8_t> bc = compile(isRegister);
+    const SectionEntry *code = findCode(bc);
+    for (uint32_t pos = code->offset; pos < code->offset + code->size; pos++) {
+        for (uint8_t mask : masks) {
+            std::vector<uint8_t> damaged = bc;
+            damaged[pos] ^= mask;
+            run(damaged, DispatchMode::Threaded);
+        }
+    }
+}
+
+int main() {
+    for (bool isRegister : { false, true }) {
+        testSlotOutOfFrame(isRegister);
+        testHugeHeader(isRegister);
+        testDamagedCode(isRegister);
+    }
+    if (failuresCount != 0) {
+        printf("%d checks failed\n", failuresCount);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}